@@ -33,7 +33,14 @@
 #define HCI_ACL_PAYLOAD_SIZE (1691 + 4)
 #define HCI_ACL_CHUNK_SIZE_ALIGNMENT 4
 #define MAX_NR_AVDTP_CONNECTIONS 1
+// sbc, plus aptx with APTX_DECODER and aac with AAC_DECODER
+#if defined(APTX_DECODER) && defined(AAC_DECODER)
+#define MAX_NR_AVDTP_STREAM_ENDPOINTS 3
+#elif defined(APTX_DECODER) || defined(AAC_DECODER)
+#define MAX_NR_AVDTP_STREAM_ENDPOINTS 2
+#else
 #define MAX_NR_AVDTP_STREAM_ENDPOINTS 1
+#endif
 #define MAX_NR_AVRCP_CONNECTIONS 2
 #define MAX_NR_BNEP_CHANNELS 1
 #define MAX_NR_BNEP_SERVICES 1
@@ -0,0 +1,306 @@
+// Accuracy, speed and memory of the AAC-LC decoder of aac_decoder.c
+// Decodes an .aac file with adts headers (e.g. ffmpeg -i music.wav -c:a aac -b:a 256k music.aac)
+// and, given the decode of a reference decoder as 16 bit stereo .wav
+// (ffmpeg -i music.aac music.wav), compares the output sample by sample:
+// largest difference and snr, after searching the best alignment in case the
+// reference skipped the priming frame. Then times the decoder per access unit of
+// 1024 audio frames (average and the slowest one, i.e. what output buffering
+// has to cover) and reports the ram it takes: decoder state, the shared tables and
+// parse state and the deepest stack, measured by painting the stack of a decoding thread.
+// Usage: aac-bench music.aac [reference.wav [iterations (default 5)]]
+
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC
+#endif
+
+#include "aac_decoder.h"
+
+
+#define MAX_ACCESS_UNITS  (30 * 60 * 48)  // half an hour
+#define MAX_LAG           (2 * AAC_DECODER_FRAME_SAMPLES)
+#define STACK_SIZE        (64 * 1024)
+#define STACK_PAINT       0xA5
+
+
+typedef struct {
+    uint32_t offset;  // of the raw_data_block in _file
+    uint32_t size;
+} access_unit_t;
+
+static uint8_t *_file;
+static access_unit_t _units[MAX_ACCESS_UNITS];
+static uint32_t _num_units;
+static uint32_t _sampling_frequency;
+static int16_t *_output;  // interleaved stereo of all access units
+static uint32_t _num_frames;
+static aac_decoder_t _decoder;
+
+
+static uint8_t *read_file(const char *filename, uint32_t *size) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) return NULL;
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t *data = length > 0 ? malloc(length) : NULL;
+    if (data && fread(data, 1, length, file) != (size_t)length) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    *size = data ? (uint32_t)length : 0;
+    return data;
+}
+
+
+// the adts headers only give the rate and the size, the raw_data_blocks go to the decoder
+static bool parse_adts(uint32_t size) {
+    static const uint32_t rates[] = { 96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050,
+                                      16000, 12000, 11025, 8000, 7350 };
+    uint32_t offset = 0;
+    while (offset + 7 <= size && _num_units < MAX_ACCESS_UNITS) {
+        const uint8_t *header = &_file[offset];
+        if (header[0] != 0xFF || (header[1] & 0xF6) != 0xF0) {
+            printf("no adts sync at %u\n", (unsigned)offset);
+            return false;
+        }
+        bool crc = !(header[1] & 1);
+        uint8_t index = (header[2] >> 2) & 0xF;
+        uint32_t length = ((header[3] & 3) << 11) | (header[4] << 3) | (header[5] >> 5);
+        uint32_t header_size = crc ? 9 : 7;
+        if ((header[6] & 3) != 0 || length <= header_size || offset + length > size || index >= 13) {
+            printf("unsupported adts frame at %u\n", (unsigned)offset);
+            return false;
+        }
+        _sampling_frequency = rates[index];
+        _units[_num_units++] = (access_unit_t){ offset + header_size, length - header_size };
+        offset += length;
+    }
+    return _num_units > 0;
+}
+
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+static uint64_t now_ticks(void) {
+#ifdef HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+
+static void *decode_all(void *arg) {
+    if (!arg) return NULL;
+    aac_decoder_init(&_decoder);
+    aac_decoder_set_sampling_frequency(&_decoder, _sampling_frequency);
+    _num_frames = 0;
+    for (uint32_t i = 0; i < _num_units; i++) {
+        int16_t *pcm = &_output[_num_frames * AAC_DECODER_CHANNELS];
+        _num_frames += aac_decoder_decode(&_decoder, &_file[_units[i].offset], _units[i].size, pcm);
+    }
+    return NULL;
+}
+
+
+// run on a painted stack, the untouched paint at its far end is what was never used
+static uint32_t stack_used(bool decode) {
+    uint8_t *stack = malloc(STACK_SIZE);
+    memset(stack, STACK_PAINT, STACK_SIZE);
+    pthread_attr_t attr;
+    pthread_t thread;
+    pthread_attr_init(&attr);
+    pthread_attr_setstack(&attr, stack, STACK_SIZE);
+    pthread_create(&thread, &attr, decode_all, decode ? &attr : NULL);
+    pthread_join(thread, NULL);
+    pthread_attr_destroy(&attr);
+
+    uint32_t unused = 0;
+    while (unused < STACK_SIZE && stack[unused] == STACK_PAINT) unused++;
+    free(stack);
+    return STACK_SIZE - unused;
+}
+
+
+// the stack of the decoder is what it takes beyond a thread that does nothing, the c library
+// keeps its thread data on the same stack. The first run binds the library calls, the
+// dynamic linker needs far more stack for that than the decoder
+static uint32_t decode_measuring_stack(void) {
+    uint32_t idle = stack_used(false);
+    stack_used(true);
+    return stack_used(true) - idle;
+}
+
+
+typedef struct {
+    double ns_per_unit;
+    double max_ns_per_unit;
+    double ticks_per_unit;
+} timing_t;
+
+
+static timing_t time_decoder(uint32_t iterations) {
+    timing_t timing = { 0 };
+    double total = 0;
+    uint64_t ticks = 0;
+    for (uint32_t n = 0; n < iterations; n++) {
+        aac_decoder_init(&_decoder);
+        aac_decoder_set_sampling_frequency(&_decoder, _sampling_frequency);
+        for (uint32_t i = 0; i < _num_units; i++) {
+            double start = now_s();
+            uint64_t start_ticks = now_ticks();
+            aac_decoder_decode(&_decoder, &_file[_units[i].offset], _units[i].size, _output);
+            ticks += now_ticks() - start_ticks;
+            double elapsed = now_s() - start;
+            total += elapsed;
+            if (elapsed * 1e9 > timing.max_ns_per_unit) timing.max_ns_per_unit = elapsed * 1e9;
+        }
+    }
+    timing.ns_per_unit = total * 1e9 / ((double)iterations * _num_units);
+    timing.ticks_per_unit = (double)ticks / ((double)iterations * _num_units);
+    return timing;
+}
+
+
+// 16 bit stereo pcm of a canonical wav file, returns the audio frames
+static uint32_t read_wav(const char *filename, int16_t **pcm) {
+    uint32_t size;
+    uint8_t *data = read_file(filename, &size);
+    if (!data || size < 12 || memcmp(data, "RIFF", 4) || memcmp(data + 8, "WAVE", 4)) {
+        free(data);
+        return 0;
+    }
+    uint32_t offset = 12;
+    bool format_ok = false;
+    while (offset + 8 <= size) {
+        uint32_t chunk = data[offset + 4] | data[offset + 5] << 8 | data[offset + 6] << 16 | (uint32_t)data[offset + 7] << 24;
+        const uint8_t *body = &data[offset + 8];
+        if (!memcmp(&data[offset], "fmt ", 4) && chunk >= 16) {
+            format_ok = body[0] == 1 && body[2] == AAC_DECODER_CHANNELS && body[14] == 16;
+        } else if (!memcmp(&data[offset], "data", 4) && format_ok) {
+            if (chunk > size - offset - 8) chunk = size - offset - 8;
+            uint32_t frames = chunk / (2 * AAC_DECODER_CHANNELS);
+            *pcm = malloc(frames * 2 * AAC_DECODER_CHANNELS + 1);
+            for (uint32_t i = 0; i < frames * AAC_DECODER_CHANNELS; i++) {
+                (*pcm)[i] = (int16_t)(body[2 * i] | body[2 * i + 1] << 8);
+            }
+            free(data);
+            return frames;
+        }
+        offset += 8 + chunk + (chunk & 1);
+    }
+    free(data);
+    return 0;
+}
+
+
+// output lagging the reference by lag audio frames (negative: leading)
+static double squared_error(const int16_t *reference, uint32_t reference_frames, int32_t lag, uint32_t *count,
+                            int32_t *max_diff) {
+    double sum = 0;
+    *count = 0;
+    *max_diff = 0;
+    for (uint32_t i = 0; i < reference_frames; i++) {
+        int64_t n = (int64_t)i + lag;
+        if (n < 0 || n >= _num_frames) continue;
+        for (uint32_t c = 0; c < AAC_DECODER_CHANNELS; c++) {
+            int32_t diff = _output[n * AAC_DECODER_CHANNELS + c] - reference[i * AAC_DECODER_CHANNELS + c];
+            sum += (double)diff * diff;
+            if (abs(diff) > *max_diff) *max_diff = abs(diff);
+        }
+        (*count)++;
+    }
+    return sum;
+}
+
+
+static bool compare(const char *filename) {
+    int16_t *reference = NULL;
+    uint32_t reference_frames = read_wav(filename, &reference);
+    if (!reference_frames) {
+        printf("cannot read %s as 16 bit stereo wav\n", filename);
+        return false;
+    }
+
+    // the alignment with the least error, checked on the first seconds only
+    uint32_t probe = reference_frames < 4 * _sampling_frequency ? reference_frames : 4 * _sampling_frequency;
+    int32_t best_lag = 0;
+    double best = INFINITY;
+    for (int32_t lag = -MAX_LAG; lag <= MAX_LAG; lag++) {
+        uint32_t count;
+        int32_t max_diff;
+        double error = squared_error(reference, probe, lag, &count, &max_diff);
+        if (count && error / count < best) {
+            best = error / count;
+            best_lag = lag;
+        }
+    }
+
+    uint32_t count;
+    int32_t max_diff;
+    double error = squared_error(reference, reference_frames, best_lag, &count, &max_diff);
+    double signal = 0;
+    for (uint32_t i = 0; i < reference_frames * AAC_DECODER_CHANNELS; i++) {
+        signal += (double)reference[i] * reference[i];
+    }
+    free(reference);
+    double rms = count ? sqrt(error / (count * AAC_DECODER_CHANNELS)) : 0;
+    double snr = error > 0 ? 10 * log10(signal / error) : INFINITY;
+    printf("# against %s: lag %d frames, %u frames compared, max difference %d, rms %.3f, snr %.1f dB\n",
+           filename, (int)best_lag, (unsigned)count, (int)max_diff, rms, snr);
+    return count > 0;
+}
+
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        printf("usage: %s music.aac [reference.wav [iterations]]\n", argv[0]);
+        return 1;
+    }
+    uint32_t size;
+    _file = read_file(argv[1], &size);
+    if (!_file || !parse_adts(size)) {
+        printf("cannot read %s as adts\n", argv[1]);
+        return 1;
+    }
+    uint32_t iterations = argc > 3 ? strtoul(argv[3], NULL, 0) : 5;
+    _output = malloc((size_t)_num_units * AAC_DECODER_FRAME_SAMPLES * AAC_DECODER_CHANNELS * sizeof(int16_t));
+
+    uint32_t stack = decode_measuring_stack();
+    uint32_t errors = aac_decoder_get_errors(&_decoder);
+    printf("# %u access units at %u Hz, %u failed\n", (unsigned)_num_units, (unsigned)_sampling_frequency,
+           (unsigned)errors);
+    printf("# ram: decoder %u bytes, shared %u bytes, stack %u bytes\n", (unsigned)sizeof(aac_decoder_t),
+           (unsigned)aac_decoder_get_static_size(), (unsigned)stack);
+
+    bool ok = errors == 0;
+    if (argc > 2) {
+        ok &= compare(argv[2]);
+    }
+
+    timing_t timing = time_decoder(iterations);
+    double frame_ns = 1e9 * AAC_DECODER_FRAME_SAMPLES / _sampling_frequency;
+    printf("access_units,ns_per_unit,max_ns_per_unit,ticks_per_unit,percent_of_realtime\n");
+    printf("%u,%.0f,%.0f,%.0f,%.2f\n", (unsigned)_num_units, timing.ns_per_unit, timing.max_ns_per_unit,
+           timing.ticks_per_unit, 100 * timing.ns_per_unit / frame_ns);
+
+    free(_output);
+    free(_file);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,31 @@
+#ifndef _HOST_ARM_ACLE_H
+#define _HOST_ARM_ACLE_H
+
+// host stand-in: the acle dsp intrinsics used by volume.c, sbc_decoder.c and aac_decoder.c, modelled in c after
+// the arm architecture reference manual, so their cortex-m33 paths can be checked on the host
+
+#include <stdint.h>
+
+static inline int32_t __smulbb(int32_t a, int32_t b) {
+    return (int32_t)(int16_t)a * (int16_t)b;
+}
+
+static inline int32_t __smultb(int32_t a, int32_t b) {
+    return (int32_t)(int16_t)((uint32_t)a >> 16) * (int16_t)b;
+}
+
+static inline int32_t __smlawb(int32_t a, int32_t b, int32_t accumulator) {
+    return accumulator + (int32_t)(((int64_t)a * (int16_t)b) >> 16);
+}
+
+static inline int32_t __smulwb(int32_t a, int32_t b) {
+    return (int32_t)(((int64_t)a * (int16_t)b) >> 16);
+}
+
+static inline int32_t __ssat(int32_t value, unsigned int bits) {
+    int32_t max = (1 << (bits - 1)) - 1;
+    int32_t min = -max - 1;
+    return value > max ? max : value < min ? min : value;
+}
+
+#endif
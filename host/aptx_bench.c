@@ -0,0 +1,305 @@
+// Bit exactness and speed of the aptX decoder of aptx_decoder.c
+// Decodes deterministic codeword streams and compares the 24 bit output with
+// hashes of what the reference decoder (aptx of ffmpeg's libavcodec) gives for
+// the same streams: random codewords with valid sync, all levels (the step sizes
+// saturate), only the lowest levels, and both alternating. With libfreeaptx
+// (found by cmake via pkg-config) it also encodes a test signal with that and
+// compares every sample with its decoder. The 16 bit output has to be the 24 bit
+// one with gain, rounded, at unity and below. Then times the decoder per 128
+// audio frames, what one sbc frame holds, so it compares with sbc-bench.
+// Usage: aptx-bench [iterations (default 20)]
+//        aptx-bench dump    writes the streams as .aptx files, to check the hashes e.g. with
+//                           ffmpeg -f aptx -i loud.aptx -f s24le - | (fnv-1a 32 of the bytes)
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC
+#endif
+
+#ifdef HAVE_FREEAPTX
+#include <freeaptx.h>
+#endif
+
+#include "aptx_decoder.h"
+#include "volume.h"
+
+
+typedef enum {
+    LEVELS_ALL,
+    LEVELS_LOW,
+    LEVELS_ALTERNATING,  // every STRETCH codewords
+} levels_t;
+
+typedef struct {
+    const char *name;
+    levels_t levels;
+    uint32_t seed;
+    uint32_t hash;  // fnv-1a 32 of the reference output, 24 bit little endian interleaved
+} stream_t;
+
+#define NUM_CODEWORDS  16384  // 1.5 s at 44.1kHz
+#define STRETCH         1024
+#define NUM_SAMPLES    (NUM_CODEWORDS * APTX_DECODER_CODEWORD_SAMPLES * APTX_DECODER_CHANNELS)
+#define FRAMES_PER_SBC_FRAME 128
+
+
+static const stream_t _streams[] = {
+    { "loud",        LEVELS_ALL,         1, 0x0ba4494a },
+    { "quiet",       LEVELS_LOW,         2, 0xbd91fe26 },
+    { "alternating", LEVELS_ALTERNATING, 3, 0x10dab19e },
+};
+
+static uint8_t _codewords[NUM_CODEWORDS * APTX_DECODER_CODEWORD_SIZE];
+static int32_t _expected[NUM_SAMPLES];
+static int16_t _output[NUM_SAMPLES];
+static uint32_t _random = 1;
+
+
+// deterministic pseudo random numbers (xorshift32) so runs are repeatable
+static uint32_t next_random(void) {
+    _random ^= _random << 13;
+    _random ^= _random >> 17;
+    _random ^= _random << 5;
+    return _random;
+}
+
+
+// 7, 4, 2 and 3 bits of levels for the subbands, low to high
+static uint16_t random_codeword(bool low) {
+    uint32_t r = next_random();
+    if (!low) return (uint16_t)r;
+
+    int32_t lf  = (int32_t)(r & 7) - 4;
+    int32_t mlf = (int32_t)((r >> 3) & 3) - 2;
+    int32_t mhf = (int32_t)((r >> 5) & 1) - 1;
+    int32_t hf  = (int32_t)((r >> 6) & 3) - 2;
+    return (lf & 0x7F) | ((mlf & 0xF) << 7) | ((mhf & 0x3) << 11) | ((hf & 0x7) << 13);
+}
+
+
+// the lowest bit of the highest subband is the parity of a channel,
+// the parities of both differ only in every 8th codeword
+static void generate(const stream_t *stream) {
+    _random = stream->seed;
+    for (uint32_t n = 0; n < NUM_CODEWORDS; n++) {
+        bool low = stream->levels == LEVELS_LOW || (stream->levels == LEVELS_ALTERNATING && (n / STRETCH) % 2);
+        uint16_t left = random_codeword(low);
+        uint16_t right = random_codeword(low);
+        if ((((left ^ right) >> 13) & 1) != (n % 8 == 7)) {
+            right ^= 1 << 13;
+        }
+        uint8_t *codeword = &_codewords[n * APTX_DECODER_CODEWORD_SIZE];
+        codeword[0] = left >> 8;
+        codeword[1] = left & 0xFF;
+        codeword[2] = right >> 8;
+        codeword[3] = right & 0xFF;
+    }
+}
+
+
+static uint32_t fnv1a_24(const int32_t *samples, uint32_t num_samples) {
+    uint32_t hash = 0x811c9dc5;
+    for (uint32_t i = 0; i < num_samples; i++) {
+        for (int byte = 0; byte < 3; byte++) {
+            hash ^= (samples[i] >> (8 * byte)) & 0xFF;
+            hash *= 0x01000193;
+        }
+    }
+    return hash;
+}
+
+
+static bool check_stream(const stream_t *stream) {
+    aptx_decoder_t decoder;
+    aptx_decoder_init(&decoder);
+    uint32_t frames = aptx_decoder_decode_24(&decoder, _codewords, sizeof(_codewords), _expected);
+
+    uint32_t hash = fnv1a_24(_expected, frames * APTX_DECODER_CHANNELS);
+    if (hash != stream->hash) {
+        printf("FAIL %s hash %08x instead of %08x\n", stream->name, (unsigned)hash, (unsigned)stream->hash);
+        return false;
+    }
+    if (aptx_decoder_get_sync_errors(&decoder)) {
+        printf("FAIL %s %u sync errors\n", stream->name, (unsigned)aptx_decoder_get_sync_errors(&decoder));
+        return false;
+    }
+    return true;
+}
+
+
+// 16 bit output against the 24 bit output of the last check_stream()
+static bool check_gain(const stream_t *stream, int32_t gain) {
+    aptx_decoder_t decoder;
+    aptx_decoder_init(&decoder);
+    aptx_decoder_set_gain(&decoder, gain);
+    uint32_t frames = aptx_decoder_decode(&decoder, _codewords, sizeof(_codewords), _output);
+
+    for (uint32_t i = 0; i < frames * APTX_DECODER_CHANNELS; i++) {
+        double scaled = floor((double)_expected[i] * gain / (1 << (8 + VOLUME_SHIFT)) + 0.5);
+        int32_t expected = scaled > INT16_MAX ? INT16_MAX : scaled < INT16_MIN ? INT16_MIN : (int32_t)scaled;
+        if (_output[i] != expected) {
+            printf("FAIL %s gain %d sample %u: %d instead of %d\n", stream->name, (int)gain, (unsigned)i,
+                   _output[i], (int)expected);
+            return false;
+        }
+    }
+    return true;
+}
+
+
+#ifdef HAVE_FREEAPTX
+// tones, a sweep and some noise, with a stretch that drives the codec into saturation
+static int32_t test_sample(uint32_t n, uint8_t channel) {
+    double t = n / 44100.0;
+    double sweep = 50.0 * pow(22050 / 50.0, fmod(t, 1.0));
+    double value = 0.4 * sin(2 * M_PI * (channel ? 1000.0 : 440.0) * t)
+                 + 0.3 * sin(2 * M_PI * sweep * t * (channel ? 0.5 : 1.0))
+                 + 0.02 * ((int32_t)(next_random() & 0xffff) - 0x8000) / 0x8000;
+    if (fmod(t, 1.0) > 0.8) value *= 3.0;
+    value *= (1 << 23) - 1;
+    return value > (1 << 23) - 1 ? (1 << 23) - 1 : value < -(1 << 23) ? -(1 << 23) : (int32_t)value;
+}
+
+
+// libfreeaptx encodes and decodes, it has to agree with aptx_decoder.c sample by sample
+static bool check_freeaptx(void) {
+    static uint8_t pcm[NUM_SAMPLES * 3];
+    static uint8_t decoded[NUM_SAMPLES * 3];
+    static int32_t output[NUM_SAMPLES];
+
+    _random = 1;
+    for (uint32_t i = 0; i < NUM_SAMPLES; i++) {
+        int32_t sample = test_sample(i / 2, i % 2);
+        pcm[3 * i + 0] = sample & 0xFF;
+        pcm[3 * i + 1] = (sample >> 8) & 0xFF;
+        pcm[3 * i + 2] = (sample >> 16) & 0xFF;
+    }
+
+    struct aptx_context *encoder = aptx_init(0);
+    struct aptx_context *reference = aptx_init(0);
+    size_t coded = 0;
+    size_t decoded_size = 0;
+    aptx_encode(encoder, pcm, sizeof(pcm), _codewords, sizeof(_codewords), &coded);
+    aptx_decode(reference, _codewords, coded, decoded, sizeof(decoded), &decoded_size);
+    aptx_finish(encoder);
+    aptx_finish(reference);
+
+    aptx_decoder_t decoder;
+    aptx_decoder_init(&decoder);
+    uint32_t num_samples = aptx_decoder_decode_24(&decoder, _codewords, coded, output) * APTX_DECODER_CHANNELS;
+
+    // libfreeaptx leaves out the first samples, the latency of the qmf
+    uint32_t num_reference = decoded_size / 3;
+    if (!coded || num_reference > num_samples) {
+        printf("FAIL libfreeaptx coded %u bytes, decoded %u samples\n", (unsigned)coded, (unsigned)num_reference);
+        return false;
+    }
+    uint32_t skip = num_samples - num_reference;
+    for (uint32_t i = 0; i < num_reference; i++) {
+        int32_t expected = (int32_t)((uint32_t)decoded[3 * i] << 8 | (uint32_t)decoded[3 * i + 1] << 16 |
+                                     (uint32_t)decoded[3 * i + 2] << 24) >> 8;
+        if (output[skip + i] != expected) {
+            printf("FAIL libfreeaptx sample %u: %d instead of %d\n", (unsigned)i, (int)output[skip + i], (int)expected);
+            return false;
+        }
+    }
+    return true;
+}
+#endif
+
+
+static void dump(void) {
+    for (size_t s = 0; s < sizeof(_streams) / sizeof(_streams[0]); s++) {
+        char filename[64];
+        snprintf(filename, sizeof(filename), "%s.aptx", _streams[s].name);
+        generate(&_streams[s]);
+        FILE *file = fopen(filename, "wb");
+        if (!file || fwrite(_codewords, 1, sizeof(_codewords), file) != sizeof(_codewords)) {
+            printf("cannot write %s\n", filename);
+        }
+        if (file) fclose(file);
+    }
+}
+
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+static uint64_t now_ticks(void) {
+#ifdef HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+
+typedef struct {
+    double ns_per_sbc_frame;
+    double ticks_per_sbc_frame;
+} timing_t;
+
+
+static timing_t time_decoder(uint32_t iterations) {
+    aptx_decoder_t decoder;
+    aptx_decoder_init(&decoder);
+
+    double start = now_s();
+    uint64_t start_ticks = now_ticks();
+    for (uint32_t i = 0; i < iterations; i++) {
+        aptx_decoder_decode(&decoder, _codewords, sizeof(_codewords), _output);
+    }
+    uint64_t ticks = now_ticks() - start_ticks;
+    double sbc_frames = (double)iterations * NUM_CODEWORDS * APTX_DECODER_CODEWORD_SAMPLES / FRAMES_PER_SBC_FRAME;
+    return (timing_t){ (now_s() - start) * 1e9 / sbc_frames, ticks / sbc_frames };
+}
+
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && !strcmp(argv[1], "dump")) {
+        dump();
+        return 0;
+    }
+    uint32_t iterations = argc > 1 ? strtoul(argv[1], NULL, 0) : 20;
+    bool ok = true;
+
+    printf("stream,codewords,ns_per_128_frames,ticks_per_128_frames\n");
+    for (size_t s = 0; s < sizeof(_streams) / sizeof(_streams[0]); s++) {
+        const stream_t *stream = &_streams[s];
+        generate(stream);
+
+        if (check_stream(stream)) {
+            ok &= check_gain(stream, VOLUME_UNITY);
+            ok &= check_gain(stream, volume_from_avrcp(100));
+            ok &= check_gain(stream, volume_from_avrcp(1));
+        } else {
+            ok = false;
+        }
+
+        timing_t timing = time_decoder(iterations);
+        printf("%s,%u,%.0f,%.0f\n", stream->name, NUM_CODEWORDS, timing.ns_per_sbc_frame, timing.ticks_per_sbc_frame);
+    }
+    printf("# aptx decoder bit exact with the reference hashes: %s\n", ok ? "yes" : "NO");
+
+#ifdef HAVE_FREEAPTX
+    bool freeaptx = check_freeaptx();
+    printf("# aptx decoder bit exact with libfreeaptx: %s\n", freeaptx ? "yes" : "NO");
+    ok &= freeaptx;
+#else
+    printf("# libfreeaptx not found, no round trip through its encoder\n");
+#endif
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,270 @@
+#define BTSTACK_FILE__ "btstack_audio_wav_sink.c"
+
+/*
+ *  btstack_audio_wav_sink.c
+ *
+ *  Host replacement for btstack_audio_pico_i2s.c
+ *
+ *  Uses the same buffer pool geometry as the pico driver, but the buffers the
+ *  virtual DAC plays are appended to a 16 bit stereo wav file. A timer fires
+ *  when the dma would complete the next buffer, like the pico dma irq does.
+ *  With I2S_CLOCK_TRIM every buffer plays for as long as the dithered pio
+ *  divider of a pico at I2S_SYS_CLOCK_HZ makes it last.
+ */
+
+#include "btstack_audio_wav_sink.h"
+
+#include "btstack_config.h"
+
+#include "btstack_debug.h"
+#include "btstack_run_loop.h"
+#include "btstack_util.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef I2S_CLOCK_TRIM
+#include "i2s_clock.h"
+#endif
+
+#include "timing.h"
+
+#ifndef I2S_BUFFER_COUNT
+#define I2S_BUFFER_COUNT          3
+#endif
+#ifndef I2S_SAMPLES_PER_BUFFER
+#define I2S_SAMPLES_PER_BUFFER  512
+#endif
+#ifndef I2S_SYS_CLOCK_HZ
+#define I2S_SYS_CLOCK_HZ  125000000  // pico w default, 150 MHz on pico 2 w
+#endif
+#define WAV_HEADER_SIZE          44
+
+// client
+static void (*playback_callback)(int16_t * buffer, uint16_t num_samples);
+
+// stands in for the dma completion irq
+static btstack_timer_source_t  driver_timer_sink;
+
+static bool     btstack_audio_wav_sink_active;
+static uint8_t  btstack_audio_wav_channel_count;
+static uint32_t btstack_audio_wav_samplerate;
+
+// virtual dac: buffers played since start of stream are derived from the run loop time
+static uint32_t btstack_audio_wav_start_ms;
+static uint32_t btstack_audio_wav_buffers_filled;
+static double   btstack_audio_wav_end_ms;                            // of the newest filled buffer, since start
+static double   btstack_audio_wav_buffer_end_ms[I2S_BUFFER_COUNT];  // by buffers filled, the oldest is next to complete
+static uint32_t btstack_audio_wav_frames_filled;                     // since init, over all streams
+#ifdef I2S_CLOCK_TRIM
+static i2s_clock_t btstack_audio_wav_clock;
+#endif
+static int16_t  btstack_audio_wav_buffer[I2S_SAMPLES_PER_BUFFER * 2];
+
+static const char * btstack_audio_wav_filename = "a2dp.wav";
+static FILE *       btstack_audio_wav_file;
+static uint32_t     btstack_audio_wav_data_bytes;
+
+
+static void write_wav_header(void){
+    uint8_t header[WAV_HEADER_SIZE];
+    uint32_t byte_rate = btstack_audio_wav_samplerate * 2 * 2;
+
+    memcpy(&header[0], "RIFF", 4);
+    little_endian_store_32(header, 4, WAV_HEADER_SIZE - 8 + btstack_audio_wav_data_bytes);
+    memcpy(&header[8], "WAVEfmt ", 8);
+    little_endian_store_32(header, 16, 16);                    // fmt chunk size
+    little_endian_store_16(header, 20, 1);                     // pcm
+    little_endian_store_16(header, 22, 2);                     // always stereo, like i2s
+    little_endian_store_32(header, 24, btstack_audio_wav_samplerate);
+    little_endian_store_32(header, 28, byte_rate);
+    little_endian_store_16(header, 32, 2 * 2);                 // block align
+    little_endian_store_16(header, 34, 16);                    // bits per sample
+    memcpy(&header[36], "data", 4);
+    little_endian_store_32(header, 40, btstack_audio_wav_data_bytes);
+
+    fseek(btstack_audio_wav_file, 0, SEEK_SET);
+    fwrite(header, 1, sizeof(header), btstack_audio_wav_file);
+    fseek(btstack_audio_wav_file, 0, SEEK_END);
+}
+
+// play time of the next buffer, the virtual dac clock is exact unless trimmed
+static double btstack_audio_wav_sink_buffer_ms(void){
+#ifdef I2S_CLOCK_TRIM
+    uint32_t divider = i2s_clock_next_divider(&btstack_audio_wav_clock);  // 16.8 like the pio takes it
+    return I2S_SAMPLES_PER_BUFFER * I2S_CLOCK_CYCLES_PER_FRAME * (divider / 256.0) * 1000.0 / I2S_SYS_CLOCK_HZ;
+#else
+    return I2S_SAMPLES_PER_BUFFER * 1000.0 / btstack_audio_wav_samplerate;
+#endif
+}
+
+static void btstack_audio_wav_sink_fill_buffer(void){
+    TIMING_BEGIN(TIMING_FILL);
+    int16_t * buffer16 = btstack_audio_wav_buffer;
+    (*playback_callback)(buffer16, I2S_SAMPLES_PER_BUFFER);
+
+    // duplicate samples for mono
+    if (btstack_audio_wav_channel_count == 1){
+        int16_t i;
+        for (i = I2S_SAMPLES_PER_BUFFER - 1 ; i >= 0; i--){
+            buffer16[2*i  ] = buffer16[i];
+            buffer16[2*i+1] = buffer16[i];
+        }
+    }
+    TIMING_END(TIMING_FILL);
+
+    // wav is little endian like the host
+    if (btstack_audio_wav_file){
+        fwrite(buffer16, 2 * 2, I2S_SAMPLES_PER_BUFFER, btstack_audio_wav_file);
+        btstack_audio_wav_data_bytes += I2S_SAMPLES_PER_BUFFER * 2 * 2;
+    }
+
+    // it plays after the buffers already queued
+    btstack_audio_wav_end_ms += btstack_audio_wav_sink_buffer_ms();
+    btstack_audio_wav_buffer_end_ms[btstack_audio_wav_buffers_filled % I2S_BUFFER_COUNT] = btstack_audio_wav_end_ms;
+    btstack_audio_wav_buffers_filled++;
+    btstack_audio_wav_frames_filled += I2S_SAMPLES_PER_BUFFER;
+}
+
+static double btstack_audio_wav_sink_elapsed_ms(void){
+    return btstack_run_loop_get_time_ms() - btstack_audio_wav_start_ms;
+}
+
+// the oldest filled buffer is next to complete, its slot is reused by the next fill
+static double btstack_audio_wav_sink_next_completion_ms(void){
+    return btstack_audio_wav_buffer_end_ms[btstack_audio_wav_buffers_filled % I2S_BUFFER_COUNT];
+}
+
+static void btstack_audio_wav_sink_fill_buffers(void){
+    // refill every buffer the dac has given back to the pool
+    while (btstack_audio_wav_buffers_filled < I2S_BUFFER_COUNT ||
+           btstack_audio_wav_sink_next_completion_ms() <= btstack_audio_wav_sink_elapsed_ms()){
+        btstack_audio_wav_sink_fill_buffer();
+    }
+}
+
+// run loop time when the dac is done with the oldest filled buffer
+static void btstack_audio_wav_sink_set_timer(btstack_timer_source_t * ts){
+    double wait_ms = btstack_audio_wav_sink_next_completion_ms() - btstack_audio_wav_sink_elapsed_ms();
+    btstack_run_loop_set_timer(ts, (uint32_t)ceil(wait_ms));
+    btstack_run_loop_add_timer(ts);
+}
+
+static void driver_timer_handler_sink(btstack_timer_source_t * ts){
+
+    // refill
+    btstack_audio_wav_sink_fill_buffers();
+
+    // wait for the next completion
+    btstack_audio_wav_sink_set_timer(ts);
+}
+
+static int btstack_audio_wav_sink_init(
+    uint8_t channels,
+    uint32_t samplerate,
+    void (*playback)(int16_t * buffer, uint16_t num_samples)
+){
+    btstack_assert(playback != NULL);
+    btstack_assert(channels != 0);
+
+    playback_callback  = playback;
+
+    btstack_audio_wav_channel_count = channels;
+    btstack_audio_wav_samplerate = samplerate;
+#ifdef I2S_CLOCK_TRIM
+    i2s_clock_init(&btstack_audio_wav_clock, I2S_SYS_CLOCK_HZ, samplerate);
+#endif
+#ifdef TIMING
+    // like the pico: after a buffer is freed, the others play while it is refilled
+    timing_set_deadline_us((uint32_t)((I2S_BUFFER_COUNT - 1) * I2S_SAMPLES_PER_BUFFER * 1000000ull / samplerate));
+#endif
+
+    btstack_audio_wav_file = fopen(btstack_audio_wav_filename, "wb");
+    if (!btstack_audio_wav_file){
+        log_error("WavSink: Unable to open %s", btstack_audio_wav_filename);
+        return -1;
+    }
+    btstack_audio_wav_data_bytes = 0;
+    btstack_audio_wav_frames_filled = 0;
+    write_wav_header();
+
+    return 0;
+}
+
+static void btstack_audio_wav_sink_set_volume(uint8_t volume){
+    UNUSED(volume);
+}
+
+static void btstack_audio_wav_sink_start_stream(void){
+
+    btstack_audio_wav_start_ms = btstack_run_loop_get_time_ms();
+    btstack_audio_wav_buffers_filled = 0;
+    btstack_audio_wav_end_ms = 0;
+
+    // pre-fill HAL buffers
+    btstack_audio_wav_sink_fill_buffers();
+
+    // wait for the first completion
+    btstack_run_loop_set_timer_handler(&driver_timer_sink, &driver_timer_handler_sink);
+    btstack_audio_wav_sink_set_timer(&driver_timer_sink);
+
+    // state
+    btstack_audio_wav_sink_active = true;
+}
+
+static void btstack_audio_wav_sink_stop_stream(void){
+
+    // stop timer
+    btstack_run_loop_remove_timer(&driver_timer_sink);
+    // state
+    btstack_audio_wav_sink_active = false;
+}
+
+static void btstack_audio_wav_sink_close(void){
+    // stop stream if needed
+    if (btstack_audio_wav_sink_active){
+        btstack_audio_wav_sink_stop_stream();
+    }
+
+    if (btstack_audio_wav_file){
+        write_wav_header();
+        fclose(btstack_audio_wav_file);
+        btstack_audio_wav_file = NULL;
+    }
+}
+
+static const btstack_audio_sink_t btstack_audio_wav_sink = {
+    .init = &btstack_audio_wav_sink_init,
+    .set_volume = &btstack_audio_wav_sink_set_volume,
+    .start_stream = &btstack_audio_wav_sink_start_stream,
+    .stop_stream = &btstack_audio_wav_sink_stop_stream,
+    .close = &btstack_audio_wav_sink_close,
+};
+
+const btstack_audio_sink_t * btstack_audio_pico_sink_get_instance(void){
+    return &btstack_audio_wav_sink;
+}
+
+bool btstack_audio_wav_sink_is_open(void){
+    return btstack_audio_wav_file != NULL;
+}
+
+void btstack_audio_wav_sink_set_filename(const char * filename){
+    btstack_audio_wav_filename = filename;
+}
+
+double btstack_audio_wav_sink_get_played_frames(void){
+    double queued = 0;
+    if (btstack_audio_wav_sink_active){
+        queued = (btstack_audio_wav_end_ms - btstack_audio_wav_sink_elapsed_ms()) * btstack_audio_wav_samplerate / 1000.0;
+        if (queued < 0) queued = 0;
+    }
+    return btstack_audio_wav_frames_filled - queued;
+}
+
+#ifdef I2S_CLOCK_TRIM
+void btstack_audio_pico_sink_set_clock_trim(int32_t ppb){
+    i2s_clock_set_trim(&btstack_audio_wav_clock, ppb);
+}
+#endif
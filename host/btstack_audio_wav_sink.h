@@ -0,0 +1,23 @@
+#ifndef btstack_audio_wav_sink_h
+#define btstack_audio_wav_sink_h
+
+#include <btstack_audio.h>
+
+// stands in for the pico i2s sink, so a2dp.c can use it unchanged
+const btstack_audio_sink_t * btstack_audio_pico_sink_get_instance(void);
+
+#ifdef I2S_CLOCK_TRIM
+// play faster (positive) or slower than nominal, parts per billion
+void btstack_audio_pico_sink_set_clock_trim(int32_t ppb);
+#endif
+
+// file that receives the played samples (default a2dp.wav)
+void btstack_audio_wav_sink_set_filename(const char * filename);
+
+// between init and close, like the i2s output of the pico is set up
+bool btstack_audio_wav_sink_is_open(void);
+
+// audio frames the virtual dac has played since init, the playing buffer in part
+double btstack_audio_wav_sink_get_played_frames(void);
+
+#endif
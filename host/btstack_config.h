@@ -0,0 +1,15 @@
+#ifndef _HOST_BTSTACK_CONFIG_H
+#define _HOST_BTSTACK_CONFIG_H
+
+// same buffers and features as on the pico, see ../btstack_config.h
+#include "../btstack_config.h"
+
+// normally defined by the pico_btstack_classic library
+#define ENABLE_CLASSIC
+
+// posix run loop instead of the pico async context
+#undef HAVE_EMBEDDED_TIME_MS
+#define HAVE_POSIX_TIME
+#define HAVE_MALLOC
+
+#endif // _HOST_BTSTACK_CONFIG_H
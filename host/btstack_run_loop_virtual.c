@@ -0,0 +1,84 @@
+#define BTSTACK_FILE__ "btstack_run_loop_virtual.c"
+
+/*
+ *  btstack_run_loop_virtual.c
+ *
+ *  Timer only run loop for host simulations. Time does not pass while
+ *  handlers execute, it advances to the next timeout once all work is done.
+ */
+
+#include "btstack_run_loop_virtual.h"
+
+#include "btstack_config.h"
+
+#include "btstack_debug.h"
+#include "btstack_run_loop_base.h"
+
+static uint32_t btstack_run_loop_virtual_time_ms;
+static bool     btstack_run_loop_virtual_exit_requested;
+
+
+static uint32_t btstack_run_loop_virtual_get_time_ms(void){
+    return btstack_run_loop_virtual_time_ms;
+}
+
+static void btstack_run_loop_virtual_set_timer(btstack_timer_source_t * ts, uint32_t timeout_in_ms){
+    ts->timeout = btstack_run_loop_virtual_time_ms + timeout_in_ms;
+}
+
+static void btstack_run_loop_virtual_execute(void){
+    btstack_run_loop_virtual_exit_requested = false;
+
+    while (!btstack_run_loop_virtual_exit_requested){
+        btstack_run_loop_base_execute_callbacks();
+        btstack_run_loop_base_poll_data_sources();
+        btstack_run_loop_base_process_timers(btstack_run_loop_virtual_time_ms);
+
+        if (btstack_run_loop_virtual_exit_requested) break;
+
+        int32_t timeout_ms = btstack_run_loop_base_get_time_until_timeout(btstack_run_loop_virtual_time_ms);
+        if (timeout_ms < 0){
+            // nothing left that could ever happen
+            break;
+        }
+        btstack_run_loop_virtual_time_ms += (uint32_t)timeout_ms;
+    }
+}
+
+static void btstack_run_loop_virtual_poll_data_sources_from_irq(void){
+    // no interrupts on the host, sources get polled every iteration anyway
+}
+
+static void btstack_run_loop_virtual_trigger_exit(void){
+    btstack_run_loop_virtual_exit_requested = true;
+}
+
+static void btstack_run_loop_virtual_execute_on_main_thread(btstack_context_callback_registration_t * callback_registration){
+    btstack_run_loop_base_add_callback(callback_registration);
+}
+
+static void btstack_run_loop_virtual_init(void){
+    btstack_run_loop_base_init();
+    btstack_run_loop_virtual_time_ms = 0;
+}
+
+static const btstack_run_loop_t btstack_run_loop_virtual = {
+    &btstack_run_loop_virtual_init,
+    &btstack_run_loop_base_add_data_source,
+    &btstack_run_loop_base_remove_data_source,
+    &btstack_run_loop_base_enable_data_source_callbacks,
+    &btstack_run_loop_base_disable_data_source_callbacks,
+    &btstack_run_loop_virtual_set_timer,
+    &btstack_run_loop_base_add_timer,
+    &btstack_run_loop_base_remove_timer,
+    &btstack_run_loop_virtual_execute,
+    &btstack_run_loop_base_dump_timer,
+    &btstack_run_loop_virtual_get_time_ms,
+    &btstack_run_loop_virtual_poll_data_sources_from_irq,
+    &btstack_run_loop_virtual_execute_on_main_thread,
+    &btstack_run_loop_virtual_trigger_exit,
+};
+
+const btstack_run_loop_t * btstack_run_loop_virtual_get_instance(void){
+    return &btstack_run_loop_virtual;
+}
@@ -0,0 +1,10 @@
+#ifndef btstack_run_loop_virtual_h
+#define btstack_run_loop_virtual_h
+
+#include <btstack_run_loop.h>
+
+// Run loop with a simulated clock: whenever nothing is due the clock jumps to
+// the next timer, so simulations run as fast as the cpu allows and are repeatable.
+const btstack_run_loop_t * btstack_run_loop_virtual_get_instance(void);
+
+#endif
@@ -0,0 +1,80 @@
+// Resolution of i2s clock trimming (I2S_CLOCK_TRIM) for the pico pio divider
+// Shows for common system clocks and sample rates how coarse one divider step
+// is, how far off the plain pico-extras divider is, and how close the dithered
+// divider of i2s_clock.c gets to requested trims on average.
+// Usage: i2s-clock-model [samples per buffer (default 256)] [seconds (default 10)]
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "i2s_clock.h"
+
+
+static const uint32_t sys_clocks[] = { 125000000, 133000000, 150000000, 200000000 };
+static const uint32_t sample_rates[] = { 32000, 44100, 48000 };
+static const float trims_ppm[] = { 0.3f, 1.0f, 7.5f, 15.0f, 88.0f, 200.0f, -200.0f, 1000.0f };
+
+#define NUM(array) (sizeof(array) / sizeof(array[0]))
+
+
+// rate of a 16.8 divider relative to the exact sample rate, ppm
+static double rate_ppm(uint32_t sys_hz, uint32_t sample_rate, double divider) {
+    double rate = sys_hz / (I2S_CLOCK_CYCLES_PER_FRAME * divider);
+    return (rate / sample_rate - 1.0) * 1e6;
+}
+
+
+// play whole buffers with the dithered divider, average rate error and max single buffer deviation
+static void model_trim(uint32_t sys_hz, uint32_t sample_rate, float trim_ppm, uint32_t samples_per_buffer, uint32_t seconds,
+                       double *avg_error_ppm, double *max_deviation_ppm) {
+    i2s_clock_t clock;
+    i2s_clock_init(&clock, sys_hz, sample_rate);
+    i2s_clock_set_trim(&clock, (int32_t)lrintf(trim_ppm * 1000.0f));
+
+    uint32_t buffers = (uint32_t)((uint64_t)seconds * sample_rate / samples_per_buffer);
+    double cycles = 0.0;
+    *max_deviation_ppm = 0.0;
+    for (uint32_t i = 0; i < buffers; i++) {
+        double divider = i2s_clock_next_divider(&clock) / 256.0;
+        cycles += divider * I2S_CLOCK_CYCLES_PER_FRAME * samples_per_buffer;
+        double deviation = fabs(rate_ppm(sys_hz, sample_rate, divider) - trim_ppm);
+        if (deviation > *max_deviation_ppm) *max_deviation_ppm = deviation;
+    }
+    double rate = (double)buffers * samples_per_buffer * sys_hz / cycles;
+    *avg_error_ppm = (rate / sample_rate - 1.0) * 1e6 - trim_ppm;
+}
+
+
+int main(int argc, char *argv[]) {
+    uint32_t samples_per_buffer = argc > 1 ? strtoul(argv[1], NULL, 0) : 256;
+    uint32_t seconds = argc > 2 ? strtoul(argv[2], NULL, 0) : 10;
+
+    printf("# resampling factor resolution for comparison: %.2f ppm\n", 1e6 / 0x10000);
+    printf("# dithered over %u s of %u sample buffers\n", (unsigned)seconds, (unsigned)samples_per_buffer);
+    printf("sys_hz,sample_rate,divider,step_ppm,pico_extras_ppm,trim_ppm,avg_error_ppm,max_deviation_ppm\n");
+
+    for (size_t s = 0; s < NUM(sys_clocks); s++) {
+        for (size_t r = 0; r < NUM(sample_rates); r++) {
+            uint32_t sys_hz = sys_clocks[s];
+            uint32_t sample_rate = sample_rates[r];
+
+            i2s_clock_t clock;
+            i2s_clock_init(&clock, sys_hz, sample_rate);
+
+            // what pico-extras sets without trimming: truncated to the 8 fraction bits
+            uint32_t plain = sys_hz * 4 / sample_rate;
+            double plain_ppm = rate_ppm(sys_hz, sample_rate, plain / 256.0);
+
+            for (size_t t = 0; t < NUM(trims_ppm); t++) {
+                double avg_error, max_deviation;
+                model_trim(sys_hz, sample_rate, trims_ppm[t], samples_per_buffer, seconds, &avg_error, &max_deviation);
+                printf("%u,%u,%.6f,%.2f,%.2f,%.1f,%.4f,%.2f\n", (unsigned)sys_hz, (unsigned)sample_rate,
+                    clock.nominal / 16777216.0, i2s_clock_step_ppb(&clock) / 1000.0, plain_ppm,
+                    trims_ppm[t], avg_error, max_deviation);
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,25 @@
+#ifndef _HOST_HARDWARE_GPIO_H
+#define _HOST_HARDWARE_GPIO_H
+
+// host stand-in: gpios (e.g. CONN_PIN) are ignored
+
+#include <stdbool.h>
+
+#define GPIO_OUT 1
+#define GPIO_IN  0
+
+static inline void gpio_init(unsigned int gpio) {
+    (void)gpio;
+}
+
+static inline void gpio_set_dir(unsigned int gpio, bool out) {
+    (void)gpio;
+    (void)out;
+}
+
+static inline void gpio_put(unsigned int gpio, bool value) {
+    (void)gpio;
+    (void)value;
+}
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef _HOST_HARDWARE_WATCHDOG_H
+#define _HOST_HARDWARE_WATCHDOG_H
+
+// host stand-in: the host never reboots
+
+#include <stdbool.h>
+
+static inline bool watchdog_caused_reboot(void) {
+    return false;
+}
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef _HOST_PICO_CYW43_ARCH_H
+#define _HOST_PICO_CYW43_ARCH_H
+
+// host stand-in: there is no cyw43 led, just ignore it
+
+#include <stdbool.h>
+
+#include "hardware/gpio.h"
+
+#define CYW43_WL_GPIO_LED_PIN 0
+
+static inline void cyw43_arch_gpio_put(unsigned int wl_gpio, bool value) {
+    (void)wl_gpio;
+    (void)value;
+}
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef _HOST_PICO_TIME_H
+#define _HOST_PICO_TIME_H
+
+// host stand-in: the microsecond timer is the monotonic clock of the host,
+// also in simulated time, so decode cost is measured for real
+
+#include <stdint.h>
+#include <time.h>
+
+static inline uint64_t time_us_64(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static inline uint32_t time_us_32(void) {
+    return (uint32_t)time_us_64();
+}
+
+#endif
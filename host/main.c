@@ -0,0 +1,317 @@
+// Host harness for the audio pipeline of a2dp.c
+// Streams an .sbc file (e.g. from "ffmpeg -i music.wav -c:a sbc music.sbc"), an .aptx
+// file, an .aac file with adts headers or a .wav file (encoded on the fly to sbc) like
+// a phone would, with a selectable arrival
+// pattern of the media packets. Playback ends up in a wav file via the wav sink
+// that replaces i2s, pipeline state is reported as csv on stdout.
+
+#include <btstack.h>
+#include <btstack_run_loop_posix.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "a2dp.h"
+#include "avrcp.h"
+#include "btstack_audio_wav_sink.h"
+#include "btstack_run_loop_virtual.h"
+#include "profiles_host.h"
+#include "timing.h"
+#include "trace.h"
+#include "traffic.h"
+
+
+#define DRAIN_MS 2000
+#define SETTLE_MS 60000  // drift controller is locked by then
+#define DELAY_SETTLE_MS 10000  // the delay averages have followed the stream start
+#define DELAY_AVERAGE 64      // packets, like the sink averages
+
+
+typedef struct {
+    uint32_t reports;
+    uint32_t underrun_reports;
+    uint32_t last_underrun_frames;
+    int min_frames;
+    int max_frames;
+    uint64_t sum_frames;
+    int32_t max_settled_error;  // drift controller, after SETTLE_MS
+    int32_t drift_ppm;          // estimate when the stream ends
+    uint32_t target_frames;     // jitter buffer target when the stream ends
+    uint32_t max_target_frames;
+    double measured_delay_100us;  // at packet arrival, averaged
+    uint32_t delay_measurements;
+    uint32_t max_delay_error_100us;  // reported against measured, after DELAY_SETTLE_MS
+} summary_t;
+
+
+static btstack_timer_source_t _report_timer;
+static btstack_timer_source_t _drain_timer;
+static uint32_t _report_interval_ms = 100;
+static uint32_t _start_ms = 0;
+static bool _streaming = false;
+static summary_t _summary = { .min_frames = INT32_MAX };
+static double _played_frames = 0;    // by the wav sink, at the last packet arrival
+static uint32_t _underrun_frames = 0;
+static double _consumed_frames = 0;  // audio of the source played so far
+static const char *_timing_filename = NULL;
+static bool _print_trace = false;
+
+
+static uint32_t frames_to_ms(uint32_t frames) {
+    return frames * 1000 / traffic_get_sample_rate();
+}
+
+
+// the real delay of a packet is the audio before it that was not played yet. What the sink
+// played since the last packet took source audio at the resampling factor of the moment,
+// or one to one at the trimmed i2s clock, except for the silence of underruns
+static void packet_arrival(uint64_t first_sample) {
+    double played = btstack_audio_wav_sink_get_played_frames();
+    uint32_t underruns = a2dp_sink_underrun_frames();
+    double consumed = played - _played_frames - (underruns - _underrun_frames);
+#ifndef I2S_CLOCK_TRIM
+    consumed *= a2dp_sink_resampling_factor() / 65536.0;
+#endif
+    _consumed_frames += consumed;
+    _played_frames = played;
+    _underrun_frames = underruns;
+    if (played <= 0) return;
+
+    double delay = (first_sample - _consumed_frames) * 10000.0 / traffic_get_sample_rate();
+    if (!_summary.delay_measurements++) {
+        _summary.measured_delay_100us = delay;
+    }
+    _summary.measured_delay_100us += (delay - _summary.measured_delay_100us) / DELAY_AVERAGE;
+}
+
+
+static void report(void) {
+    const traffic_stats_t *stats = traffic_get_stats();
+    int frames = a2dp_sink_sbc_frames_buffered();
+    uint32_t underruns = a2dp_sink_underrun_frames();
+
+    int32_t error = a2dp_sink_drift_error();
+    uint32_t target = a2dp_sink_target_frames();
+
+    printf("%u,%d,%u,%d,%d,%u,%u,%u,%u,%u,%.0f\n", (unsigned)(btstack_run_loop_get_time_ms() - _start_ms), frames,
+        (unsigned)a2dp_sink_resampling_factor(), (int)a2dp_sink_drift_ppm(), (int)error, (unsigned)target,
+        (unsigned)underruns, (unsigned)stats->packets_sent, (unsigned)stats->packets_lost,
+        (unsigned)profiles_host_delay_report_100us(), _summary.measured_delay_100us);
+
+    _summary.reports++;
+    if (underruns != _summary.last_underrun_frames) _summary.underrun_reports++;
+    _summary.last_underrun_frames = underruns;
+    if (frames < _summary.min_frames) _summary.min_frames = frames;
+    if (frames > _summary.max_frames) _summary.max_frames = frames;
+    _summary.sum_frames += frames;
+    _summary.drift_ppm = a2dp_sink_drift_ppm();
+    _summary.target_frames = target;
+    if (target > _summary.max_target_frames) _summary.max_target_frames = target;
+    if (btstack_run_loop_get_time_ms() - _start_ms >= SETTLE_MS && abs(error) > _summary.max_settled_error) {
+        _summary.max_settled_error = abs(error);
+    }
+    if (_streaming && btstack_run_loop_get_time_ms() - _start_ms >= DELAY_SETTLE_MS && _summary.delay_measurements) {
+        uint32_t delay_error = (uint32_t)fabs(a2dp_sink_delay_100us() - _summary.measured_delay_100us);
+        if (delay_error > _summary.max_delay_error_100us) _summary.max_delay_error_100us = delay_error;
+    }
+}
+
+
+static void report_timer_handler(btstack_timer_source_t *ts) {
+    report();
+    if (!_streaming) return;
+    btstack_run_loop_set_timer(ts, _report_interval_ms);
+    btstack_run_loop_add_timer(ts);
+}
+
+
+// the binary record the pico sends on request, for timing-report
+static void write_timing(void) {
+    uint8_t record[TIMING_RECORD_SIZE];
+    uint32_t size = timing_encode(record, sizeof(record));
+    FILE *file = fopen(_timing_filename, "wb");
+    if (!file || fwrite(record, 1, size, file) != size) {
+        printf("# cannot write %s\n", _timing_filename);
+    }
+    if (file) {
+        fclose(file);
+    }
+}
+
+
+static void drain_timer_handler(btstack_timer_source_t *ts) {
+    UNUSED(ts);
+    const traffic_stats_t *stats = traffic_get_stats();
+
+    profiles_host_stream_event(A2DP_SUBEVENT_STREAM_RELEASED);
+
+    printf("# packets %u sent, %u lost, %u sbc frames\n",
+        (unsigned)stats->packets_sent, (unsigned)stats->packets_lost, (unsigned)stats->frames_sent);
+    printf("# sbc frames buffered min %d, avg %u, max %d\n", _summary.min_frames,
+        (unsigned)(_summary.reports ? _summary.sum_frames / _summary.reports : 0), _summary.max_frames);
+    printf("# underrun audio frames %u in %u of %u report intervals\n",
+        (unsigned)_summary.last_underrun_frames, (unsigned)_summary.underrun_reports, (unsigned)_summary.reports);
+    printf("# concealed audio frames %u, dropped sbc frames %u, ring overflow audio frames %u\n",
+        (unsigned)a2dp_sink_concealed_frames(), (unsigned)a2dp_sink_dropped_frames(), (unsigned)a2dp_sink_overflow_frames());
+    printf("# drift estimate %d ppm, max fill error %d audio frames after %u s\n",
+        (int)_summary.drift_ppm, (int)_summary.max_settled_error, SETTLE_MS / 1000);
+    printf("# jitter buffer target %u ms at the end, max %u ms\n",
+        (unsigned)frames_to_ms(_summary.target_frames), (unsigned)frames_to_ms(_summary.max_target_frames));
+    printf("# decode load %u%% of real time in the last second, peak %u%%, max bitpool offered %u\n",
+        (unsigned)a2dp_sink_decode_load(), (unsigned)a2dp_sink_decode_peak(), (unsigned)a2dp_sink_max_bitpool());
+    printf("# link: %u packets lost, %u bad seconds, max bitpool stepped down %u and up %u times\n",
+        (unsigned)a2dp_sink_lost_packets(), (unsigned)a2dp_sink_bad_link_windows(),
+        (unsigned)a2dp_sink_bitpool_steps_down(), (unsigned)a2dp_sink_bitpool_steps_up());
+    printf("# delay %.1f ms in the last of %u reports, %.1f ms measured, sink estimate off by up to %.1f ms after %u s\n",
+        profiles_host_delay_report_100us() / 10.0, (unsigned)profiles_host_delay_reports(),
+        _summary.measured_delay_100us / 10.0, _summary.max_delay_error_100us / 10.0, DELAY_SETTLE_MS / 1000);
+
+    stats_t pipeline;
+    a2dp_sink_get_stats(&pipeline);
+    stats_print(&pipeline, "# ");
+
+    if (_timing_filename) {
+        write_timing();
+    }
+    if (_print_trace) {
+        trace_print(false);
+    }
+
+    btstack_run_loop_trigger_exit();
+}
+
+
+// stats cover the stream only, then let the buffers play out and release the stream
+static void traffic_done(void) {
+    _streaming = false;
+    btstack_run_loop_remove_timer(&_report_timer);
+    report();
+
+    btstack_run_loop_set_timer_handler(&_drain_timer, &drain_timer_handler);
+    btstack_run_loop_set_timer(&_drain_timer, DRAIN_MS);
+    btstack_run_loop_add_timer(&_drain_timer);
+}
+
+
+static void usage(const char *name) {
+    printf("Usage: %s [options] input.sbc|input.aptx|input.aac|input.wav [output.wav]\n", name);
+    printf("  -p profile  arrival pattern (default ideal), one of\n");
+    traffic_list_profiles();
+    printf("  -j ms       override max arrival jitter\n");
+    printf("  -b packets  override burst size\n");
+    printf("  -d ppm      override source clock drift\n");
+    printf("  -l percent  override packet loss\n");
+    printf("  -B bitpool  sbc bitpool for wav input (default 53)\n");
+    printf("  -D          dual channel instead of joint stereo for wav input, \"sbc xq\" with -B 76\n");
+    printf("  -s seed     random seed (default 1)\n");
+    printf("  -v volume   avrcp absolute volume 0..127 (default 127)\n");
+    printf("  -r ms       report interval (default 100)\n");
+    printf("  -t          real time with the posix run loop instead of simulated time\n");
+    printf("  -T file     binary timing record at the end, for timing-report (built with TIMING)\n");
+    printf("  -X          post-mortem trace at the end\n");
+}
+
+
+int main(int argc, char *argv[]) {
+    traffic_profile_t profile = *traffic_get_profile("ideal");
+    const traffic_profile_t *preset;
+    int bitpool = 53;
+    bool dual = false;
+    uint32_t seed = 1;
+    int volume = 127;
+    bool real_time = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:j:b:d:l:B:Ds:v:r:tT:Xh")) != -1) {
+        switch (opt) {
+            case 'p':
+                preset = traffic_get_profile(optarg);
+                if (!preset) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                profile = *preset;
+                break;
+            case 'j':
+                profile.jitter_ms = atoi(optarg);
+                break;
+            case 'b':
+                profile.burst = atoi(optarg);
+                break;
+            case 'd':
+                profile.drift_ppm = atoi(optarg);
+                break;
+            case 'l':
+                profile.loss_percent = atof(optarg);
+                break;
+            case 'B':
+                bitpool = atoi(optarg);
+                break;
+            case 'D':
+                dual = true;
+                break;
+            case 's':
+                seed = strtoul(optarg, NULL, 0);
+                break;
+            case 'v':
+                volume = atoi(optarg);
+                break;
+            case 'r':
+                _report_interval_ms = atoi(optarg);
+                break;
+            case 't':
+                real_time = true;
+                break;
+            case 'T':
+                _timing_filename = optarg;
+                break;
+            case 'X':
+                _print_trace = true;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (optind + 1 < argc) {
+        btstack_audio_wav_sink_set_filename(argv[optind + 1]);
+    }
+
+    if (!traffic_open(argv[optind], bitpool, dual)) {
+        return 1;
+    }
+
+    trace_init();
+    btstack_run_loop_init(real_time ? btstack_run_loop_posix_get_instance() : btstack_run_loop_virtual_get_instance());
+
+    a2dp_sink_begin();
+    avrcp_begin();
+
+    // what the phone does when it connects and starts playing
+    profiles_host_volume(volume);
+    traffic_configure_sink();
+    profiles_host_stream_event(A2DP_SUBEVENT_STREAM_STARTED);
+
+    printf("# profile %s: jitter %u ms, burst %u, drift %+d ppm, loss %.1f%%\n", profile.name,
+        (unsigned)profile.jitter_ms, (unsigned)profile.burst, (int)profile.drift_ppm, profile.loss_percent);
+    printf("time_ms,sbc_frames,resampling_factor,drift_ppm,drift_error,target_frames,underrun_frames,packets_sent,packets_lost,"
+        "delay_report_100us,measured_delay_100us\n");
+
+    _start_ms = btstack_run_loop_get_time_ms();
+    _streaming = true;
+    traffic_set_arrival_handler(&packet_arrival);
+    traffic_start(&profile, seed, &traffic_done);
+
+    btstack_run_loop_set_timer_handler(&_report_timer, &report_timer_handler);
+    btstack_run_loop_set_timer(&_report_timer, _report_interval_ms);
+    btstack_run_loop_add_timer(&_report_timer);
+
+    btstack_run_loop_execute();
+    return 0;
+}
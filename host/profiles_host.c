@@ -0,0 +1,328 @@
+#include "profiles_host.h"
+
+#include <stdio.h>
+
+
+static btstack_packet_handler_t _a2dp_handler = 0;
+static void (*_media_handler)(uint8_t local_seid, uint8_t *packet, uint16_t size) = 0;
+static btstack_packet_handler_t _avrcp_handler = 0;
+static btstack_packet_handler_t _avrcp_target_handler = 0;
+static btstack_packet_handler_t _avrcp_controller_handler = 0;
+static avdtp_stream_endpoint_t _endpoints[MAX_NR_AVDTP_STREAM_ENDPOINTS];
+static avdtp_media_codec_type_t _endpoint_codecs[MAX_NR_AVDTP_STREAM_ENDPOINTS];
+static bool _endpoint_delay_reporting[MAX_NR_AVDTP_STREAM_ENDPOINTS];
+static uint8_t _num_endpoints = 0;
+static uint8_t _local_seid = 1;  // of the endpoint the phone configured last, seids count from 1
+static const uint16_t _cid = 1;
+static uint16_t _delay_report_100us = 0;
+static uint32_t _delay_reports = 0;
+
+
+// --- a2dp sink, as used by a2dp.c
+
+void a2dp_sink_init(void) {
+}
+
+
+void a2dp_sink_register_packet_handler(btstack_packet_handler_t callback) {
+    _a2dp_handler = callback;
+}
+
+
+void a2dp_sink_register_media_handler(void (*callback)(uint8_t local_seid, uint8_t *packet, uint16_t size)) {
+    _media_handler = callback;
+}
+
+
+avdtp_stream_endpoint_t * a2dp_sink_create_stream_endpoint(avdtp_media_type_t media_type, avdtp_media_codec_type_t media_codec_type,
+    const uint8_t *codec_capabilities, uint16_t codec_capabilities_len,
+    uint8_t *codec_configuration, uint16_t codec_configuration_len) {
+    UNUSED(media_type);
+    UNUSED(codec_capabilities);
+    UNUSED(codec_capabilities_len);
+    UNUSED(codec_configuration);
+    UNUSED(codec_configuration_len);
+    if (_num_endpoints == MAX_NR_AVDTP_STREAM_ENDPOINTS) return NULL;
+    _endpoint_codecs[_num_endpoints] = media_codec_type;
+    return &_endpoints[_num_endpoints++];
+}
+
+
+uint8_t avdtp_local_seid(const avdtp_stream_endpoint_t * stream_endpoint) {
+    return (uint8_t)(stream_endpoint - _endpoints) + 1;
+}
+
+
+// the host tools always act as the phone that connects, the sink pages nobody
+uint8_t a2dp_sink_establish_stream(bd_addr_t bd_addr, uint8_t local_seid, uint16_t * avdtp_cid) {
+    UNUSED(bd_addr);
+    UNUSED(local_seid);
+    UNUSED(avdtp_cid);
+    return ERROR_CODE_COMMAND_DISALLOWED;
+}
+
+
+// the phone picks the endpoint of the codec it streams
+static void select_endpoint(avdtp_media_codec_type_t media_codec_type) {
+    for (uint8_t i = 0; i < _num_endpoints; i++) {
+        if (_endpoint_codecs[i] == media_codec_type) {
+            _local_seid = i + 1;
+            return;
+        }
+    }
+}
+
+
+void avdtp_sink_register_delay_reporting_category(uint8_t seid) {
+    if (seid >= 1 && seid <= _num_endpoints) {
+        _endpoint_delay_reporting[seid - 1] = true;
+    }
+}
+
+
+// the phone takes delay reports of the streaming endpoint, if it offers the capability.
+// There is just one connection, its cid is not checked
+uint8_t a2dp_sink_delay_report(uint16_t a2dp_cid, uint8_t local_seid, uint16_t delay_100us) {
+    UNUSED(a2dp_cid);
+    if (local_seid != _local_seid || !_endpoint_delay_reporting[local_seid - 1]) {
+        return ERROR_CODE_COMMAND_DISALLOWED;
+    }
+    _delay_report_100us = delay_100us;
+    _delay_reports++;
+    return ERROR_CODE_SUCCESS;
+}
+
+
+// the phone in this harness keeps streaming as it is, a request to renegotiate is just logged
+
+uint8_t avdtp_sink_suspend(uint16_t avdtp_cid, uint8_t local_seid) {
+    UNUSED(avdtp_cid);
+    UNUSED(local_seid);
+    printf("# avdtp suspend requested\n");
+    return ERROR_CODE_SUCCESS;
+}
+
+
+uint8_t avdtp_sink_reconfigure(uint16_t avdtp_cid, uint8_t local_seid, uint8_t remote_seid,
+    uint16_t configured_services_bitmap, avdtp_capabilities_t configuration) {
+    UNUSED(avdtp_cid);
+    UNUSED(local_seid);
+    UNUSED(remote_seid);
+    UNUSED(configured_services_bitmap);
+    printf("# avdtp reconfigure to max bitpool %u requested\n", configuration.media_codec.media_codec_information[3]);
+    return ERROR_CODE_SUCCESS;
+}
+
+
+uint8_t avdtp_sink_start_stream(uint16_t avdtp_cid, uint8_t local_seid) {
+    UNUSED(avdtp_cid);
+    UNUSED(local_seid);
+    printf("# avdtp start requested\n");
+    return ERROR_CODE_SUCCESS;
+}
+
+
+// --- avrcp, as used by avrcp.c
+
+void avrcp_init(void) {
+}
+
+
+void avrcp_controller_init(void) {
+}
+
+
+void avrcp_target_init(void) {
+}
+
+
+void avrcp_register_packet_handler(btstack_packet_handler_t callback) {
+    _avrcp_handler = callback;
+}
+
+
+void avrcp_controller_register_packet_handler(btstack_packet_handler_t callback) {
+    _avrcp_controller_handler = callback;
+}
+
+
+void avrcp_target_register_packet_handler(btstack_packet_handler_t callback) {
+    _avrcp_target_handler = callback;
+}
+
+
+uint8_t avrcp_target_support_event(uint16_t avrcp_cid, avrcp_notification_event_id_t event_id) {
+    UNUSED(avrcp_cid);
+    UNUSED(event_id);
+    return ERROR_CODE_SUCCESS;
+}
+
+
+uint8_t avrcp_target_battery_status_changed(uint16_t avrcp_cid, avrcp_battery_status_t battery_status) {
+    UNUSED(avrcp_cid);
+    UNUSED(battery_status);
+    return ERROR_CODE_SUCCESS;
+}
+
+
+uint8_t avrcp_controller_get_supported_events(uint16_t avrcp_cid) {
+    UNUSED(avrcp_cid);
+    return ERROR_CODE_SUCCESS;
+}
+
+
+uint8_t avrcp_controller_enable_notification(uint16_t avrcp_cid, avrcp_notification_event_id_t event_id) {
+    UNUSED(avrcp_cid);
+    UNUSED(event_id);
+    return ERROR_CODE_SUCCESS;
+}
+
+
+// --- injection of what a phone would do
+
+void profiles_host_sbc_configuration(uint16_t sampling_frequency, avdtp_channel_mode_t channel_mode,
+    uint8_t block_length, uint8_t subbands, avdtp_sbc_allocation_method_t allocation_method,
+    uint8_t min_bitpool_value, uint8_t max_bitpool_value, bool reconfigure) {
+    uint8_t event[18];
+    int pos = 0;
+
+    select_endpoint(AVDTP_CODEC_SBC);
+    event[pos++] = HCI_EVENT_A2DP_META;
+    event[pos++] = sizeof(event) - 2;
+    event[pos++] = A2DP_SUBEVENT_SIGNALING_MEDIA_CODEC_SBC_CONFIGURATION;
+    little_endian_store_16(event, pos, _cid);
+    pos += 2;
+    event[pos++] = _local_seid;
+    event[pos++] = _local_seid;  // remote seid
+    event[pos++] = reconfigure ? 1 : 0;
+    event[pos++] = AVDTP_AUDIO;
+    little_endian_store_16(event, pos, sampling_frequency);
+    pos += 2;
+    event[pos++] = (uint8_t)channel_mode;
+    event[pos++] = channel_mode == AVDTP_CHANNEL_MODE_MONO ? 1 : 2;
+    event[pos++] = block_length;
+    event[pos++] = subbands;
+    event[pos++] = (uint8_t)allocation_method;
+    event[pos++] = min_bitpool_value;
+    event[pos++] = max_bitpool_value;
+
+    if (_a2dp_handler) (*_a2dp_handler)(HCI_EVENT_PACKET, 0, event, pos);
+}
+
+
+void profiles_host_aptx_configuration(uint16_t sampling_frequency, bool reconfigure) {
+    uint8_t event[20];
+    int pos = 0;
+
+    select_endpoint(AVDTP_CODEC_NON_A2DP);
+    event[pos++] = HCI_EVENT_A2DP_META;
+    event[pos++] = sizeof(event) - 2;
+    event[pos++] = A2DP_SUBEVENT_SIGNALING_MEDIA_CODEC_OTHER_CONFIGURATION;
+    little_endian_store_16(event, pos, _cid);
+    pos += 2;
+    event[pos++] = _local_seid;
+    event[pos++] = _local_seid;  // remote seid
+    event[pos++] = reconfigure ? 1 : 0;
+    event[pos++] = AVDTP_AUDIO;
+    little_endian_store_16(event, pos, AVDTP_CODEC_NON_A2DP);
+    pos += 2;
+    little_endian_store_16(event, pos, 7);  // codec information length
+    pos += 2;
+    little_endian_store_32(event, pos, 0x0000004F);  // apt
+    pos += 4;
+    little_endian_store_16(event, pos, 0x0001);  // aptx
+    pos += 2;
+    event[pos++] = ((sampling_frequency == 48000 ? AVDTP_SBC_48000 : AVDTP_SBC_44100) << 4) | AVDTP_SBC_STEREO;
+
+    if (_a2dp_handler) (*_a2dp_handler)(HCI_EVENT_PACKET, 0, event, pos);
+}
+
+
+// same layout as the event of btstack
+void profiles_host_aac_configuration(uint32_t sampling_frequency, uint8_t num_channels, uint32_t bit_rate, bool reconfigure) {
+    uint8_t event[18];
+    int pos = 0;
+
+    select_endpoint(AVDTP_CODEC_MPEG_2_4_AAC);
+    event[pos++] = HCI_EVENT_A2DP_META;
+    event[pos++] = sizeof(event) - 2;
+    event[pos++] = A2DP_SUBEVENT_SIGNALING_MEDIA_CODEC_MPEG_AAC_CONFIGURATION;
+    little_endian_store_16(event, pos, _cid);
+    pos += 2;
+    event[pos++] = _local_seid;
+    event[pos++] = _local_seid;  // remote seid
+    event[pos++] = reconfigure ? 1 : 0;
+    event[pos++] = AVDTP_AUDIO;
+    event[pos++] = 0x40;  // mpeg-4 aac lc
+    little_endian_store_24(event, pos, sampling_frequency);
+    pos += 3;
+    event[pos++] = num_channels;
+    little_endian_store_24(event, pos, bit_rate);
+    pos += 3;
+    event[pos++] = 1;  // vbr
+
+    if (_a2dp_handler) (*_a2dp_handler)(HCI_EVENT_PACKET, 0, event, pos);
+}
+
+
+void profiles_host_stream_established(uint8_t status) {
+    uint8_t event[16] = {0};  // bd_addr and con_handle stay 0
+    int pos = 0;
+
+    event[pos++] = HCI_EVENT_A2DP_META;
+    event[pos++] = sizeof(event) - 2;
+    event[pos++] = A2DP_SUBEVENT_STREAM_ESTABLISHED;
+    little_endian_store_16(event, pos, _cid);
+    pos += 2 + 6 + 2;
+    event[pos++] = _local_seid;
+    event[pos++] = _local_seid;  // remote seid
+    event[pos++] = status;
+
+    if (_a2dp_handler) (*_a2dp_handler)(HCI_EVENT_PACKET, 0, event, pos);
+}
+
+
+void profiles_host_stream_event(uint8_t subevent) {
+    uint8_t event[6];
+    int pos = 0;
+
+    event[pos++] = HCI_EVENT_A2DP_META;
+    event[pos++] = sizeof(event) - 2;
+    event[pos++] = subevent;
+    little_endian_store_16(event, pos, _cid);
+    pos += 2;
+    event[pos++] = _local_seid;
+
+    if (_a2dp_handler) (*_a2dp_handler)(HCI_EVENT_PACKET, 0, event, pos);
+}
+
+
+void profiles_host_media_packet(uint8_t * packet, uint16_t size) {
+    if (_media_handler) (*_media_handler)(_local_seid, packet, size);
+}
+
+
+void profiles_host_volume(uint8_t volume) {
+    uint8_t event[7];
+    int pos = 0;
+
+    event[pos++] = HCI_EVENT_AVRCP_META;
+    event[pos++] = sizeof(event) - 2;
+    event[pos++] = AVRCP_SUBEVENT_NOTIFICATION_VOLUME_CHANGED;
+    little_endian_store_16(event, pos, _cid);
+    pos += 2;
+    event[pos++] = 0;  // command type
+    event[pos++] = volume & 0x7f;
+
+    if (_avrcp_target_handler) (*_avrcp_target_handler)(HCI_EVENT_PACKET, 0, event, pos);
+}
+
+
+uint16_t profiles_host_delay_report_100us(void) {
+    return _delay_report_100us;
+}
+
+
+uint32_t profiles_host_delay_reports(void) {
+    return _delay_reports;
+}
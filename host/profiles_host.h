@@ -0,0 +1,38 @@
+#ifndef profiles_host_h
+#define profiles_host_h
+
+// Host stand-ins for the btstack a2dp sink and avrcp profiles.
+// a2dp.c and avrcp.c register their handlers as usual, the host tools
+// then inject the events and media packets a phone would cause.
+
+#include <btstack.h>
+
+// A2DP_SUBEVENT_SIGNALING_MEDIA_CODEC_SBC_CONFIGURATION
+void profiles_host_sbc_configuration(uint16_t sampling_frequency, avdtp_channel_mode_t channel_mode,
+    uint8_t block_length, uint8_t subbands, avdtp_sbc_allocation_method_t allocation_method,
+    uint8_t min_bitpool_value, uint8_t max_bitpool_value, bool reconfigure);
+
+// A2DP_SUBEVENT_SIGNALING_MEDIA_CODEC_OTHER_CONFIGURATION of classic aptx, stereo
+void profiles_host_aptx_configuration(uint16_t sampling_frequency, bool reconfigure);
+
+// A2DP_SUBEVENT_SIGNALING_MEDIA_CODEC_MPEG_AAC_CONFIGURATION of mpeg-4 aac lc
+void profiles_host_aac_configuration(uint32_t sampling_frequency, uint8_t num_channels, uint32_t bit_rate, bool reconfigure);
+
+// A2DP_SUBEVENT_STREAM_ESTABLISHED of the endpoint configured last
+void profiles_host_stream_established(uint8_t status);
+
+// A2DP_SUBEVENT_STREAM_STARTED, _SUSPENDED or _RELEASED
+void profiles_host_stream_event(uint8_t subevent);
+
+// avdtp media packet: rtp header, sbc header and sbc frames, rtp header and a LATM AudioMuxElement of aac,
+// or just aptx codewords
+void profiles_host_media_packet(uint8_t * packet, uint16_t size);
+
+// AVRCP_SUBEVENT_NOTIFICATION_VOLUME_CHANGED, 0..127
+void profiles_host_volume(uint8_t volume);
+
+// the last delay the sink reported, 100us, and how many reports the phone took
+uint16_t profiles_host_delay_report_100us(void);
+uint32_t profiles_host_delay_reports(void);
+
+#endif
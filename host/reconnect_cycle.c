@@ -0,0 +1,242 @@
+// Reconnect test of the media pipeline of a2dp.c, in simulated time
+// Acts as a phone that keeps coming back: configures the sink, establishes and starts the
+// stream, suspends and resumes it, releases it, and starts over, streaming the input in
+// between. Every stream must play, and every release must leave nothing behind: no frames
+// queued, the sink closed and no more open file descriptors than before. Two last, longer
+// sbc streams lose many packets: the max bitpool must step down in the second as in the first,
+// nothing of the stream before may hold it back. Build with -fsanitize=address or run
+// under valgrind for heap leaks.
+// Usage: reconnect-cycle [-n cycles (default 2000)] [-p profile] input.sbc|input.aptx|input.aac|input.wav
+
+#include <btstack.h>
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "a2dp.h"
+#include "avrcp.h"
+#include "btstack_audio_wav_sink.h"
+#include "btstack_run_loop_virtual.h"
+#include "profiles_host.h"
+#include "trace.h"
+#include "traffic.h"
+
+
+#define STREAM_MS  300  // of audio sent before the source suspends, and again before it releases
+#define PAUSE_MS    50  // suspended
+#define GONE_MS    100  // between release and the next connection
+#define ADAPT_MS  8000  // before the suspend of the lossy streams, the bitpool steps down after 6 or 7 seconds
+#define ADAPT_STREAMS 2
+
+
+typedef enum {
+    STEP_CONNECT,
+    STEP_SUSPEND,
+    STEP_RESUME,
+    STEP_RELEASE
+} step_t;
+
+// every window bad, the phone in this harness never follows a request
+static const traffic_profile_t _lossy = { "lossy", 0, 1, 0, 10.0f };
+
+static const char *_filename = NULL;
+static const traffic_profile_t *_profile = NULL;
+static uint32_t _cycles = 2000;
+static uint32_t _adapt_streams = 0;  // bitpools are sbc only
+static uint32_t _cycle = 0;
+static uint32_t _failures = 0;
+static int _open_fds = 0;  // before the first connection
+static uint32_t _refills = 0;  // of the decoder, when the stream started
+static uint32_t _steps_down = 0;  // of the bitpool, when the stream was established
+static step_t _step = STEP_CONNECT;
+static btstack_timer_source_t _timer;
+
+
+static int open_fds(void) {
+    DIR *dir = opendir("/proc/self/fd");
+    if (!dir) return -1;
+    int count = 0;
+    while (readdir(dir)) {
+        count++;
+    }
+    closedir(dir);
+    return count;
+}
+
+
+static uint32_t decoder_refills(void) {
+    stats_t stats;
+    a2dp_sink_get_stats(&stats);
+    return stats.decoder.refills;
+}
+
+
+// the last streams are the lossy ones
+static bool adapting(void) {
+    return _cycle >= _cycles;
+}
+
+
+static const traffic_profile_t * profile(void) {
+    return adapting() ? &_lossy : _profile;
+}
+
+
+static void fail(const char *what) {
+    _failures++;
+    if (_failures <= 10) {
+        printf("# cycle %u: %s\n", (unsigned)_cycle, what);
+    }
+}
+
+
+// the source loops over the input
+static void input_done(void) {
+    if (!traffic_open(_filename, 53, false)) {
+        fail("cannot reopen the input");
+        btstack_run_loop_trigger_exit();
+        return;
+    }
+    traffic_start(profile(), _cycle + 1, &input_done);
+}
+
+
+static void start_streaming(void) {
+    profiles_host_stream_event(A2DP_SUBEVENT_STREAM_STARTED);
+    _refills = decoder_refills();
+    traffic_start(profile(), _cycle + 1, &input_done);
+}
+
+
+// playback started and the source stopped: nothing may be left queued for the decoder
+static void stop_streaming(uint8_t subevent) {
+    traffic_stop();
+    if (decoder_refills() == _refills) {
+        fail("nothing played");
+    }
+    profiles_host_stream_event(subevent);
+    if (a2dp_sink_sbc_frames_buffered()) {
+        fail("frames left queued");
+    }
+}
+
+
+static void next_step(step_t step, uint32_t delay_ms) {
+    _step = step;
+    btstack_run_loop_set_timer(&_timer, delay_ms);
+    btstack_run_loop_add_timer(&_timer);
+}
+
+
+static void step_handler(btstack_timer_source_t *ts) {
+    UNUSED(ts);
+
+    switch (_step) {
+        case STEP_CONNECT:
+            traffic_configure_sink();
+            profiles_host_stream_established(ERROR_CODE_SUCCESS);
+            _steps_down = a2dp_sink_bitpool_steps_down();
+            start_streaming();
+            if (!btstack_audio_wav_sink_is_open()) {
+                fail("sink not set up");
+            }
+            next_step(STEP_SUSPEND, adapting() ? ADAPT_MS : STREAM_MS);
+            break;
+
+        case STEP_SUSPEND:
+            if (adapting() && a2dp_sink_bitpool_steps_down() == _steps_down) {
+                fail("max bitpool not stepped down");
+            }
+            stop_streaming(A2DP_SUBEVENT_STREAM_SUSPENDED);
+            next_step(STEP_RESUME, PAUSE_MS);
+            break;
+
+        case STEP_RESUME:
+            start_streaming();
+            next_step(STEP_RELEASE, STREAM_MS);
+            break;
+
+        case STEP_RELEASE:
+            stop_streaming(A2DP_SUBEVENT_STREAM_RELEASED);
+            if (btstack_audio_wav_sink_is_open()) {
+                fail("sink left open");
+            }
+            if (open_fds() != _open_fds) {
+                fail("file descriptors leaked");
+            }
+            if (++_cycle < _cycles + _adapt_streams) {
+                next_step(STEP_CONNECT, GONE_MS);
+            } else {
+                btstack_run_loop_trigger_exit();
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+static void usage(const char *name) {
+    printf("Usage: %s [options] input.sbc|input.aptx|input.aac|input.wav\n", name);
+    printf("  -n cycles   connect, start, suspend, resume and release that often (default 2000),\n");
+    printf("              then, for sbc, twice more with heavy loss\n");
+    printf("  -p profile  arrival pattern (default ideal), one of\n");
+    traffic_list_profiles();
+}
+
+
+int main(int argc, char *argv[]) {
+    _profile = traffic_get_profile("ideal");
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:p:h")) != -1) {
+        switch (opt) {
+            case 'n':
+                _cycles = strtoul(optarg, NULL, 0);
+                break;
+            case 'p':
+                _profile = traffic_get_profile(optarg);
+                if (!_profile) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind >= argc || !_cycles) {
+        usage(argv[0]);
+        return 1;
+    }
+    _filename = argv[optind];
+
+    btstack_audio_wav_sink_set_filename("/dev/null");
+    if (!traffic_open(_filename, 53, false)) {
+        return 1;
+    }
+    if (traffic_is_sbc()) {
+        _adapt_streams = ADAPT_STREAMS;
+    }
+
+    trace_init();
+    btstack_run_loop_init(btstack_run_loop_virtual_get_instance());
+    a2dp_sink_begin();
+    avrcp_begin();
+    profiles_host_volume(127);
+
+    _open_fds = open_fds();
+    btstack_run_loop_set_timer_handler(&_timer, &step_handler);
+    next_step(STEP_CONNECT, 0);
+    btstack_run_loop_execute();
+
+    printf("# %u of %u cycles, %u failures\n", (unsigned)_cycle, (unsigned)(_cycles + _adapt_streams), (unsigned)_failures);
+    stats_t stats;
+    a2dp_sink_get_stats(&stats);
+    stats_print(&stats, "# ");
+    return _failures ? 1 : 0;
+}
@@ -0,0 +1,299 @@
+// Bit exactness and speed of the sbc decoders of sbc_decoder.c
+// Encodes a test signal with the bluedroid encoder in common and less common
+// layouts, then decodes it with the bluedroid decoder (the reference, as used by
+// pico_btstack_sbc_decoder), the generic path of sbc_decoder.c, sbc_decoder.c as
+// built for the pico (specialized where the layout allows) and its (host modelled)
+// cortex-m33 path. The last three must agree bit by bit, at unity gain and below.
+// Bluedroid rounds differently, it has to agree within REFERENCE_MIN_SNR_DB.
+// Then times the decoders per frame. On x86 also in tsc ticks, that says nothing
+// about the pico, but the ratios between the decoders carry over roughly.
+// Usage: sbc-bench [iterations (default 20)]
+
+#include <btstack.h>
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC
+#endif
+
+#include "sbc_decoder.h"
+#include "volume.h"
+
+
+// from sbc_decoder_generic_model.c and sbc_decoder_dsp_model.c
+void sbc_decoder_init_generic(sbc_decoder_t *decoder);
+void sbc_decoder_set_gain_generic(sbc_decoder_t *decoder, int32_t gain);
+bool sbc_decoder_decode_generic(sbc_decoder_t *decoder, const uint8_t *data, uint32_t size, int16_t *pcm, sbc_header_t *header);
+void sbc_decoder_init_dsp(sbc_decoder_t *decoder);
+void sbc_decoder_set_gain_dsp(sbc_decoder_t *decoder, int32_t gain);
+bool sbc_decoder_decode_dsp(sbc_decoder_t *decoder, const uint8_t *data, uint32_t size, int16_t *pcm, sbc_header_t *header);
+
+typedef void (*init_t)(sbc_decoder_t *decoder);
+typedef void (*set_gain_t)(sbc_decoder_t *decoder, int32_t gain);
+typedef bool (*decode_t)(sbc_decoder_t *decoder, const uint8_t *data, uint32_t size, int16_t *pcm, sbc_header_t *header);
+
+typedef struct {
+    const char *name;
+    init_t init;
+    set_gain_t set_gain;
+    decode_t decode;
+} decoder_t;
+
+typedef struct {
+    uint32_t sample_rate;
+    uint8_t blocks;
+    uint8_t subbands;
+    btstack_sbc_allocation_method_t allocation_method;
+    btstack_sbc_channel_mode_t channel_mode;
+    uint8_t bitpool;
+} layout_t;
+
+#define NUM_FRAMES            400
+#define MAX_FRAME_SIZE        512
+#define MAX_SAMPLES           (NUM_FRAMES * SBC_DECODER_MAX_SAMPLES * SBC_DECODER_MAX_CHANNELS)
+#define REFERENCE_MIN_SNR_DB  60.0
+
+
+static const decoder_t _decoders[] = {
+    { "generic", sbc_decoder_init_generic, sbc_decoder_set_gain_generic, sbc_decoder_decode_generic },
+    { "pico", sbc_decoder_init, sbc_decoder_set_gain, sbc_decoder_decode },
+    { "pico dsp", sbc_decoder_init_dsp, sbc_decoder_set_gain_dsp, sbc_decoder_decode_dsp },
+};
+
+static const layout_t _layouts[] = {
+    { 44100, 16, 8, SBC_LOUDNESS, SBC_CHANNEL_MODE_JOINT_STEREO, 53 },  // what phones send
+    { 48000, 16, 8, SBC_LOUDNESS, SBC_CHANNEL_MODE_JOINT_STEREO, 51 },
+    { 44100, 16, 8, SBC_LOUDNESS, SBC_CHANNEL_MODE_STEREO,       53 },
+    { 44100, 16, 8, SBC_SNR,      SBC_CHANNEL_MODE_JOINT_STEREO, 35 },
+    { 44100, 16, 8, SBC_LOUDNESS, SBC_CHANNEL_MODE_DUAL_CHANNEL, 38 },
+    { 44100, 16, 8, SBC_LOUDNESS, SBC_CHANNEL_MODE_MONO,         31 },
+    { 32000, 12, 8, SBC_LOUDNESS, SBC_CHANNEL_MODE_STEREO,       45 },
+    { 48000,  8, 4, SBC_SNR,      SBC_CHANNEL_MODE_JOINT_STEREO, 24 },
+    { 16000,  4, 4, SBC_LOUDNESS, SBC_CHANNEL_MODE_MONO,         18 },
+};
+
+static const char *_mode_names[] = { "mono", "dual", "stereo", "joint" };
+
+static uint8_t _frames[NUM_FRAMES][MAX_FRAME_SIZE];
+static uint16_t _frame_lengths[NUM_FRAMES];
+static int16_t _reference[MAX_SAMPLES];
+static uint32_t _reference_samples = 0;
+static int16_t _expected[MAX_SAMPLES];
+static int16_t _output[MAX_SAMPLES];
+static uint32_t _random = 1;
+
+
+// deterministic pseudo random numbers (xorshift32) so runs are repeatable
+static uint32_t next_random(void) {
+    _random ^= _random << 13;
+    _random ^= _random >> 17;
+    _random ^= _random << 5;
+    return _random;
+}
+
+
+// tones, a sweep and some noise, with a stretch that drives the decoders into saturation
+static int16_t test_sample(uint32_t n, uint8_t channel, uint32_t sample_rate) {
+    double t = (double)n / sample_rate;
+    double sweep = 50.0 * pow(sample_rate / 2 / 50.0, fmod(t, 1.0));
+    double value = 0.4 * sin(2 * M_PI * (channel ? 1000.0 : 440.0) * t)
+                 + 0.3 * sin(2 * M_PI * sweep * t * (channel ? 0.5 : 1.0))
+                 + 0.02 * ((int32_t)(next_random() & 0xffff) - 0x8000) / 0x8000;
+    if (fmod(t, 1.0) > 0.8) value *= 3.0;
+    value *= 32767;
+    return value > INT16_MAX ? INT16_MAX : value < INT16_MIN ? INT16_MIN : (int16_t)value;
+}
+
+
+static void encode(const layout_t *layout) {
+    static btstack_sbc_encoder_state_t encoder_state;
+    uint8_t num_channels = layout->channel_mode == SBC_CHANNEL_MODE_MONO ? 1 : 2;
+    uint32_t frame_samples = layout->blocks * layout->subbands;
+
+    btstack_sbc_encoder_init(&encoder_state, SBC_MODE_STANDARD, layout->blocks, layout->subbands,
+        layout->allocation_method, layout->sample_rate, layout->bitpool, layout->channel_mode);
+    _random = 1;
+    for (uint32_t frame = 0; frame < NUM_FRAMES; frame++) {
+        int16_t pcm[SBC_DECODER_MAX_SAMPLES * SBC_DECODER_MAX_CHANNELS];
+        for (uint32_t i = 0; i < frame_samples; i++) {
+            for (uint8_t ch = 0; ch < num_channels; ch++) {
+                pcm[i * num_channels + ch] = test_sample(frame * frame_samples + i, ch, layout->sample_rate);
+            }
+        }
+        btstack_sbc_encoder_process_data(pcm);
+        _frame_lengths[frame] = btstack_sbc_encoder_sbc_buffer_length();
+        memcpy(_frames[frame], btstack_sbc_encoder_sbc_buffer(), _frame_lengths[frame]);
+    }
+}
+
+
+static void handle_reference_pcm(int16_t *data, int num_audio_frames, int num_channels, int sample_rate, void *context) {
+    UNUSED(sample_rate);
+    UNUSED(context);
+    uint32_t count = num_audio_frames * num_channels;
+    if (_reference_samples + count > MAX_SAMPLES) return;
+    memcpy(&_reference[_reference_samples], data, count * sizeof(int16_t));
+    _reference_samples += count;
+}
+
+
+static void decode_reference(void) {
+    static btstack_sbc_decoder_state_t decoder_state;
+    btstack_sbc_decoder_init(&decoder_state, SBC_MODE_STANDARD, handle_reference_pcm, NULL);
+    _reference_samples = 0;
+    for (uint32_t frame = 0; frame < NUM_FRAMES; frame++) {
+        btstack_sbc_decoder_process_data(&decoder_state, 0, _frames[frame], _frame_lengths[frame]);
+    }
+}
+
+
+// all frames, returns the number of samples or 0 if a frame was rejected
+static uint32_t decode(const decoder_t *decoder, int32_t gain, int16_t *pcm) {
+    sbc_decoder_t state;
+    sbc_header_t header;
+    uint32_t num_samples = 0;
+
+    decoder->init(&state);
+    decoder->set_gain(&state, gain);
+    for (uint32_t frame = 0; frame < NUM_FRAMES; frame++) {
+        if (!decoder->decode(&state, _frames[frame], _frame_lengths[frame], &pcm[num_samples], &header)) {
+            printf("FAIL %s rejected frame %u\n", decoder->name, (unsigned)frame);
+            return 0;
+        }
+        num_samples += header.num_samples * header.num_channels;
+    }
+    return num_samples;
+}
+
+
+static bool check_bit_exact(const char *layout_name, int32_t gain) {
+    uint32_t num_expected = decode(&_decoders[0], gain, _expected);
+    if (!num_expected) return false;
+
+    for (size_t d = 1; d < sizeof(_decoders) / sizeof(_decoders[0]); d++) {
+        uint32_t num_samples = decode(&_decoders[d], gain, _output);
+        if (num_samples != num_expected) return false;
+        for (uint32_t i = 0; i < num_samples; i++) {
+            if (_output[i] != _expected[i]) {
+                printf("FAIL %s %s gain %d sample %u: %d instead of %d\n", _decoders[d].name, layout_name, (int)gain,
+                       (unsigned)i, _output[i], _expected[i]);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+
+// of the generic decoder at unity gain against bluedroid
+static double reference_snr_db(uint32_t *max_difference) {
+    uint32_t num_samples = decode(&_decoders[0], VOLUME_UNITY, _output);
+    if (num_samples > _reference_samples) num_samples = _reference_samples;
+
+    double signal = 0.0;
+    double noise = 0.0;
+    *max_difference = 0;
+    for (uint32_t i = 0; i < num_samples; i++) {
+        int32_t difference = _output[i] - _reference[i];
+        signal += (double)_reference[i] * _reference[i];
+        noise += (double)difference * difference;
+        if ((uint32_t)abs(difference) > *max_difference) *max_difference = abs(difference);
+    }
+    if (noise == 0.0) return INFINITY;
+    return 10.0 * log10(signal / noise);
+}
+
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+static uint64_t now_ticks(void) {
+#ifdef HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+
+typedef struct {
+    double ns_per_frame;
+    double ticks_per_frame;
+} timing_t;
+
+
+static timing_t time_reference(uint32_t iterations) {
+    double start = now_s();
+    uint64_t start_ticks = now_ticks();
+    for (uint32_t i = 0; i < iterations; i++) {
+        decode_reference();
+    }
+    uint64_t ticks = now_ticks() - start_ticks;
+    double frames = (double)iterations * NUM_FRAMES;
+    return (timing_t){ (now_s() - start) * 1e9 / frames, ticks / frames };
+}
+
+
+static timing_t time_decoder(const decoder_t *decoder, uint32_t iterations) {
+    double start = now_s();
+    uint64_t start_ticks = now_ticks();
+    for (uint32_t i = 0; i < iterations; i++) {
+        decode(decoder, VOLUME_UNITY, _output);
+    }
+    uint64_t ticks = now_ticks() - start_ticks;
+    double frames = (double)iterations * NUM_FRAMES;
+    return (timing_t){ (now_s() - start) * 1e9 / frames, ticks / frames };
+}
+
+
+int main(int argc, char *argv[]) {
+    uint32_t iterations = argc > 1 ? strtoul(argv[1], NULL, 0) : 20;
+    bool ok = true;
+
+    printf("layout,bitpool,reference_snr_db,reference_max_difference,"
+           "bluedroid_ns_per_frame,generic_ns_per_frame,pico_ns_per_frame,"
+           "bluedroid_ticks_per_frame,generic_ticks_per_frame,pico_ticks_per_frame\n");
+    for (size_t l = 0; l < sizeof(_layouts) / sizeof(_layouts[0]); l++) {
+        const layout_t *layout = &_layouts[l];
+        char name[64];
+        snprintf(name, sizeof(name), "%u/%u/%u/%s/%s", (unsigned)layout->sample_rate, layout->blocks, layout->subbands,
+                 _mode_names[layout->channel_mode], layout->allocation_method == SBC_SNR ? "snr" : "loudness");
+
+        encode(layout);
+        decode_reference();
+
+        ok &= check_bit_exact(name, VOLUME_UNITY);
+        ok &= check_bit_exact(name, volume_from_avrcp(100));
+        ok &= check_bit_exact(name, volume_from_avrcp(1));
+
+        uint32_t max_difference;
+        double snr_db = reference_snr_db(&max_difference);
+        if (snr_db < REFERENCE_MIN_SNR_DB) {
+            printf("FAIL %s only %.1f dB from bluedroid\n", name, snr_db);
+            ok = false;
+        }
+
+        timing_t bluedroid = time_reference(iterations);
+        timing_t generic = time_decoder(&_decoders[0], iterations);
+        timing_t pico = time_decoder(&_decoders[1], iterations);
+        printf("%s,%u,%.1f,%u,%.0f,%.0f,%.0f,%.0f,%.0f,%.0f\n", name, layout->bitpool, snr_db, (unsigned)max_difference,
+               bluedroid.ns_per_frame, generic.ns_per_frame, pico.ns_per_frame,
+               bluedroid.ticks_per_frame, generic.ticks_per_frame, pico.ticks_per_frame);
+    }
+    printf("# generic, pico and pico dsp decoders bit exact, within %.0f dB of bluedroid: %s\n",
+           REFERENCE_MIN_SNR_DB, ok ? "yes" : "NO");
+
+    return ok ? 0 : 1;
+}
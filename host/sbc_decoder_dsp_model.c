@@ -0,0 +1,10 @@
+// The cortex-m33 path of sbc_decoder.c built for the host, with the acle
+// intrinsics of acle/arm_acle.h, under its own names for sbc_bench.c
+
+#define __ARM_FEATURE_DSP 1
+#define sbc_decoder_init sbc_decoder_init_dsp
+#define sbc_decoder_reset sbc_decoder_reset_dsp
+#define sbc_decoder_set_gain sbc_decoder_set_gain_dsp
+#define sbc_decoder_decode sbc_decoder_decode_dsp
+
+#include "sbc_decoder.c"
@@ -0,0 +1,9 @@
+// sbc_decoder.c without its specialized decoders, under its own names for sbc_bench.c
+
+#define SBC_DECODER_GENERIC_ONLY
+#define sbc_decoder_init sbc_decoder_init_generic
+#define sbc_decoder_reset sbc_decoder_reset_generic
+#define sbc_decoder_set_gain sbc_decoder_set_gain_generic
+#define sbc_decoder_decode sbc_decoder_decode_generic
+
+#include "sbc_decoder.c"
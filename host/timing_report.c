@@ -0,0 +1,132 @@
+// Report of the stage timing records of a pico built with TIMING (or of the host binary, -T)
+// Reads a capture of its stdio, e.g. after "stty -F /dev/ttyACM0 raw -echo" with
+// "cat /dev/ttyACM0 >capture.bin" while sending "printf t >/dev/ttyACM0", console text
+// around the records is skipped. Prints every record found as csv: per stage the count,
+// min, average and max in microseconds, the 50th and 99th percentile as the upper end of
+// their histogram bucket and the share of the time since the records started.
+// With a refill deadline in the record, the longest wait for a refill plus the longest
+// refill is checked against it: beyond it i2s would have run out of audio.
+// -H adds the histograms. Usage: timing-report [-H] [capture.bin (default stdin)]
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "timing.h"
+
+
+#define MAX_CAPTURE (64 * 1024 * 1024)
+
+
+static uint8_t *read_capture(FILE *file, uint32_t *size) {
+    uint32_t capacity = 64 * 1024;
+    uint8_t *data = malloc(capacity);
+    *size = 0;
+    size_t got;
+    while (data && (got = fread(data + *size, 1, capacity - *size, file)) > 0) {
+        *size += got;
+        if (*size == capacity && capacity < MAX_CAPTURE) {
+            capacity *= 2;
+            data = realloc(data, capacity);
+        } else if (*size == capacity) {
+            break;
+        }
+    }
+    return data;
+}
+
+
+// cycles at the upper end of the bucket that holds the given share of the stage
+static uint32_t percentile(const timing_record_t *record, uint32_t percent) {
+    uint64_t wanted = ((uint64_t)record->count * percent + 99) / 100;
+    uint64_t seen = 0;
+    for (int i = 0; i < TIMING_BUCKETS; i++) {
+        seen += record->histogram[i];
+        if (seen >= wanted) {
+            return i == TIMING_BUCKETS - 1 ? record->max : (uint32_t)((1ull << i) - 1);
+        }
+    }
+    return record->max;
+}
+
+
+static void report(uint32_t number, const timing_record_t records[TIMING_STAGES], uint32_t clock_hz,
+                   uint32_t elapsed_ms, uint32_t deadline_us, bool histograms) {
+    double us_per_cycle = 1e6 / clock_hz;
+    printf("# record %u: %u ms at %.1f MHz\n", (unsigned)number, (unsigned)elapsed_ms, clock_hz / 1e6);
+    printf("stage,count,min_us,avg_us,max_us,p50_us,p99_us,busy_percent\n");
+    for (int stage = 0; stage < TIMING_STAGES; stage++) {
+        const timing_record_t *record = &records[stage];
+        double avg = record->count ? (double)record->sum / record->count : 0;
+        double busy = elapsed_ms ? record->sum * us_per_cycle / (elapsed_ms * 10.0) : 0;
+        printf("%s,%u,%.2f,%.2f,%.2f,%.2f,%.2f,%.3f\n", timing_stage_name(stage), (unsigned)record->count,
+            record->min * us_per_cycle, avg * us_per_cycle, record->max * us_per_cycle,
+            percentile(record, 50) * us_per_cycle, percentile(record, 99) * us_per_cycle, busy);
+    }
+    if (deadline_us) {
+        double wait = records[TIMING_REFILL_WAIT].max * us_per_cycle;
+        double fill = records[TIMING_FILL].max * us_per_cycle;
+        printf("# refill waited up to %.0f us and took up to %.0f us of the %u us the output buffers cover: %s\n",
+            wait, fill, (unsigned)deadline_us, wait + fill < deadline_us ? "in time" : "TOO LATE");
+    }
+    if (!histograms) return;
+
+    printf("stage,below_us,count\n");
+    for (int stage = 0; stage < TIMING_STAGES; stage++) {
+        for (int i = 0; i < TIMING_BUCKETS; i++) {
+            if (records[stage].histogram[i]) {
+                printf("%s,%.2f,%u\n", timing_stage_name(stage), (double)(1ull << i) * us_per_cycle,
+                    (unsigned)records[stage].histogram[i]);
+            }
+        }
+    }
+}
+
+
+int main(int argc, char *argv[]) {
+    bool histograms = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "Hh")) != -1) {
+        if (opt == 'H') {
+            histograms = true;
+        } else {
+            printf("usage: %s [-H] [capture.bin]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    FILE *file = optind < argc ? fopen(argv[optind], "rb") : stdin;
+    if (!file) {
+        printf("cannot open %s\n", argv[optind]);
+        return 1;
+    }
+    uint32_t size;
+    uint8_t *capture = read_capture(file, &size);
+    if (file != stdin) {
+        fclose(file);
+    }
+
+    // a record is where its magic is and the checksum fits, anything else is console text
+    uint32_t found = 0;
+    uint32_t pos = 0;
+    while (capture && pos + TIMING_RECORD_SIZE <= size) {
+        timing_record_t records[TIMING_STAGES];
+        uint32_t clock_hz, elapsed_ms, deadline_us;
+        if (capture[pos] == 'P' && timing_decode(&capture[pos], size - pos, records, &clock_hz, &elapsed_ms, &deadline_us)) {
+            report(++found, records, clock_hz, elapsed_ms, deadline_us, histograms);
+            pos += TIMING_RECORD_SIZE;
+        } else {
+            pos++;
+        }
+    }
+    free(capture);
+
+    if (!found) {
+        printf("no timing record found\n");
+        return 1;
+    }
+    return 0;
+}
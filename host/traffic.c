@@ -0,0 +1,466 @@
+#include "traffic.h"
+
+#include <btstack.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "profiles_host.h"
+#include "sbc_header.h"
+
+
+#define MEDIA_MTU          895  // typical l2cap mtu negotiated by phones
+#define MAX_SBC_FRAME_SIZE 512
+#define MAX_FRAMES         15   // 4 bit frame count in sbc header
+#define MAX_BURST          16
+#define SBC_BLOCKS         16
+#define SBC_SUBBANDS       8
+#define APTX_FRAME_SIZE    64   // 16 codewords, 64 audio frames, read at a time
+#define APTX_SAMPLE_RATE   44100  // raw .aptx files do not tell, the rate of most phones
+#define AAC_MTU            1691 // aac sources take what the sink allows, an access unit has to fit
+#define MAX_AAC_FRAME_SIZE 1536 // 6144 bits per channel
+#define AAC_FRAME_SAMPLES  1024
+#define AAC_CONFIG_PERIOD  8    // AudioMuxElements, one of them carries the StreamMuxConfig
+
+
+typedef struct {
+    uint8_t  data[AAC_MTU];
+    uint16_t size;
+    bool     lost;
+    uint64_t first_sample;  // audio frames of the stream before this packet
+} packet_t;
+
+
+static const traffic_profile_t _profiles[] = {
+    // name         jitter  burst  drift  loss
+    { "ideal",           0,     1,     0,  0.0f },
+    { "phone",          10,     1,    50,  0.0f },  // typical phone next to the receiver
+    { "jitter",         60,     1,     0,  0.0f },  // crackles with some phones
+    { "burst",          20,     6,     0,  0.0f },  // source buffers and sends in chunks
+    { "fast",            5,     1,   200,  0.0f },  // source clock runs fast
+    { "slow",            5,     1,  -200,  0.0f },  // source clock runs slow, slow buffer fill
+    { "congested",      40,     3,   100,  2.0f },  // busy 2.4 GHz band
+};
+
+static FILE *_file = 0;
+static bool _is_wav = false;
+static bool _is_aptx = false;
+static bool _is_aac = false;
+static uint8_t _aac_sampling_index = 0;
+static uint8_t _aac_channels = 0;
+static uint32_t _aac_frames_sent = 0;
+static uint16_t _wav_channels = 0;
+static btstack_sbc_encoder_state_t _encoder_state;
+
+static sbc_header_t _info = {0};
+static uint8_t _next_frame[MAX_AAC_FRAME_SIZE];  // or an sbc frame or aptx codewords
+static int _next_frame_length = 0;
+
+static const traffic_profile_t *_profile = 0;
+static void (*_done)(void) = 0;
+static void (*_arrival)(uint64_t first_sample) = 0;
+static uint32_t _random = 0;
+static btstack_timer_source_t _timer;
+static uint32_t _start_ms = 0;
+static double _arrival_ms = 0;
+static uint64_t _source_samples = 0;
+static uint16_t _sequence_number = 0;
+static packet_t _packets[MAX_BURST];
+static int _num_packets = 0;
+static traffic_stats_t _stats = {0};
+
+
+// deterministic pseudo random numbers (xorshift32) so runs are repeatable
+static uint32_t next_random(void) {
+    _random ^= _random << 13;
+    _random ^= _random >> 17;
+    _random ^= _random << 5;
+    return _random;
+}
+
+
+// next frame from the sbc file, returns its length or 0 at the end
+static int read_sbc_frame(uint8_t *frame) {
+    sbc_header_t info;
+    if (fread(frame, 1, 4, _file) != 4) return 0;
+    if (!sbc_header_parse(frame, 4, &info) || info.frame_length > MAX_SBC_FRAME_SIZE) {
+        printf("# invalid sbc frame header\n");
+        return 0;
+    }
+    if (fread(frame + 4, 1, info.frame_length - 4, _file) != info.frame_length - 4u) return 0;
+    return info.frame_length;
+}
+
+
+// next frame encoded from the wav file, returns its length or 0 at the end
+static int read_wav_frame(uint8_t *frame) {
+    int16_t pcm[SBC_BLOCKS * SBC_SUBBANDS * 2];
+    size_t samples = SBC_BLOCKS * SBC_SUBBANDS * _wav_channels;
+
+    size_t got = fread(pcm, sizeof(int16_t), samples, _file);
+    if (got == 0) return 0;
+    memset(&pcm[got], 0, (samples - got) * sizeof(int16_t));
+
+    btstack_sbc_encoder_process_data(pcm);
+    int length = btstack_sbc_encoder_sbc_buffer_length();
+    memcpy(frame, btstack_sbc_encoder_sbc_buffer(), length);
+    return length;
+}
+
+
+// next whole aptx codewords from the raw file, returns their length or 0 at the end
+static int read_aptx_frame(uint8_t *frame) {
+    size_t got = fread(frame, 1, APTX_FRAME_SIZE, _file);
+    return got - got % 4;
+}
+
+
+// next access unit of the adts file, returns its length or 0 at the end
+static int read_aac_frame(uint8_t *frame) {
+    uint8_t header[9];
+    if (fread(header, 1, 7, _file) != 7) return 0;
+    uint32_t length = ((header[3] & 3) << 11) | (header[4] << 3) | (header[5] >> 5);
+    uint32_t header_size = (header[1] & 1) ? 7 : 9;  // with crc
+    if (header[0] != 0xFF || (header[1] & 0xF6) != 0xF0 || (header[6] & 3) ||
+        length <= header_size || length - header_size > MAX_AAC_FRAME_SIZE) {
+        printf("# invalid adts header\n");
+        return 0;
+    }
+    if (header_size > 7 && fread(&header[7], 1, 2, _file) != 2) return 0;
+    _aac_sampling_index = (header[2] >> 2) & 0xF;
+    _aac_channels = ((header[2] & 1) << 2) | (header[3] >> 6);
+    if (fread(frame, 1, length - header_size, _file) != length - header_size) return 0;
+    return length - header_size;
+}
+
+
+// one frame lookahead, so packets are only filled with frames that fit
+static void fetch_frame(void) {
+    _next_frame_length = _is_aptx ? read_aptx_frame(_next_frame) : _is_aac ? read_aac_frame(_next_frame) :
+                         _is_wav ? read_wav_frame(_next_frame) : read_sbc_frame(_next_frame);
+}
+
+
+static bool open_wav(uint8_t bitpool, bool dual) {
+    uint8_t chunk[8];
+    uint8_t fmt[16] = {0};
+    uint32_t sample_rate = 0;
+    uint16_t bits = 0;
+
+    if (fread(chunk, 1, 4, _file) != 4 || memcmp(chunk, "WAVE", 4)) return false;
+
+    // skip chunks until data, remember format
+    while (fread(chunk, 1, sizeof(chunk), _file) == sizeof(chunk)) {
+        uint32_t size = little_endian_read_32(chunk, 4);
+        if (!memcmp(chunk, "data", 4)) break;
+        if (!memcmp(chunk, "fmt ", 4) && size >= sizeof(fmt)) {
+            if (fread(fmt, 1, sizeof(fmt), _file) != sizeof(fmt)) return false;
+            _wav_channels = little_endian_read_16(fmt, 2);
+            sample_rate = little_endian_read_32(fmt, 4);
+            bits = little_endian_read_16(fmt, 14);
+            size -= sizeof(fmt);
+        }
+        fseek(_file, (size + 1) & ~1u, SEEK_CUR);
+    }
+
+    if (little_endian_read_16(fmt, 0) != 1 || bits != 16 || _wav_channels < 1 || _wav_channels > 2) {
+        printf("# only 16 bit pcm mono or stereo wav files are supported\n");
+        return false;
+    }
+    if (sample_rate != 16000 && sample_rate != 32000 && sample_rate != 44100 && sample_rate != 48000) {
+        printf("# sbc needs 16, 32, 44.1 or 48 kHz, not %u Hz\n", (unsigned)sample_rate);
+        return false;
+    }
+
+    btstack_sbc_encoder_init(&_encoder_state, SBC_MODE_STANDARD, SBC_BLOCKS, SBC_SUBBANDS, SBC_LOUDNESS,
+        sample_rate, bitpool, _wav_channels == 1 ? SBC_CHANNEL_MODE_MONO : dual ? SBC_CHANNEL_MODE_DUAL_CHANNEL : SBC_CHANNEL_MODE_JOINT_STEREO);
+    return true;
+}
+
+
+const traffic_profile_t * traffic_get_profile(const char *name) {
+    for (size_t i = 0; i < sizeof(_profiles) / sizeof(_profiles[0]); i++) {
+        if (!strcmp(_profiles[i].name, name)) return &_profiles[i];
+    }
+    return 0;
+}
+
+
+void traffic_list_profiles(void) {
+    for (size_t i = 0; i < sizeof(_profiles) / sizeof(_profiles[0]); i++) {
+        const traffic_profile_t *p = &_profiles[i];
+        printf("  %-10s jitter %3u ms, burst %2u, drift %+4d ppm, loss %.1f%%\n",
+            p->name, (unsigned)p->jitter_ms, (unsigned)p->burst, (int)p->drift_ppm, p->loss_percent);
+    }
+}
+
+
+bool traffic_open(const char *filename, uint8_t bitpool, bool dual) {
+    uint8_t magic[4];
+
+    if (_file) {
+        fclose(_file);
+    }
+    _file = fopen(filename, "rb");
+    if (!_file) {
+        printf("# cannot open %s\n", filename);
+        return false;
+    }
+    if (fread(magic, 1, sizeof(magic), _file) != sizeof(magic)) return false;
+
+    size_t name_length = strlen(filename);
+    _is_aptx = name_length > 5 && !strcmp(filename + name_length - 5, ".aptx");
+    _is_aac = name_length > 4 && !strcmp(filename + name_length - 4, ".aac");
+    _is_wav = !_is_aptx && !_is_aac && !memcmp(magic, "RIFF", 4);
+    if (_is_wav) {
+        fseek(_file, 4, SEEK_CUR);  // riff size
+        if (!open_wav(bitpool, dual)) return false;
+    } else {
+        rewind(_file);
+    }
+
+    fetch_frame();
+    if (_is_aptx) {
+        _info.sampling_frequency = APTX_SAMPLE_RATE;
+        _info.num_channels = 2;
+        return _next_frame_length > 0;
+    }
+    if (_is_aac) {
+        static const uint32_t rates[16] = { 96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050,
+                                            16000, 12000, 11025, 8000, 7350 };
+        _info.sampling_frequency = rates[_aac_sampling_index];
+        _info.num_channels = _aac_channels;
+        if (!_next_frame_length || (_info.sampling_frequency != 44100 && _info.sampling_frequency != 48000) ||
+            _aac_channels < 1 || _aac_channels > 2) {
+            printf("# %s has no aac frames at 44.1 or 48kHz in mono or stereo\n", filename);
+            return false;
+        }
+        return true;
+    }
+
+    // sbc configuration from the first frame
+    if (!_next_frame_length || !sbc_header_parse(_next_frame, _next_frame_length, &_info)) {
+        printf("# %s has no sbc frames\n", filename);
+        return false;
+    }
+    return true;
+}
+
+
+void traffic_configure_sink(void) {
+    if (_is_aptx) {
+        profiles_host_aptx_configuration(_info.sampling_frequency, false);
+        return;
+    }
+    if (_is_aac) {
+        profiles_host_aac_configuration(_info.sampling_frequency, _info.num_channels, 0, false);  // vbr, no rate known
+        return;
+    }
+    profiles_host_sbc_configuration(_info.sampling_frequency, _info.channel_mode, _info.block_length,
+        _info.subbands, _info.allocation_method, 2, _info.bitpool, false);
+}
+
+
+// aptx packets are just codewords, as many as fit
+static bool build_aptx_packet(packet_t *packet) {
+    int pos = 0;
+
+    while (_next_frame_length && pos + _next_frame_length <= MEDIA_MTU) {
+        memcpy(&packet->data[pos], _next_frame, _next_frame_length);
+        pos += _next_frame_length;
+        _source_samples += _next_frame_length;  // 4 audio frames per 4 byte codeword pair
+        _stats.frames_sent++;
+        fetch_frame();
+    }
+    if (!pos) return false;
+
+    packet->size = pos;
+    packet->lost = next_random() % 100000 < (uint32_t)(_profile->loss_percent * 1000);
+    return true;
+}
+
+
+static void put_bits(uint8_t *data, uint32_t *position, uint32_t value, uint8_t num_bits) {
+    while (num_bits--) {
+        if (value >> num_bits & 1) {
+            data[*position >> 3] |= 0x80 >> (*position & 7);
+        }
+        (*position)++;
+    }
+}
+
+
+// ISO 14496-3 1.7.3: audioMuxVersion 0, one program and layer, AudioSpecificConfig of aac lc
+static void put_stream_mux_config(uint8_t *data, uint32_t *position) {
+    put_bits(data, position, 0, 1);     // audioMuxVersion
+    put_bits(data, position, 1, 1);     // allStreamsSameTimeFraming
+    put_bits(data, position, 0, 6);     // numSubFrames - 1
+    put_bits(data, position, 0, 4);     // numProgram - 1
+    put_bits(data, position, 0, 3);     // numLayer - 1
+    put_bits(data, position, 2, 5);     // audioObjectType aac lc
+    put_bits(data, position, _aac_sampling_index, 4);
+    put_bits(data, position, _aac_channels, 4);
+    put_bits(data, position, 0, 3);     // GASpecificConfig: 1024 samples, no core coder, no extension
+    put_bits(data, position, 0, 3);     // frameLengthType, variable
+    put_bits(data, position, 0xFF, 8);  // latmBufferFullness
+    put_bits(data, position, 0, 1);     // otherDataPresent
+    put_bits(data, position, 0, 1);     // crcCheckPresent
+}
+
+
+// one access unit in an AudioMuxElement, every AAC_CONFIG_PERIOD-th with the configuration
+static bool build_aac_packet(packet_t *packet) {
+    if (!_next_frame_length) return false;
+
+    uint8_t *data = &packet->data[12];
+    uint32_t position = 0;
+    memset(data, 0, AAC_MTU - 12);
+    bool config = _aac_frames_sent % AAC_CONFIG_PERIOD == 0;
+    put_bits(data, &position, !config, 1);  // useSameStreamMux
+    if (config) {
+        put_stream_mux_config(data, &position);
+    }
+    for (int length = _next_frame_length; length >= 0; length -= 255) {  // PayloadLengthInfo
+        put_bits(data, &position, length >= 255 ? 255 : length, 8);
+    }
+    for (int i = 0; i < _next_frame_length; i++) {
+        put_bits(data, &position, _next_frame[i], 8);
+    }
+
+    packet->data[0] = 0x80;  // rtp version 2
+    packet->data[1] = 0x60;  // dynamic payload type
+    big_endian_store_16(packet->data, 2, _sequence_number++);
+    big_endian_store_32(packet->data, 4, (uint32_t)_source_samples);
+    big_endian_store_32(packet->data, 8, 0x5bc5bc);  // ssrc
+    packet->size = 12 + (position + 7) / 8;
+    packet->lost = next_random() % 100000 < (uint32_t)(_profile->loss_percent * 1000);
+
+    _source_samples += AAC_FRAME_SAMPLES;
+    _aac_frames_sent++;
+    _stats.frames_sent++;
+    fetch_frame();
+    return true;
+}
+
+
+// fill the next packet with as many frames as fit, returns false at the end
+static bool build_packet(packet_t *packet) {
+    packet->first_sample = _source_samples;
+    if (_is_aptx) return build_aptx_packet(packet);
+    if (_is_aac) return build_aac_packet(packet);
+
+    int pos = 12 + 1;  // room for rtp and sbc header
+    int num_frames = 0;
+    uint32_t timestamp = (uint32_t)_source_samples;
+
+    while (_next_frame_length && num_frames < MAX_FRAMES && pos + _next_frame_length <= MEDIA_MTU) {
+        sbc_header_t info;
+        sbc_header_parse(_next_frame, _next_frame_length, &info);
+        memcpy(&packet->data[pos], _next_frame, _next_frame_length);
+        pos += _next_frame_length;
+        num_frames++;
+        _source_samples += info.num_samples;
+        fetch_frame();
+    }
+    if (!num_frames) return false;
+
+    packet->data[0] = 0x80;  // rtp version 2
+    packet->data[1] = 0x60;  // dynamic payload type
+    big_endian_store_16(packet->data, 2, _sequence_number++);
+    big_endian_store_32(packet->data, 4, timestamp);
+    big_endian_store_32(packet->data, 8, 0x5bc5bc);  // ssrc
+    packet->data[12] = num_frames;
+    packet->size = pos;
+    packet->lost = next_random() % 100000 < (uint32_t)(_profile->loss_percent * 1000);
+
+    _stats.frames_sent += num_frames;
+    return true;
+}
+
+
+// the source sends a burst once the audio of its last packet exists (source clock),
+// the sink sees it after some random air and stack delay, never out of order
+static bool build_burst(void) {
+    uint32_t burst = btstack_max(1u, btstack_min(_profile->burst, (uint32_t)MAX_BURST));
+
+    _num_packets = 0;
+    while (_num_packets < (int)burst && build_packet(&_packets[_num_packets])) {
+        _num_packets++;
+    }
+    if (!_num_packets) return false;
+
+    double source_rate = _info.sampling_frequency * (1.0 + _profile->drift_ppm / 1e6);
+    double send_ms = _source_samples * 1000.0 / source_rate;
+    double delay_ms = _profile->jitter_ms ? next_random() % (_profile->jitter_ms + 1) : 0;
+    if (send_ms + delay_ms > _arrival_ms) {
+        _arrival_ms = send_ms + delay_ms;
+    }
+    return true;
+}
+
+
+static void schedule(btstack_timer_source_t *ts) {
+    uint32_t elapsed = btstack_run_loop_get_time_ms() - _start_ms;
+    uint32_t due = (uint32_t)_arrival_ms;
+    btstack_run_loop_set_timer(ts, due > elapsed ? due - elapsed : 0);
+    btstack_run_loop_add_timer(ts);
+}
+
+
+static void timer_handler(btstack_timer_source_t *ts) {
+    for (int i = 0; i < _num_packets; i++) {
+        if (_packets[i].lost) {
+            _stats.packets_lost++;
+            continue;
+        }
+        if (_arrival) (*_arrival)(_packets[i].first_sample);
+        profiles_host_media_packet(_packets[i].data, _packets[i].size);
+        _stats.packets_sent++;
+    }
+
+    if (build_burst()) {
+        schedule(ts);
+    } else if (_done) {
+        (*_done)();
+    }
+}
+
+
+void traffic_start(const traffic_profile_t *profile, uint32_t seed, void (*done)(void)) {
+    _profile = profile;
+    _random = seed ? seed : 1;
+    _done = done;
+    _start_ms = btstack_run_loop_get_time_ms() - (uint32_t)_arrival_ms;
+
+    if (!build_burst()) {
+        if (_done) (*_done)();
+        return;
+    }
+    btstack_run_loop_set_timer_handler(&_timer, &timer_handler);
+    schedule(&_timer);
+}
+
+
+void traffic_stop(void) {
+    btstack_run_loop_remove_timer(&_timer);
+}
+
+
+void traffic_set_arrival_handler(void (*arrival)(uint64_t first_sample)) {
+    _arrival = arrival;
+}
+
+
+const traffic_stats_t * traffic_get_stats(void) {
+    return &_stats;
+}
+
+
+uint32_t traffic_get_sample_rate(void) {
+    return _info.sampling_frequency;
+}
+
+
+bool traffic_is_sbc(void) {
+    return !_is_aptx && !_is_aac;
+}
@@ -0,0 +1,61 @@
+#ifndef traffic_h
+#define traffic_h
+
+// Stand-in for a phone: packetizes sbc frames from an .sbc file, or a .wav file
+// encoded on the fly, into avdtp media packets with rtp and sbc headers and
+// delivers them to the a2dp media handler with a configurable arrival pattern.
+// Raw .aptx files (e.g. from "ffmpeg -i music.wav -c:a aptx music.aptx") are sent
+// as bare codewords, like android sources send aptx.
+// .aac files with adts headers (e.g. from "ffmpeg -i music.wav -c:a aac -b:a 256k music.aac")
+// are sent one access unit per packet after an rtp header, in LATM AudioMuxElements.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+typedef struct {
+    const char *name;
+    uint32_t jitter_ms;     // extra delay of each packet (or burst), uniform 0..jitter_ms
+    uint32_t burst;         // packets held back by the source and delivered together
+    int32_t  drift_ppm;     // source clock relative to the sink clock
+    float    loss_percent;  // packets lost on air
+} traffic_profile_t;
+
+typedef struct {
+    uint32_t packets_sent;
+    uint32_t packets_lost;
+    uint32_t frames_sent;
+} traffic_stats_t;
+
+
+// predefined arrival patterns, NULL if name is unknown
+const traffic_profile_t * traffic_get_profile(const char *name);
+void traffic_list_profiles(void);
+
+// .sbc, .aptx and .aac files are sent as they are, .wav files are encoded with bitpool,
+// stereo ones in dual channel mode instead of joint stereo if dual is set.
+// Opening again, e.g. the same file at its end, closes the one before
+bool traffic_open(const char *filename, uint8_t bitpool, bool dual);
+
+// codec configuration the source would negotiate, valid after traffic_open()
+void traffic_configure_sink(void);
+
+// start delivering packets, done is called after the last one.
+// After traffic_stop() the stream goes on where it stopped, as after a pause of the source
+void traffic_start(const traffic_profile_t *profile, uint32_t seed, void (*done)(void));
+
+// no more packets until traffic_start()
+void traffic_stop(void);
+
+// called right before a packet is delivered, with the audio frames of the stream before it
+void traffic_set_arrival_handler(void (*arrival)(uint64_t first_sample));
+
+const traffic_stats_t * traffic_get_stats(void);
+
+// of the stream, valid after traffic_open()
+uint32_t traffic_get_sample_rate(void);
+
+// .sbc files and .wav files encoded to it, the codec with bitpools to adapt
+bool traffic_is_sbc(void);
+
+#endif
@@ -0,0 +1,165 @@
+// Bit exactness and speed of the volume kernels of volume.c
+// Compares the portable and the (host modelled) cortex-m33 kernels with the
+// former per sample loop of a2dp.c, at Q15, for every sample value and a sweep
+// of volumes, in place and out of place, with odd lengths and misaligned buffers.
+// Then times the reference loop and the portable kernel on sbc frame sized blocks.
+// Timing of the modelled dsp kernel says nothing about the m33, measure that on the pico.
+// Usage: volume-bench [iterations (default 200000)]
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "volume.h"
+
+
+// from volume_dsp_model.c
+void volume_apply_dsp(int16_t *dst, const int16_t *src, uint32_t num_samples, int32_t volume);
+void volume_apply_mono_to_stereo_dsp(int16_t *dst, const int16_t *src, uint32_t num_frames, int32_t volume);
+
+typedef void (*apply_t)(int16_t *dst, const int16_t *src, uint32_t num_samples, int32_t volume);
+
+#define NUM_SAMPLES    65536     // every int16 value once
+#define FRAME_SAMPLES  (128 * 2) // one 16 block, 8 subband stereo sbc frame
+
+
+static int16_t _input[NUM_SAMPLES + 8];
+static int16_t _expected[2 * NUM_SAMPLES + 8];
+static int16_t _output[2 * NUM_SAMPLES + 8];
+
+
+// the loop play_pcm_data() used before, Q7 then
+static void reference_apply(int16_t *data, int samples, int32_t volume) {
+    int32_t sample;
+    for( int32_t i=0; i<samples; ++i ) {
+        sample = (volume * data[i]) >> VOLUME_SHIFT;
+        if( sample < INT16_MIN) {
+            data[i] = INT16_MIN;
+        } 
+        else if( sample > INT16_MAX) {
+            data[i] = INT16_MAX;
+        } 
+        else {
+            data[i] = sample;
+        } 
+    }
+}
+
+
+static bool check(const char *name, const int16_t *output, const int16_t *expected, uint32_t num_samples, int32_t volume) {
+    for (uint32_t i = 0; i < num_samples; i++) {
+        if (output[i] != expected[i]) {
+            printf("FAIL %s volume %d sample %u: %d instead of %d\n", name, (int)volume, (unsigned)i, output[i], expected[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+
+static bool check_apply(const char *name, apply_t apply, int32_t volume) {
+    bool ok = true;
+
+    // all lengths up to 7 and all offsets up to 3 cover the tails and halfword aligned starts
+    for (uint32_t offset = 0; offset < 4; offset++) {
+        uint32_t num_samples = NUM_SAMPLES - offset - (volume % 8);
+        const int16_t *src = &_input[offset];
+
+        memcpy(_expected, src, num_samples * sizeof(int16_t));
+        reference_apply(_expected, num_samples, volume);
+
+        apply(&_output[3 - offset], src, num_samples, volume);
+        ok &= check(name, &_output[3 - offset], _expected, num_samples, volume);
+
+        memcpy(_output, src, num_samples * sizeof(int16_t));
+        apply(_output, _output, num_samples, volume);
+        ok &= check(name, _output, _expected, num_samples, volume);
+    }
+    return ok;
+}
+
+
+static bool check_mono_to_stereo(const char *name, apply_t apply, int32_t volume) {
+    uint32_t num_frames = NUM_SAMPLES - 1 - (volume % 8);
+    int16_t *scaled = &_output[NUM_SAMPLES];
+
+    memcpy(scaled, &_input[1], num_frames * sizeof(int16_t));
+    reference_apply(scaled, num_frames, volume);
+    for (uint32_t i = 0; i < num_frames; i++) {
+        _expected[2*i] = _expected[2*i+1] = scaled[i];
+    }
+
+    apply(&_output[1], &_input[1], num_frames, volume);
+    return check(name, &_output[1], _expected, 2 * num_frames, volume);
+}
+
+
+// every volume up to 255, then in coarse steps, and the top end including unity
+static int32_t next_volume(int32_t volume) {
+    if (volume < 255 || volume >= VOLUME_UNITY - 2) return volume + 1;
+    return volume + 251 < VOLUME_UNITY - 2 ? volume + 251 : VOLUME_UNITY - 2;
+}
+
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+static double time_reference(uint32_t iterations, int32_t volume) {
+    double start = now_s();
+    for (uint32_t i = 0; i < iterations; i++) {
+        reference_apply(&_output[(i % 64) * FRAME_SAMPLES], FRAME_SAMPLES, volume);
+    }
+    return (now_s() - start) * 1e9 / ((double)iterations * FRAME_SAMPLES);
+}
+
+
+static double time_apply(apply_t apply, uint32_t iterations, int32_t volume) {
+    double start = now_s();
+    for (uint32_t i = 0; i < iterations; i++) {
+        int16_t *block = &_output[(i % 64) * FRAME_SAMPLES];
+        apply(block, block, FRAME_SAMPLES, volume);
+    }
+    return (now_s() - start) * 1e9 / ((double)iterations * FRAME_SAMPLES);
+}
+
+
+int main(int argc, char *argv[]) {
+    uint32_t iterations = argc > 1 ? strtoul(argv[1], NULL, 0) : 200000;
+    bool ok = true;
+
+    for (uint32_t i = 0; i < NUM_SAMPLES; i++) {
+        _input[i] = (int16_t)(i ^ 0x8000);  // INT16_MIN .. INT16_MAX
+    }
+
+    for (int32_t volume = 0; volume <= VOLUME_UNITY; volume = next_volume(volume)) {
+        ok &= check_apply("volume_apply", volume_apply, volume);
+        ok &= check_apply("volume_apply dsp", volume_apply_dsp, volume);
+        ok &= check_mono_to_stereo("volume_apply_mono_to_stereo", volume_apply_mono_to_stereo, volume);
+        ok &= check_mono_to_stereo("volume_apply_mono_to_stereo dsp", volume_apply_mono_to_stereo_dsp, volume);
+    }
+    printf("# bit exact for volume 0..%d and all sample values: %s\n", VOLUME_UNITY, ok ? "yes" : "NO");
+
+    // fill with audio like values, the reference loop is data dependent on some targets
+    srand(1);
+    for (uint32_t i = 0; i < 2 * NUM_SAMPLES; i++) {
+        _output[i] = (int16_t)(rand() % 20000 - 10000);
+    }
+
+    printf("avrcp_volume,volume,reference_ns_per_sample,volume_apply_ns_per_sample\n");
+    static const uint8_t avrcp_volumes[] = { 32, 64, 100, 126, 127 };
+    for (size_t v = 0; v < sizeof(avrcp_volumes) / sizeof(avrcp_volumes[0]); v++) {
+        int32_t volume = volume_from_avrcp(avrcp_volumes[v]);
+        double reference_ns = time_reference(iterations, volume);
+        double apply_ns = time_apply(volume_apply, iterations, volume);
+        printf("%d,%d,%.3f,%.3f\n", avrcp_volumes[v], (int)volume, reference_ns, apply_ns);
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,9 @@
+// The cortex-m33 path of volume.c built for the host, with the acle
+// intrinsics of acle/arm_acle.h, under its own names for volume_bench.c
+
+#define __ARM_FEATURE_DSP 1
+#define volume_apply volume_apply_dsp
+#define volume_apply_mono_to_stereo volume_apply_mono_to_stereo_dsp
+#define volume_from_avrcp volume_from_avrcp_dsp
+
+#include "volume.c"
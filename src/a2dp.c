@@ -3,23 +3,67 @@
 #include <btstack.h>
 #include <btstack_resample.h>
 #include <classic/a2dp_sink.h>
-#include "hardware/watchdog.h"
+#include "pico/time.h"
 
 // for connection led 
 #include <pico/cyw43_arch.h>
 
+#ifdef AAC_DECODER
+#include "aac_decoder.h"
+#endif
+#ifdef APTX_DECODER
+#include "aptx_decoder.h"
+#endif
 #include "avrcp.h"
+#include "bitrate.h"
+#include "boot_time.h"
+#include "budget.h"
+#include "delay.h"
+#include "drift.h"
+#include "jitter.h"
+#include "plc.h"
+#include "sbc_decoder.h"
+#include "sbc_header.h"
+#include "sbc_queue.h"
+#include "stats.h"
+#include "timing.h"
+#include "trace.h"
+#include "volume.h"
 
 // from btstack_audio_pico.c
 const btstack_audio_sink_t * btstack_audio_pico_sink_get_instance(void);
-
-
-#define OPTIMAL_FRAMES_MIN 60
-#define OPTIMAL_FRAMES_MAX 120
-#define ADDITIONAL_FRAMES  30
+#ifdef I2S_CLOCK_TRIM
+void btstack_audio_pico_sink_set_clock_trim(int32_t ppb);
+#endif
+
+
+#define MIN_TARGET_MS      30   // buffered ahead of i2s on a perfect link: one i2s buffer and one media packet
+#if defined(I2S_BUFFER_COUNT) && defined(I2S_SAMPLES_PER_BUFFER)
+#define SINK_PREFILL_FRAMES (I2S_BUFFER_COUNT*I2S_SAMPLES_PER_BUFFER)  // taken by the i2s sink on stream start, measured on every start
+#define SINK_BUFFER_FRAMES  I2S_SAMPLES_PER_BUFFER
+#else
+#define SINK_PREFILL_FRAMES (3*512)
+#define SINK_BUFFER_FRAMES  512
+#endif
 #define NUM_CHANNELS       2
 #define BYTES_PER_FRAME    (2*NUM_CHANNELS)
-#define MAX_SBC_FRAME_SIZE 120
+#ifndef SBC_MAX_BITPOOL
+#define SBC_MAX_BITPOOL    76   // dual channel at 44.1kHz is 552 kbit/s, the "sbc xq" of android sources
+#endif
+#define SBC_STANDARD_BITPOOL 53  // joint stereo high quality of the a2dp spec, the fallback
+#define MAX_SBC_FRAME_SIZE (4 + 8 + (16*2*SBC_MAX_BITPOOL+7)/8)  // dual channel, 16 blocks, 8 subbands: header, scale factors, samples
+#ifndef DECODE_BUDGET_PERCENT
+#define DECODE_BUDGET_PERCENT 60  // of the decoding core, above that fall back to the standard bitpool
+#endif
+#define MAX_SBC_FRAMES     150  // 435ms of 16 block, 8 subband frames at 44.1kHz
+#define MAX_SBC_FRAME_SAMPLES 128      // 16 blocks * 8 subbands
+#define MAX_PACKET_SAMPLES (15 * MAX_SBC_FRAME_SAMPLES)  // 4 bit frame count in the media payload header
+#define MAX_RESAMPLED_FRAMES (MAX_SBC_FRAME_SAMPLES+16)  // stretched by resampling
+#define MAX_CONCEALED_MS   500  // longer gaps are not bridged, playback just continues
+#define MAX_LATE_PACKETS   8    // behind the expected sequence number, further back the source restarted it
+#define APTX_VENDOR_ID     0x0000004F  // APT Ltd.
+#define APTX_CODEC_ID      0x0001
+#define APTX_CHUNK_SIZE    (MAX_SBC_FRAME_SAMPLES / APTX_DECODER_CODEWORD_SAMPLES * APTX_DECODER_CODEWORD_SIZE)  // queued like an sbc frame
 
 
 typedef struct {
@@ -35,6 +79,20 @@ typedef struct {
 } sbc_configuration_t;
 
 
+// of aptx or aac, always played as stereo: aptx is, the aac decoder duplicates mono
+typedef struct {
+    uint8_t  reconfigure;
+    uint16_t sampling_frequency;
+} codec_configuration_t;
+
+
+typedef enum {
+    CODEC_SBC,
+    CODEC_APTX,
+    CODEC_AAC,
+} codec_t;
+
+
 typedef enum {
     STREAM_STATE_CLOSED,
     STREAM_STATE_OPEN,
@@ -43,86 +101,252 @@ typedef enum {
 } stream_state_t;
 
 
-// all configurations with bitpool 2-53 are supported
-static const uint8_t _sbc_capabilities[] = {
+typedef enum {
+    RECONFIGURE_IDLE,
+    RECONFIGURE_SUSPENDING,  // waiting for the stream to be suspended
+    RECONFIGURE_PENDING,     // sent, waiting for the source to accept
+} reconfigure_state_t;
+
+
+// all configurations with bitpool 2-SBC_MAX_BITPOOL are supported, the max drops to
+// SBC_STANDARD_BITPOOL if decoding falls behind (btstack keeps a pointer, not a copy)
+static uint8_t _sbc_capabilities[] = {
     0xFF,  // (AVDTP_SBC_44100 << 4) | AVDTP_SBC_STEREO,
     0xFF,  // (AVDTP_SBC_BLOCK_LENGTH_16 << 4) | (AVDTP_SBC_SUBBANDS_8 << 2) | AVDTP_SBC_ALLOCATION_METHOD_LOUDNESS
-    2, 53
+    2, SBC_MAX_BITPOOL
+};
+#ifdef APTX_DECODER
+// classic aptx in stereo at 44.1 or 48kHz, a vendor codec: vendor and codec id, then frequencies and channel mode
+static const uint8_t _aptx_capabilities[] = {
+    0x4F, 0x00, 0x00, 0x00,  // APTX_VENDOR_ID, little endian
+    0x01, 0x00,              // APTX_CODEC_ID
+    0x32,                    // (AVDTP_SBC_44100 | AVDTP_SBC_48000) << 4 | AVDTP_SBC_STEREO, same bits as sbc
+};
+uint8_t _aptx_codec_configuration[sizeof(_aptx_capabilities)];  // btstack keeps a pointer
+uint8_t _aptx_seid = 0;
+codec_configuration_t _aptx_configuration = {0};
+aptx_decoder_t _aptx_decoder;  // decoder side only
+uint32_t _aptx_timestamp = 0;  // aptx packets have no rtp header, audio frames received instead
+#endif
+#ifdef AAC_DECODER
+// mpeg-2 or mpeg-4 aac lc at 44.1 or 48kHz, mono or stereo, up to 320 kbit/s with vbr, A2DP spec 4.5.2
+static const uint8_t _aac_capabilities[] = {
+    0xC0,              // object types mpeg-2 aac lc and mpeg-4 aac lc
+    0x01,              // 44100, the lowest of 8 frequency bits from 8000
+    0x8C,              // 48000, then 1 and 2 channels in bits 3 and 2
+    0x84, 0xE2, 0x00,  // vbr, then the bit rate 320000 in 23 bits, big endian
 };
+uint8_t _aac_codec_configuration[sizeof(_aac_capabilities)];  // btstack keeps a pointer
+uint8_t _aac_seid = 0;
+codec_configuration_t _aac_configuration = {0};
+aac_decoder_t _aac_decoder;  // decoder side only
+int16_t _aac_pcm[AAC_DECODER_FRAME_SAMPLES * NUM_CHANNELS];  // the access unit being played, decoder side only
+uint16_t _aac_pcm_position = 0;   // audio frames of it played
+uint16_t _aac_pending_frames = 0;  // audio frames of it still to play
+bool _aac_concealing = false;     // it could not be decoded, the pending frames are concealed
+#endif
+codec_t _codec = CODEC_SBC;  // of the started stream
+uint16_t _cid = 0;
+uint8_t _sbc_seid = 0;
 uint8_t _seid = 0;
+uint8_t _remote_seid = 0;
 stream_state_t _stream_state = STREAM_STATE_CLOSED;
+reconfigure_state_t _reconfigure_state = RECONFIGURE_IDLE;
+uint8_t _reconfigure_codec_info[4];
 sbc_configuration_t _sbc_configuration = {0};
+#if !defined(SBC_BTSTACK_DECODER) || defined(APTX_DECODER)
+int16_t _decoded_frame[MAX_SBC_FRAME_SAMPLES * NUM_CHANNELS];  // an sbc frame or a chunk of aptx codewords
+#endif
+#ifndef SBC_BTSTACK_DECODER
+sbc_decoder_t _sbc_decoder;  // decoder side only
+#else
 btstack_sbc_decoder_state_t _state = {0};
+#endif
 bool _media_initialized = false;
 bool _audio_stream_started = false;
-unsigned _sbc_frame_size = 0;
 btstack_resample_t _resample_instance = {0};
-btstack_ring_buffer_t _sbc_frame_ring_buffer = {0};
+sbc_queue_t _sbc_queue = {0};  // written on core 0, decoded on core 1 with DECODE_ON_CORE1 or in the refill irq with AUDIO_FIRST
 btstack_ring_buffer_t _decoded_audio_ring_buffer = {0};
-uint8_t _sbc_frame_storage[(OPTIMAL_FRAMES_MAX + ADDITIONAL_FRAMES) * MAX_SBC_FRAME_SIZE] = {0};
-uint8_t _decoded_audio_storage[(128+16) * BYTES_PER_FRAME] = {0};
+uint8_t _sbc_frame_storage[MAX_SBC_FRAMES * MAX_SBC_FRAME_SIZE] = {0};
+sbc_frame_t _sbc_frames[MAX_SBC_FRAMES] = {0};
+uint8_t _decoded_audio_storage[MAX_RESAMPLED_FRAMES * BYTES_PER_FRAME] = {0};
 int16_t * _request_buffer = 0;
 int _request_frames = 0;
-
-
-// process volume on decoded frames and send to i2s buffer or ringbuffer
-static void handle_pcm_data(int16_t * data, int num_audio_frames, int num_channels, int sample_rate, void * context) {
-    UNUSED(sample_rate);
-    UNUSED(context);
-    UNUSED(num_channels);   // must be stereo == 2
-
+uint32_t _min_target_frames = 0;
+volatile uint32_t _target_frames = 0;  // adapted to the arrival jitter on core 0
+uint32_t _sink_prefill_frames = SINK_PREFILL_FRAMES;
+volatile bool _rebuffering = false;
+jitter_t _jitter = {0};
+plc_t _plc = {0};
+bool _sequence_valid = false;
+uint16_t _expected_sequence = 0;
+uint32_t _expected_timestamp = 0;
+uint32_t _concealed_frames = 0;
+uint32_t _dropped_frames = 0;
+uint32_t _overflow_frames = 0;
+drift_t _drift = { .factor = 0x10000 };  // updated on the decoder side only
+volatile bool _drift_restart = false;  // set on core 0 when playback starts, done on the decoder side
+budget_t _budget = {0};  // time to decode and output, decoder side only
+volatile bool _over_budget = false;  // set on the decoder side, handled on core 0
+uint32_t _underrun_frames = 0;
+uint16_t _sampling_frequency = 0;  // of the started stream
+delay_t _delay = {0};  // reported to the source, core 0 only
+bitrate_t _bitrate = {0};  // max bitpool for the link, core 0 only
+uint32_t _lost_packets = 0;
+volatile uint32_t _decoded_frames = 0;  // waiting for i2s after the last request, set on the decoder side
+stats_t _stats = {0};  // bluetooth and decoder side count into their own parts
+
+
+// process volume on decoded frames in place and resample them straight into the i2s buffer,
+// only the partial tail of the last frame of a request goes through the ring buffer
+static void play_pcm_data(int16_t * data, int num_audio_frames, int num_channels) {
     const btstack_audio_sink_t * audio_sink = btstack_audio_sink_get_instance();
     if (!audio_sink){
         return;
     }
 
-    // adjust volume
-    int32_t volume = 1L + avrcp_get_volume();  // 1..128
-    int32_t samples = num_audio_frames * NUM_CHANNELS;
-    int32_t sample;
-    for( size_t i=0; i<samples; ++i ) {
-        sample = (volume * data[i]) >> 7;
-        if( sample < INT16_MIN) {
-            data[i] = INT16_MIN;
-        } 
-        else if( sample > INT16_MAX) {
-            data[i] = INT16_MAX;
-        } 
-        else {
-            data[i] = sample;
-        } 
-    }
-
-    // resample into request buffer - add some additional space for resampling
-    int16_t  output_buffer[(128+16) * NUM_CHANNELS]; // 16 * 8 * 2
+#ifndef SBC_BTSTACK_DECODER
+    int32_t volume = VOLUME_UNITY;  // the decoder has applied it already, also to what plc repeats
+#else
+    int32_t volume = volume_from_avrcp(avrcp_get_volume());
+#if defined(APTX_DECODER) || defined(AAC_DECODER)
+    if (_codec != CODEC_SBC) {
+        volume = VOLUME_UNITY;  // applied by the decoder, like the in-tree sbc decoder does
+    }
+#endif
+#endif
+
+    // resample directly into request buffer if even a stretched frame fits, else into tail buffer
+    int16_t  tail_buffer[MAX_RESAMPLED_FRAMES * NUM_CHANNELS];
+    bool     direct = _request_frames >= MAX_RESAMPLED_FRAMES;
+    int16_t *output_buffer = direct ? _request_buffer : tail_buffer;
+#ifdef I2S_CLOCK_TRIM
+    // the i2s clock follows the source: volume, saturation and stereo expansion in a single pass
+    uint32_t resampled_frames = num_audio_frames;
+    TIMING_BEGIN(TIMING_VOLUME);
+    if (num_channels == 1) {
+        volume_apply_mono_to_stereo(output_buffer, data, num_audio_frames, volume);
+    } else {
+        volume_apply(output_buffer, data, num_audio_frames * num_channels, volume);
+    }
+    TIMING_END(TIMING_VOLUME);
+#else
+    TIMING_BEGIN(TIMING_VOLUME);
+    volume_apply(data, data, num_audio_frames * num_channels, volume);
+    TIMING_END(TIMING_VOLUME);
+    TIMING_BEGIN(TIMING_RESAMPLE);
     uint32_t resampled_frames = btstack_resample_block(&_resample_instance, data, num_audio_frames, output_buffer);
 
-    // store data in btstack_audio buffer first
-    int frames_to_copy = btstack_min(resampled_frames, _request_frames);
-    memcpy(_request_buffer, output_buffer, frames_to_copy * BYTES_PER_FRAME);
+    // i2s is always stereo: expand mono in place, back to front
+    if (num_channels == 1) {
+        for (int i = resampled_frames - 1; i >= 0; i--) {
+            output_buffer[2*i+1] = output_buffer[i];
+            output_buffer[2*i  ] = output_buffer[i];
+        }
+    }
+    TIMING_END(TIMING_RESAMPLE);
+#endif
+
+    if (direct) {
+        _request_frames -= resampled_frames;
+        _request_buffer += resampled_frames * NUM_CHANNELS;
+        return;
+    }
+
+    // store tail data in btstack_audio buffer first
+    int frames_to_copy = btstack_min(resampled_frames, (uint32_t)_request_frames);
+    memcpy(_request_buffer, tail_buffer, frames_to_copy * BYTES_PER_FRAME);
     _request_frames -= frames_to_copy;
     _request_buffer += frames_to_copy * NUM_CHANNELS;
 
     // and rest in ring buffer
     int frames_to_store = resampled_frames - frames_to_copy;
     if (frames_to_store) {
-        int status = btstack_ring_buffer_write(&_decoded_audio_ring_buffer, (uint8_t *)&output_buffer[frames_to_copy * NUM_CHANNELS], frames_to_store * BYTES_PER_FRAME);
-        // if (status){
-        //     printf("Error storing samples in PCM ring buffer!!!\n");
-        // }
+        int status = btstack_ring_buffer_write(&_decoded_audio_ring_buffer, (uint8_t *)&tail_buffer[frames_to_copy * NUM_CHANNELS], frames_to_store * BYTES_PER_FRAME);
+        if (status){
+            _overflow_frames += frames_to_store;
+            stats_overflow(&_stats, frames_to_store);
+        }
+    }
+}
+
+
+// decoded audio, remembered for concealment of later losses
+static void handle_pcm_data(int16_t * data, int num_audio_frames, int num_channels, int sample_rate, void * context) {
+    UNUSED(sample_rate);
+    UNUSED(context);
+
+    plc_good_frames(&_plc, data, num_audio_frames, num_channels);
+    play_pcm_data(data, num_audio_frames, num_channels);
+}
+
+
+// lost or corrupt audio, synthesized so everything after it stays in time
+static void conceal_frames(uint16_t num_audio_frames) {
+    int16_t concealed[MAX_SBC_FRAME_SAMPLES * NUM_CHANNELS];
+    plc_conceal(&_plc, concealed, num_audio_frames);
+    play_pcm_data(concealed, num_audio_frames, plc_num_channels(&_plc));
+    _concealed_frames += num_audio_frames;
+}
+
+
+#ifdef AAC_DECODER
+// the next piece of the decoded access unit, pieces the size of an sbc frame
+// fit the buffers of resampling and concealment
+static void play_aac_pending(void) {
+    uint16_t frames = btstack_min(_aac_pending_frames, MAX_SBC_FRAME_SAMPLES);
+    if (_aac_concealing) {
+        conceal_frames(frames);
+    } else {
+        handle_pcm_data(&_aac_pcm[_aac_pcm_position * NUM_CHANNELS], frames, NUM_CHANNELS, 0, NULL);
     }
+    _aac_pcm_position += frames;
+    _aac_pending_frames -= frames;
 }
+#endif
 
 
 /// provide pcm frames to i2s sink
 static void playback_handler(int16_t * buffer, uint16_t num_audio_frames) {
 
-    // called from lower-layer but guaranteed to be on main thread
-    if (_sbc_frame_size == 0){
-        memset(buffer, 0, num_audio_frames * BYTES_PER_FRAME);
-        return;
+    // called from lower-layer, either on main thread, in the refill irq (AUDIO_FIRST) or on core 1
+
+    uint32_t buffered_frames = sbc_queue_samples(&_sbc_queue) + btstack_ring_buffer_bytes_available(&_decoded_audio_ring_buffer) / BYTES_PER_FRAME;
+#ifdef AAC_DECODER
+    buffered_frames += _aac_pending_frames;
+#endif
+    uint32_t target_frames = _target_frames;
+
+    // after an underrun, play silence until the buffer is back at its target
+    if (_rebuffering) {
+        if (buffered_frames < target_frames) {
+            memset(buffer, 0, num_audio_frames * BYTES_PER_FRAME);
+            _underrun_frames += num_audio_frames;
+            stats_underrun(&_stats, num_audio_frames, false);
+            return;
+        }
+        _rebuffering = false;
+        trace_audio(TRACE_REBUFFERED, 0, buffered_frames > UINT16_MAX ? UINT16_MAX : buffered_frames);
+        drift_restart(&_drift);
+    }
+
+    // playback started: the fill left after the sink took its own buffers is the reference to start from,
+    // the controller moves it to the target
+    if (_drift_restart) {
+        _drift_restart = false;
+        drift_restart(&_drift);
     }
 
+    // steer resampling (or the i2s clock) to hold the target fill, measured before this request is served
+    drift_set_target(&_drift, target_frames);
+#ifdef I2S_CLOCK_TRIM
+    drift_update(&_drift, buffered_frames, num_audio_frames);
+    btstack_audio_pico_sink_set_clock_trim(drift_get_correction_ppb(&_drift));
+#else
+    btstack_resample_set_factor(&_resample_instance, drift_update(&_drift, buffered_frames, num_audio_frames));
+#endif
+    stats_refill(&_stats, sbc_queue_frames(&_sbc_queue), drift_get_correction_ppb(&_drift) / 1000, num_audio_frames);
+
     // first fill from resampled audio
     uint32_t bytes_read;
     btstack_ring_buffer_read(&_decoded_audio_ring_buffer, (uint8_t *) buffer, num_audio_frames * BYTES_PER_FRAME, &bytes_read);
@@ -132,32 +356,178 @@ static void playback_handler(int16_t * buffer, uint16_t num_audio_frames) {
     // then start decoding sbc frames using request_* globals
     _request_buffer = buffer;
     _request_frames = num_audio_frames;
-    while (_request_frames && btstack_ring_buffer_bytes_available(&_sbc_frame_ring_buffer) >= _sbc_frame_size) {
-        // decode frame
-        uint8_t sbc_frame[MAX_SBC_FRAME_SIZE];
-        btstack_ring_buffer_read(&_sbc_frame_ring_buffer, sbc_frame, _sbc_frame_size, &bytes_read);
-        btstack_sbc_decoder_process_data(&_state, 0, sbc_frame, _sbc_frame_size);
+    const sbc_frame_t *first;
+    while (_request_frames) {
+#ifdef AAC_DECODER
+        // the rest of the last access unit comes first
+        if (_aac_pending_frames) {
+            play_aac_pending();
+            continue;
+        }
+#endif
+        if (!(first = sbc_queue_peek(&_sbc_queue, 0))) break;
+
+        if (first->length == 0) {
+            conceal_frames(first->samples);
+            sbc_queue_consume(&_sbc_queue, 1);
+            continue;
+        }
+
+#ifdef APTX_DECODER
+        if (_codec == CODEC_APTX) {
+            // one chunk at a time, the volume goes into rounding the 24 bit output
+            uint32_t start_us = time_us_32();
+            aptx_decoder_set_gain(&_aptx_decoder, volume_from_avrcp(avrcp_get_volume()));
+            TIMING_BEGIN(TIMING_DECODE);
+            uint32_t frames = aptx_decoder_decode(&_aptx_decoder, sbc_queue_frame_data(&_sbc_queue, first), first->length, _decoded_frame);
+            TIMING_END(TIMING_DECODE);
+            handle_pcm_data(_decoded_frame, frames, NUM_CHANNELS, 0, NULL);
+            budget_update(&_budget, time_us_32() - start_us, frames);  // load only, aptx has no cheaper setting
+            sbc_queue_consume(&_sbc_queue, 1);
+            continue;
+        }
+#endif
+
+#ifdef AAC_DECODER
+        if (_codec == CODEC_AAC) {
+            // a whole access unit at once, played in pieces, the volume is folded into its dequantization
+            uint32_t start_us = time_us_32();
+            aac_decoder_set_gain(&_aac_decoder, volume_from_avrcp(avrcp_get_volume()));
+            TIMING_BEGIN(TIMING_DECODE);
+            _aac_pending_frames = aac_decoder_decode_latm(&_aac_decoder, sbc_queue_frame_data(&_sbc_queue, first), first->length, _aac_pcm);
+            TIMING_END(TIMING_DECODE);
+            _aac_pcm_position = 0;
+            _aac_concealing = !_aac_pending_frames;
+            if (_aac_concealing) {
+                _aac_pending_frames = first->samples;
+            } else {
+                budget_update(&_budget, time_us_32() - start_us, _aac_pending_frames);  // load only, like aptx
+            }
+            sbc_queue_consume(&_sbc_queue, 1);
+            continue;
+        }
+#endif
+
+#ifndef SBC_BTSTACK_DECODER
+        // one frame at a time, with the volume of the moment
+        sbc_header_t header;
+        uint32_t start_us = time_us_32();
+        sbc_decoder_set_gain(&_sbc_decoder, volume_from_avrcp(avrcp_get_volume()));
+        TIMING_BEGIN(TIMING_DECODE);
+        bool decoded = sbc_decoder_decode(&_sbc_decoder, sbc_queue_frame_data(&_sbc_queue, first), first->length, _decoded_frame, &header);
+        TIMING_END(TIMING_DECODE);
+        if (decoded) {
+            handle_pcm_data(_decoded_frame, header.num_samples, header.num_channels, header.sampling_frequency, NULL);
+            if (budget_update(&_budget, time_us_32() - start_us, header.num_samples)) {
+                _over_budget = true;
+                trace_audio(TRACE_OVER_BUDGET, 0, 0);
+            }
+        } else {
+            conceal_frames(first->samples);
+        }
+        sbc_queue_consume(&_sbc_queue, 1);
+#else
+        // decode in place, as many adjacent frames per call as surely fit into the request,
+        // so only the last frame can spill into the ring buffer
+        uint32_t num_frames = 1;
+        uint32_t length = first->length;
+        int samples = first->samples;
+        const sbc_frame_t *next;
+        while ((next = sbc_queue_peek(&_sbc_queue, num_frames)) &&
+               next->length &&
+               next->offset == first->offset + length &&
+               samples + next->samples <= _request_frames) {
+            length += next->length;
+            samples += next->samples;
+            num_frames++;
+        }
+        uint32_t start_us = time_us_32();
+        TIMING_BEGIN(TIMING_DECODE);
+        btstack_sbc_decoder_process_data(&_state, 0, sbc_queue_frame_data(&_sbc_queue, first), length);
+        TIMING_END(TIMING_DECODE);
+        if (budget_update(&_budget, time_us_32() - start_us, samples)) {
+            _over_budget = true;
+            trace_audio(TRACE_OVER_BUDGET, 0, 0);
+        }
+        sbc_queue_consume(&_sbc_queue, num_frames);
+#endif
+    }
+
+    // sbc frames ran out: play silence instead of stale buffer content
+    if (_request_frames) {
+        memset(_request_buffer, 0, _request_frames * BYTES_PER_FRAME);
+        _underrun_frames += _request_frames;
+        stats_underrun(&_stats, _request_frames, true);
+        _request_frames = 0;
+        _rebuffering = true;
+        trace_audio(TRACE_UNDERRUN, 0, target_frames > UINT16_MAX ? UINT16_MAX : target_frames);
     }
+
+    _decoded_frames = btstack_ring_buffer_bytes_available(&_decoded_audio_ring_buffer) / BYTES_PER_FRAME;
+#ifdef AAC_DECODER
+    _decoded_frames += _aac_pending_frames;
+#endif
 }
 
 
-static void media_processing_init(sbc_configuration_t * configuration) {
+// tell the source how long audio arriving now takes to be heard, source_frames is what is
+// buffered ahead of it. The i2s buffers are all full right after a refill and one less just
+// before the next, so they hold half a buffer less than they took on start on average.
+// Sources that did not configure delay reporting refuse the report, that is fine
+static void update_delay(uint32_t source_frames) {
+    uint32_t sink_frames = _sink_prefill_frames > SINK_BUFFER_FRAMES / 2 ? _sink_prefill_frames - SINK_BUFFER_FRAMES / 2 : 0;
+    if (delay_update(&_delay, btstack_run_loop_get_time_ms(), source_frames, drift_get_factor(&_drift), sink_frames)) {
+        a2dp_sink_delay_report(_cid, _seid, delay_get_report_100us(&_delay));
+    }
+}
+
+
+static void media_processing_init(uint16_t sampling_frequency, uint8_t num_channels) {
     if (_media_initialized) return;
 
+#ifdef AAC_DECODER
+    aac_decoder_init(&_aac_decoder);
+    _aac_pending_frames = 0;
+#endif
+#ifdef APTX_DECODER
+    aptx_decoder_init(&_aptx_decoder);
+    _aptx_timestamp = 0;
+#endif
+#ifndef SBC_BTSTACK_DECODER
+    sbc_decoder_init(&_sbc_decoder);
+#else
     btstack_sbc_decoder_init(&_state, SBC_MODE_STANDARD, handle_pcm_data, NULL);
+#endif
 
-    btstack_ring_buffer_init(&_sbc_frame_ring_buffer, _sbc_frame_storage, sizeof(_sbc_frame_storage));
+    sbc_queue_init(&_sbc_queue, _sbc_frame_storage, sizeof(_sbc_frame_storage), _sbc_frames, MAX_SBC_FRAMES);
     btstack_ring_buffer_init(&_decoded_audio_ring_buffer, _decoded_audio_storage, sizeof(_decoded_audio_storage));
-    btstack_resample_init(&_resample_instance, configuration->num_channels);
+    btstack_resample_init(&_resample_instance, num_channels);
+    _sampling_frequency = sampling_frequency;
+    stats_set_sample_rate(&_stats, sampling_frequency);
+    _min_target_frames = sampling_frequency * MIN_TARGET_MS / 1000;
+    _target_frames = _min_target_frames;
+    _rebuffering = false;
+    jitter_init(&_jitter, sampling_frequency);
+    jitter_set_untimed(&_jitter, _codec == CODEC_APTX);
+    plc_init(&_plc);
+    _sequence_valid = false;
+    drift_init(&_drift, sampling_frequency, _target_frames);
+    budget_init(&_budget, sampling_frequency, DECODE_BUDGET_PERCENT);
+    _over_budget = false;
+    _decoded_frames = 0;
 
     // setup audio playback
     const btstack_audio_sink_t * audio = btstack_audio_sink_get_instance();
     if (audio){
-        audio->init(NUM_CHANNELS, configuration->sampling_frequency, &playback_handler);
+        audio->init(NUM_CHANNELS, sampling_frequency, &playback_handler);
     }
 
     _audio_stream_started = false;
     _media_initialized = true;
+
+    // until there are measurements: what playback starts with
+    delay_init(&_delay, sampling_frequency);
+    update_delay(_target_frames);
     return;
 }
 
@@ -168,12 +538,53 @@ static void media_processing_start(void) {
     // setup audio playback
     const btstack_audio_sink_t * audio = btstack_audio_sink_get_instance();
     if (audio){
+        uint32_t buffered_frames = sbc_queue_samples(&_sbc_queue);
         audio->start_stream();
+
+        // remember how much the sink took for its own buffers, to prebuffer that on top of the target next time
+        uint32_t remaining_frames = sbc_queue_samples(&_sbc_queue) + btstack_ring_buffer_bytes_available(&_decoded_audio_ring_buffer) / BYTES_PER_FRAME;
+#ifdef AAC_DECODER
+        remaining_frames += _aac_pending_frames;
+#endif
+        _sink_prefill_frames = buffered_frames > remaining_frames ? buffered_frames - remaining_frames : 0;
+
+        // the decoder side runs already, it restarts the controller itself
+        _drift_restart = true;
     }
+    boot_time_mark(BOOT_AUDIO);
+    delay_restart(&_delay);  // the first packet that finds playback running measures it
+    bitrate_restart(&_bitrate);
     _audio_stream_started = true;
 }
 
 
+// discard pending data, the decoder side is stopped
+static void media_processing_discard(void) {
+    btstack_ring_buffer_reset(&_decoded_audio_ring_buffer);
+    sbc_queue_reset(&_sbc_queue);
+#ifndef SBC_BTSTACK_DECODER
+    sbc_decoder_reset(&_sbc_decoder);
+#endif
+#ifdef APTX_DECODER
+    aptx_decoder_reset(&_aptx_decoder);
+#endif
+#ifdef AAC_DECODER
+    aac_decoder_reset(&_aac_decoder);
+    _aac_pending_frames = 0;
+#endif
+    drift_restart(&_drift);
+    budget_reset(&_budget);
+    _decoded_frames = 0;
+
+    // arrival timing starts over on resume
+    jitter_reset(&_jitter);
+    _target_frames = _min_target_frames;
+    _rebuffering = false;
+    plc_init(&_plc);
+    _sequence_valid = false;
+}
+
+
 static void media_processing_pause(void) {
     if (!_media_initialized) return;
 
@@ -184,18 +595,16 @@ static void media_processing_pause(void) {
     if (audio) {
         audio->stop_stream();
     }
-    // discard pending data
-    btstack_ring_buffer_reset(&_decoded_audio_ring_buffer);
-    btstack_ring_buffer_reset(&_sbc_frame_ring_buffer);
+    media_processing_discard();
 }
 
 
+// leaves nothing behind: the next stream, of this source or another one, sets up from scratch
 static void media_processing_close(void) {
     if (!_media_initialized) return;
 
     _media_initialized = false;
     _audio_stream_started = false;
-    _sbc_frame_size = 0;
 
     // stop audio playback
     const btstack_audio_sink_t * audio = btstack_audio_sink_get_instance();
@@ -203,17 +612,122 @@ static void media_processing_close(void) {
         // printf("close stream\n");
         audio->close();
     }
+    media_processing_discard();
+}
+
+
+// sbc codec information element of a configuration, A2DP spec 4.3.2
+static void store_sbc_configuration(uint8_t *codec_info, const sbc_configuration_t *configuration, uint8_t max_bitpool) {
+    static const uint8_t channel_modes[] = {
+        AVDTP_SBC_MONO, AVDTP_SBC_DUAL_CHANNEL, AVDTP_SBC_STEREO, AVDTP_SBC_JOINT_STEREO };
+    uint8_t frequency;
+    switch (configuration->sampling_frequency) {
+        case 16000: frequency = AVDTP_SBC_16000; break;
+        case 32000: frequency = AVDTP_SBC_32000; break;
+        case 48000: frequency = AVDTP_SBC_48000; break;
+        default:    frequency = AVDTP_SBC_44100; break;
+    }
+    codec_info[0] = (frequency << 4) | channel_modes[configuration->channel_mode];
+    codec_info[1] = ((AVDTP_SBC_BLOCK_LENGTH_4 >> (configuration->block_length / 4 - 1)) << 4) |
+                    ((configuration->subbands == 8 ? AVDTP_SBC_SUBBANDS_8 : AVDTP_SBC_SUBBANDS_4) << 2) |
+                    (configuration->allocation_method == SBC_SNR ? AVDTP_SBC_ALLOCATION_METHOD_SNR : AVDTP_SBC_ALLOCATION_METHOD_LOUDNESS);
+    codec_info[2] = btstack_min(configuration->min_bitpool_value, max_bitpool);
+    codec_info[3] = max_bitpool;
 }
 
 
+// ask the source to stay at or below max_bitpool. Only a suspended stream can be
+// reconfigured, it goes on when the source confirms the suspend and the reconfiguration.
+// Returns false if nothing was sent, a reconfiguration is under way or the stream is not playing
+static bool request_max_bitpool(uint8_t max_bitpool) {
+    if (_reconfigure_state != RECONFIGURE_IDLE || _stream_state != STREAM_STATE_PLAYING) return false;
+
+    store_sbc_configuration(_reconfigure_codec_info, &_sbc_configuration, max_bitpool);
+    if (avdtp_sink_suspend(_cid, _seid) != ERROR_CODE_SUCCESS) return false;
+
+    trace_bt(TRACE_BITPOOL, max_bitpool, 0);
+    _reconfigure_state = RECONFIGURE_SUSPENDING;
+    return true;
+}
+
+
+static void send_reconfigure(void) {
+    avdtp_capabilities_t configuration;
+    memset(&configuration, 0, sizeof(configuration));
+    configuration.media_codec.media_type = AVDTP_AUDIO;
+    configuration.media_codec.media_codec_type = AVDTP_CODEC_SBC;
+    configuration.media_codec.media_codec_information_len = sizeof(_reconfigure_codec_info);
+    configuration.media_codec.media_codec_information = _reconfigure_codec_info;
+
+    if (avdtp_sink_reconfigure(_cid, _seid, _remote_seid, 1 << AVDTP_MEDIA_CODEC, configuration) == ERROR_CODE_SUCCESS) {
+        _reconfigure_state = RECONFIGURE_PENDING;
+    } else {
+        _reconfigure_state = RECONFIGURE_IDLE;
+        avdtp_sink_start_stream(_cid, _seid);
+    }
+}
+
+
+// the source accepted or rejected the reconfiguration, play on either way
+static void reconfigure_done(bool accepted) {
+    if (accepted) {
+        _sbc_configuration.min_bitpool_value = _reconfigure_codec_info[2];
+        _sbc_configuration.max_bitpool_value = _reconfigure_codec_info[3];
+    }
+    _reconfigure_state = RECONFIGURE_IDLE;
+    avdtp_sink_start_stream(_cid, _seid);
+}
+
+
+// decoding did not keep up: standard bitpool for this stream and all later ones
+static void fall_back_to_standard_bitpool(void) {
+    _sbc_capabilities[3] = SBC_STANDARD_BITPOOL;
+    bitrate_set_ceiling(&_bitrate, SBC_STANDARD_BITPOOL);
+    if (_sbc_configuration.max_bitpool_value > SBC_STANDARD_BITPOOL) {
+        request_max_bitpool(SBC_STANDARD_BITPOOL);
+    }
+}
+
+
+#if defined(APTX_DECODER) || defined(AAC_DECODER)
+static codec_t codec_of_seid(uint8_t seid) {
+#ifdef APTX_DECODER
+    if (seid == _aptx_seid) return CODEC_APTX;
+#endif
+#ifdef AAC_DECODER
+    if (seid == _aac_seid) return CODEC_AAC;
+#endif
+    return CODEC_SBC;
+}
+#endif
+
+
 static void event_handler(uint8_t event, uint8_t *packet) {
     uint8_t status;
     uint8_t allocation_method;
 
     switch (event){
-        // case A2DP_SUBEVENT_SIGNALING_MEDIA_CODEC_OTHER_CONFIGURATION:
-        //     printf("A2DP  Sink      : Received non SBC codec - not implemented\n");
-        //     break;
+#ifdef APTX_DECODER
+        case A2DP_SUBEVENT_SIGNALING_MEDIA_CODEC_OTHER_CONFIGURATION:{
+            // vendor codec information element: vendor id, codec id, then the codec specific part
+            const uint8_t *info = a2dp_subevent_signaling_media_codec_other_configuration_get_media_codec_information(packet);
+            if (a2dp_subevent_signaling_media_codec_other_configuration_get_media_codec_information_len(packet) < sizeof(_aptx_capabilities) ||
+                little_endian_read_32(info, 0) != APTX_VENDOR_ID || little_endian_read_16(info, 4) != APTX_CODEC_ID) {
+                break;
+            }
+            _aptx_configuration.reconfigure = a2dp_subevent_signaling_media_codec_other_configuration_get_reconfigure(packet);
+            _aptx_configuration.sampling_frequency = (info[6] >> 4) & AVDTP_SBC_48000 ? 48000 : 44100;
+            break;
+        }
+#endif
+
+#ifdef AAC_DECODER
+        case A2DP_SUBEVENT_SIGNALING_MEDIA_CODEC_MPEG_AAC_CONFIGURATION:
+            // the rest comes with every stream in its LATM StreamMuxConfig
+            _aac_configuration.reconfigure = a2dp_subevent_signaling_media_codec_mpeg_aac_configuration_get_reconfigure(packet);
+            _aac_configuration.sampling_frequency = a2dp_subevent_signaling_media_codec_mpeg_aac_configuration_get_sampling_frequency(packet);
+            break;
+#endif
 
         case A2DP_SUBEVENT_SIGNALING_MEDIA_CODEC_SBC_CONFIGURATION:{
             // printf("A2DP  Sink      : Received SBC codec configuration\n");
@@ -255,13 +769,16 @@ static void event_handler(uint8_t event, uint8_t *packet) {
             status = a2dp_subevent_stream_established_get_status(packet);
             if (status != ERROR_CODE_SUCCESS){
                 // printf("A2DP  Sink      : Streaming connection failed, status 0x%02x\n", status);
+                trace_bt(TRACE_STREAM_FAILED, status, 0);
                 break;
             }
 
             // a2dp_subevent_stream_established_get_bd_addr(packet, _addr);
-            // _cid = a2dp_subevent_stream_established_get_a2dp_cid(packet);
+            _cid = a2dp_subevent_stream_established_get_a2dp_cid(packet);
             _seid = a2dp_subevent_stream_established_get_local_seid(packet);
+            _remote_seid = a2dp_subevent_stream_established_get_remote_seid(packet);
             _stream_state = STREAM_STATE_OPEN;
+            boot_time_mark(BOOT_STREAM);
             cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, true);
             gpio_put(CONN_PIN, 1);
 
@@ -272,11 +789,36 @@ static void event_handler(uint8_t event, uint8_t *packet) {
         case A2DP_SUBEVENT_STREAM_STARTED:
             // printf("A2DP  Sink      : Stream started\n");
             _stream_state = STREAM_STATE_PLAYING;
+            _seid = a2dp_subevent_stream_started_get_local_seid(packet);  // delay reports go to the endpoint that streams
+#if defined(APTX_DECODER) || defined(AAC_DECODER)
+        {
+            // the source streams the codec of the endpoint it configured, a switch starts over
+            codec_t codec = codec_of_seid(_seid);
+            if (codec != _codec) {
+                media_processing_close();
+                _codec = codec;
+            }
+            const codec_configuration_t *configuration = NULL;
+#ifdef APTX_DECODER
+            if (_codec == CODEC_APTX) configuration = &_aptx_configuration;
+#endif
+#ifdef AAC_DECODER
+            if (_codec == CODEC_AAC) configuration = &_aac_configuration;
+#endif
+            if (configuration) {
+                if (configuration->reconfigure){
+                    media_processing_close();
+                }
+                media_processing_init(configuration->sampling_frequency, NUM_CHANNELS);
+                break;
+            }
+        }
+#endif
             if (_sbc_configuration.reconfigure){
                 media_processing_close();
             }
             // prepare media processing
-            media_processing_init(&_sbc_configuration);
+            media_processing_init(_sbc_configuration.sampling_frequency, _sbc_configuration.num_channels);
             // audio stream is started when buffer reaches minimal level
             break;
         
@@ -284,15 +826,33 @@ static void event_handler(uint8_t event, uint8_t *packet) {
             // printf("A2DP  Sink      : Stream paused\n");
             _stream_state = STREAM_STATE_PAUSED;
             media_processing_pause();
+            if (_reconfigure_state == RECONFIGURE_SUSPENDING) {
+                send_reconfigure();
+            }
+            break;
+
+        case A2DP_SUBEVENT_COMMAND_ACCEPTED:
+            if (_reconfigure_state == RECONFIGURE_PENDING &&
+                a2dp_subevent_command_accepted_get_signal_identifier(packet) == AVDTP_SI_RECONFIGURE) {
+                reconfigure_done(true);
+            }
+            break;
+
+        case A2DP_SUBEVENT_COMMAND_REJECTED:
+            if (_reconfigure_state == RECONFIGURE_PENDING &&
+                a2dp_subevent_command_rejected_get_signal_identifier(packet) == AVDTP_SI_RECONFIGURE) {
+                reconfigure_done(false);
+            }
             break;
         
         case A2DP_SUBEVENT_STREAM_RELEASED:
             // printf("A2DP  Sink      : Stream released\n");
             _stream_state = STREAM_STATE_CLOSED;
+            _reconfigure_state = RECONFIGURE_IDLE;
+            bitrate_reset(&_bitrate);
             media_processing_close();
             cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, false);
             gpio_put(CONN_PIN, 0);
-            watchdog_enable(100, true);  // reboot in 0.1s, since reconnect is buggy
             break;
         
         case A2DP_SUBEVENT_SIGNALING_CONNECTION_RELEASED:
@@ -317,7 +877,10 @@ static void data_handler(uint8_t packet_type, uint16_t channel, uint8_t *packet,
     if (packet_type != HCI_EVENT_PACKET) return;
     if (hci_event_packet_get_type(packet) != HCI_EVENT_A2DP_META) return;
 
+    TIMING_BEGIN(TIMING_EVENT);
+    trace_bt(TRACE_A2DP, packet[2], little_endian_read_16(packet, 3));  // all a2dp subevents start with the cid
     event_handler(packet[2], packet);
+    TIMING_END(TIMING_EVENT);
 }
 
 
@@ -372,9 +935,122 @@ int read_sbc_header(uint8_t * packet, int size, int * offset, avdtp_sbc_codec_he
 }
 
 
-static void media_handler(uint8_t seid, uint8_t *packet, uint16_t size) {
-    UNUSED(seid);
+// placeholders for the audio of lost packets, concealed when their turn comes
+static void queue_lost_audio(uint32_t lost_samples, uint16_t frame_samples) {
+    if (lost_samples > _sampling_frequency * MAX_CONCEALED_MS / 1000u) return;
+
+    uint32_t timestamp = _expected_timestamp;
+    while (lost_samples) {
+        uint16_t samples = btstack_min(lost_samples, frame_samples);
+        if (!sbc_queue_write(&_sbc_queue, NULL, 0, samples, timestamp)) {
+            _dropped_frames++;
+        }
+        timestamp += samples;
+        lost_samples -= samples;
+    }
+}
+
+
+// received audio into the frame store, counted as dropped if there is no room
+static void queue_frame(const uint8_t *data, uint16_t length, uint16_t samples, uint32_t timestamp) {
+    bool stored = sbc_queue_write(&_sbc_queue, data, length, samples, timestamp);
+    stats_received(&_stats, stored, sbc_queue_frames(&_sbc_queue));
+    if (!stored) {
+        _dropped_frames++;
+    }
+}
+
+
+// lost packets: queue their audio for concealment, so everything after stays in time.
+// false for a late or duplicate packet, its place was concealed already
+static bool track_sequence(const avdtp_media_packet_header_t *media_header, uint32_t packet_samples, uint16_t frame_samples) {
+    if (_sequence_valid) {
+        int16_t missing_packets = (int16_t)(media_header->sequence_number - _expected_sequence);
+        uint32_t lost_samples = media_header->timestamp - _expected_timestamp;
+        // a little behind is late or sent twice
+        if (missing_packets < 0 && missing_packets >= -MAX_LATE_PACKETS) return false;
+
+        if (missing_packets > 0 && lost_samples >= missing_packets * frame_samples &&
+            lost_samples <= missing_packets * MAX_PACKET_SAMPLES) {
+            _lost_packets += missing_packets;
+            // the lost audio only shows up now, as late as this packet: the buffer has to cover that too
+            jitter_update(&_jitter, btstack_run_loop_get_time_ms(), _expected_timestamp);
+            queue_lost_audio(lost_samples, frame_samples);
+        } else if (missing_packets) {
+            // further back, or ahead by more than the timestamps moved on: the source started its
+            // sequence over or jumped. Follow it from this packet, the transit times start over too
+            jitter_reset(&_jitter);
+        }
+    }
+    _sequence_valid = true;
+    _expected_sequence = media_header->sequence_number + 1;
+    _expected_timestamp = media_header->timestamp + packet_samples;
+    return true;
+}
+
+
+// buffer as much as the arrival jitter needs, with some margin, and start playing once that is there.
+// While playing, what was buffered ahead of the packet of packet_samples is its delay
+static void update_buffering(uint32_t timestamp, uint32_t packet_samples) {
+    if (_audio_stream_started) {
+        uint32_t queued = sbc_queue_samples(&_sbc_queue);
+        update_delay((queued > packet_samples ? queued - packet_samples : 0) + _decoded_frames);
+    }
+
+    jitter_update(&_jitter, btstack_run_loop_get_time_ms(), timestamp);
+    uint32_t spread = jitter_get_spread(&_jitter);
+    _target_frames = _min_target_frames + spread + spread / 4;
+
+    // start stream as soon as the target is buffered, plus what the sink takes for itself
+    if (!_audio_stream_started && sbc_queue_samples(&_sbc_queue) >= _target_frames + _sink_prefill_frames){
+        media_processing_start();
+    }
+}
+
+
+#ifdef APTX_DECODER
+// aptx packets are bare codewords, without rtp header: lost ones cannot be told,
+// arrival jitter is measured against the audio received instead of timestamps
+static void aptx_media_handler(uint8_t *packet, uint16_t size) {
+    uint32_t timestamp = _aptx_timestamp;
+    uint16_t length = size - size % APTX_DECODER_CODEWORD_SIZE;
+
+    for (uint16_t pos = 0; pos < length; pos += APTX_CHUNK_SIZE) {
+        uint16_t chunk = btstack_min(APTX_CHUNK_SIZE, length - pos);
+        uint16_t samples = chunk / APTX_DECODER_CODEWORD_SIZE * APTX_DECODER_CODEWORD_SAMPLES;
+        queue_frame(packet + pos, chunk, samples, _aptx_timestamp);
+        _aptx_timestamp += samples;
+    }
+
+    update_buffering(timestamp, _aptx_timestamp - timestamp);
+}
+#endif
 
+
+#ifdef AAC_DECODER
+// an aac packet is the rtp header and one LATM AudioMuxElement with one access unit,
+// sources keep those below the mtu. It is queued whole, the decoder side plays it in pieces
+static void aac_media_handler(uint8_t *packet, uint16_t size) {
+    int pos = 0;
+
+    avdtp_media_packet_header_t media_header;
+    if (!read_media_header(packet, size, &pos, &media_header)) return;
+    if (pos == size) return;
+
+    // lost ones are concealed in pieces of an sbc frame, what the concealment buffers hold
+    if (!track_sequence(&media_header, AAC_DECODER_FRAME_SAMPLES, MAX_SBC_FRAME_SAMPLES)) {
+        _dropped_frames++;
+        return;
+    }
+    queue_frame(packet + pos, size - pos, AAC_DECODER_FRAME_SAMPLES, media_header.timestamp);
+
+    update_buffering(media_header.timestamp, AAC_DECODER_FRAME_SAMPLES);
+}
+#endif
+
+
+// an sbc packet is the rtp header, the sbc header with the number of frames and the frames
+static void sbc_media_handler(uint8_t *packet, uint16_t size) {
     int pos = 0;
      
     avdtp_media_packet_header_t media_header;
@@ -386,36 +1062,64 @@ static void media_handler(uint8_t seid, uint8_t *packet, uint16_t size) {
     int packet_length = size-pos;
     uint8_t *packet_begin = packet + pos;
 
-    // store sbc frame size for buffer management
-    _sbc_frame_size = packet_length / sbc_header.num_frames;
-    int status = btstack_ring_buffer_write(&_sbc_frame_ring_buffer, packet_begin, packet_length);
-    // if (status != ERROR_CODE_SUCCESS){
-    //     printf("Error storing samples in SBC ring buffer!!!\n");
-    // }
+    // the first frame tells the audio length of the packet
+    sbc_header_t frame_header;
+    if (!sbc_header_parse(packet_begin, packet_length, &frame_header)) return;
+    uint32_t packet_samples = sbc_header.num_frames * frame_header.num_samples;
 
-    // decide on audio sync drift based on number of sbc frames in queue
-    int sbc_frames_in_buffer = btstack_ring_buffer_bytes_available(&_sbc_frame_ring_buffer) / _sbc_frame_size;
+    if (!track_sequence(&media_header, packet_samples, frame_header.num_samples)) {
+        _dropped_frames += sbc_header.num_frames;
+        return;
+    }
 
-    uint32_t resampling_factor;
+    // slice into frames by their own headers, the size can change from one frame to the next
+    uint32_t timestamp = media_header.timestamp;
+    for (int i = 0; i < sbc_header.num_frames; i++) {
+        if (!sbc_header_parse(packet_begin, packet_length, &frame_header) || frame_header.frame_length > packet_length) {
+            _dropped_frames += sbc_header.num_frames - i;
+            break;
+        }
+        queue_frame(packet_begin, frame_header.frame_length, frame_header.num_samples, timestamp);
+        timestamp += frame_header.num_samples;
+        packet_begin += frame_header.frame_length;
+        packet_length -= frame_header.frame_length;
+    }
 
-    // nominal factor (fixed-point 2^16) and compensation offset
-    uint32_t nominal_factor = 0x10000;
-    uint32_t compensation   = 0x00100;
+    // the decoder fell behind: renegotiate here, on the bluetooth side
+    if (_over_budget) {
+        _over_budget = false;
+        fall_back_to_standard_bitpool();
+    }
 
-    if (sbc_frames_in_buffer < OPTIMAL_FRAMES_MIN){
-    	resampling_factor = nominal_factor - compensation;    // stretch samples
-    } else if (sbc_frames_in_buffer <= OPTIMAL_FRAMES_MAX){
-    	resampling_factor = nominal_factor;                   // nothing to do
-    } else {
-    	resampling_factor = nominal_factor + compensation;    // compress samples
+    // so does a struggling link, fewer bytes per frame take fewer acl packets
+    uint8_t max_bitpool = bitrate_update(&_bitrate, btstack_run_loop_get_time_ms(), _lost_packets, _underrun_frames,
+        jitter_get_spread(&_jitter) * 1000 / _sampling_frequency, _sbc_configuration.max_bitpool_value);
+    if (max_bitpool && request_max_bitpool(max_bitpool)) {
+        bitrate_requested(&_bitrate, max_bitpool, _sbc_configuration.max_bitpool_value);
     }
 
-    btstack_resample_set_factor(&_resample_instance, resampling_factor);
+    update_buffering(media_header.timestamp, packet_samples);
+}
 
-    // start stream if enough frames buffered
-    if (!_audio_stream_started && sbc_frames_in_buffer >= (OPTIMAL_FRAMES_MIN+OPTIMAL_FRAMES_MAX)/2){
-        media_processing_start();
+
+static void media_handler(uint8_t seid, uint8_t *packet, uint16_t size) {
+    TIMING_BEGIN(TIMING_MEDIA);
+
+#ifdef AAC_DECODER
+    if (seid == _aac_seid) {
+        aac_media_handler(packet, size);
+    } else
+#endif
+#ifdef APTX_DECODER
+    if (seid == _aptx_seid) {
+        aptx_media_handler(packet, size);
+    } else
+#endif
+    {
+        sbc_media_handler(packet, size);
     }
+
+    TIMING_END(TIMING_MEDIA);
 }
 
 
@@ -430,6 +1134,13 @@ void a2dp_sink_begin() {
 
     a2dp_sink_init();
 
+#ifdef TIMING
+    timing_init();
+#endif
+
+    bitrate_init(&_bitrate, SBC_MAX_BITPOOL);
+    stats_init(&_stats, MAX_SBC_FRAMES);
+
     a2dp_sink_register_packet_handler(&data_handler);
     a2dp_sink_register_media_handler(&media_handler);
 
@@ -437,5 +1148,131 @@ void a2dp_sink_begin() {
     avdtp_stream_endpoint_t * endpoint = a2dp_sink_create_stream_endpoint(AVDTP_AUDIO, AVDTP_CODEC_SBC, 
         _sbc_capabilities, sizeof(_sbc_capabilities),
         sbc_configuration, sizeof(sbc_configuration));
-    _seid = avdtp_local_seid(endpoint);
+    _sbc_seid = avdtp_local_seid(endpoint);
+    _seid = _sbc_seid;
+    avdtp_sink_register_delay_reporting_category(_sbc_seid);
+
+#ifdef APTX_DECODER
+    // sources that know aptx prefer it
+    endpoint = a2dp_sink_create_stream_endpoint(AVDTP_AUDIO, AVDTP_CODEC_NON_A2DP,
+        _aptx_capabilities, sizeof(_aptx_capabilities),
+        _aptx_codec_configuration, sizeof(_aptx_codec_configuration));
+    _aptx_seid = avdtp_local_seid(endpoint);
+    avdtp_sink_register_delay_reporting_category(_aptx_seid);
+#endif
+
+#ifdef AAC_DECODER
+    // iphones stream aac if they may, with fewer and smaller packets than sbc
+    endpoint = a2dp_sink_create_stream_endpoint(AVDTP_AUDIO, AVDTP_CODEC_MPEG_2_4_AAC,
+        _aac_capabilities, sizeof(_aac_capabilities),
+        _aac_codec_configuration, sizeof(_aac_codec_configuration));
+    _aac_seid = avdtp_local_seid(endpoint);
+    avdtp_sink_register_delay_reporting_category(_aac_seid);
+#endif
+}
+
+
+uint8_t a2dp_sink_connect(bd_addr_t address) {
+    uint16_t cid;
+    return a2dp_sink_establish_stream(address, _sbc_seid, &cid);
+}
+
+
+int a2dp_sink_sbc_frames_buffered() {
+    return sbc_queue_frames(&_sbc_queue);
+}
+
+
+uint32_t a2dp_sink_resampling_factor() {
+    return drift_get_factor(&_drift);
+}
+
+
+int32_t a2dp_sink_drift_ppm() {
+    return drift_get_ppm(&_drift);
+}
+
+
+int32_t a2dp_sink_drift_error() {
+    return drift_get_error(&_drift);
+}
+
+
+uint32_t a2dp_sink_target_frames() {
+    return _target_frames;
+}
+
+
+uint32_t a2dp_sink_underrun_frames() {
+    return _underrun_frames;
+}
+
+
+uint32_t a2dp_sink_concealed_frames() {
+    return _concealed_frames;
+}
+
+
+uint32_t a2dp_sink_dropped_frames() {
+    return _dropped_frames;
+}
+
+
+uint32_t a2dp_sink_overflow_frames() {
+    return _overflow_frames;
+}
+
+
+uint32_t a2dp_sink_decode_load() {
+    return budget_get_load(&_budget);
+}
+
+
+uint32_t a2dp_sink_decode_peak() {
+    return budget_get_peak(&_budget);
+}
+
+
+uint8_t a2dp_sink_max_bitpool() {
+    return _sbc_capabilities[3];
+}
+
+
+uint32_t a2dp_sink_delay_100us() {
+    return delay_get_100us(&_delay);
+}
+
+
+uint32_t a2dp_sink_delay_reports() {
+    return delay_get_reports(&_delay);
+}
+
+
+uint32_t a2dp_sink_lost_packets() {
+    return _lost_packets;
+}
+
+
+uint32_t a2dp_sink_bad_link_windows() {
+    return bitrate_get_bad_windows(&_bitrate);
+}
+
+
+uint32_t a2dp_sink_bitpool_steps_down() {
+    return bitrate_get_steps_down(&_bitrate);
+}
+
+
+uint32_t a2dp_sink_bitpool_steps_up() {
+    return bitrate_get_steps_up(&_bitrate);
+}
+
+
+void a2dp_sink_get_stats(stats_t *stats) {
+    stats_get(&_stats, stats);
+}
+
+
+void a2dp_sink_reset_stats() {
+    stats_reset(&_stats);
 }
@@ -1,8 +1,39 @@
 #ifndef a2dp_h
 #define a2dp_h
 
+#include <bluetooth.h>
+#include <stdint.h>
+
+#include "stats.h"
+
 
 void a2dp_sink_begin();
 
+// page a source and set up a stream to it, of sbc that every source has.
+// ERROR_CODE_SUCCESS if paging started, the stream comes as if the source set it up
+uint8_t a2dp_sink_connect(bd_addr_t address);
+
+// media pipeline monitoring
+int a2dp_sink_sbc_frames_buffered();       // sbc frames waiting for decode
+uint32_t a2dp_sink_resampling_factor();    // 0x10000 is nominal, i2s clock ratio with I2S_CLOCK_TRIM
+int32_t a2dp_sink_drift_ppm();             // estimated source clock offset
+int32_t a2dp_sink_drift_error();           // audio frames buffered above target
+uint32_t a2dp_sink_target_frames();        // audio frames to buffer for the arrival jitter
+uint32_t a2dp_sink_underrun_frames();      // audio frames played as silence so far
+uint32_t a2dp_sink_concealed_frames();     // audio frames synthesized for lost packets
+uint32_t a2dp_sink_dropped_frames();       // sbc frames not queued: late, corrupt or no room
+uint32_t a2dp_sink_overflow_frames();      // decoded audio frames that did not fit the ring buffer
+uint32_t a2dp_sink_decode_load();          // percent of real time spent decoding over the last second
+uint32_t a2dp_sink_decode_peak();          // highest decode load so far
+uint8_t a2dp_sink_max_bitpool();           // offered to sources, drops to the standard 53 if decoding falls behind
+uint32_t a2dp_sink_delay_100us();          // averaged delay from arrival to output, reported to the source
+uint32_t a2dp_sink_delay_reports();        // delay reports sent so far
+uint32_t a2dp_sink_lost_packets();         // gaps in the rtp sequence
+uint32_t a2dp_sink_bad_link_windows();     // seconds with underruns, losses or late packets
+uint32_t a2dp_sink_bitpool_steps_down();   // max bitpool requests for a struggling link
+uint32_t a2dp_sink_bitpool_steps_up();     // and back once it was stable
+void a2dp_sink_get_stats(stats_t *stats);  // counters and histograms for sizing the buffers
+void a2dp_sink_reset_stats();              // on core 0, they count from now on
+
 
-#endif
\ No newline at end of file
+#endif
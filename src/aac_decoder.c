@@ -0,0 +1,1324 @@
+#include "aac_decoder.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "volume.h"
+
+#ifdef __ARM_FEATURE_DSP
+#include <arm_acle.h>
+#endif
+
+
+// see ISO/IEC 14496-3 4.4.2 (syntax), 4.6.1-4.6.3 (spectrum), 4.6.8 (stereo),
+// 4.6.9 (tns), 4.6.11 (filterbank), 4.6.13 (pns) and 1.7.3 (latm)
+
+#define COEF_SHIFT   4   // fraction bits of the spectrum
+#define OUT_SHIFT    8   // fraction bits of the windowed imdct output and the overlap
+#define NORM_BITS   30   // imdct inputs are normalized to below 2^NORM_BITS
+
+#define LONG_SAMPLES   1024
+#define SHORT_SAMPLES   128
+#define NUM_SWB_LONG     49  // scale factor bands at 44.1 and 48kHz
+#define NUM_SWB_SHORT    14
+#define MAX_WINDOWS       8
+#define MAX_BANDS       (MAX_WINDOWS * 16)  // window groups times bands
+#define MAX_PULSES        4
+#define MAX_FILTERS       3  // tns, per window
+#define TNS_MAX_ORDER    12  // lc profile, long windows
+#define TNS_MAX_ORDER_SHORT 7
+#define FFT_SIZE        512  // complex points of the long imdct
+
+#define SAMPLING_INDEX_48000  3
+#define SAMPLING_INDEX_44100  4
+#define AOT_AAC_LC            2
+
+enum { ID_SCE, ID_CPE, ID_CCE, ID_LFE, ID_DSE, ID_PCE, ID_FIL, ID_END };
+enum { ONLY_LONG_SEQUENCE, LONG_START_SEQUENCE, EIGHT_SHORT_SEQUENCE, LONG_STOP_SEQUENCE };
+enum { ZERO_HCB = 0, ESC_HCB = 11, NOISE_HCB = 13, INTENSITY_HCB2 = 14, INTENSITY_HCB = 15 };
+
+
+// scale factor band offsets at 44.1 and 48kHz
+static const uint16_t swb_offset_long[NUM_SWB_LONG + 1] = {
+    0, 4, 8, 12, 16, 20, 24, 28, 32, 36, 40, 48, 56, 64, 72, 80, 88, 96, 108, 120,
+    132, 144, 160, 176, 196, 216, 240, 264, 292, 320, 352, 384, 416, 448, 480, 512, 544, 576, 608, 640,
+    672, 704, 736, 768, 800, 832, 864, 896, 928, 1024,
+};
+static const uint16_t swb_offset_short[NUM_SWB_SHORT + 1] = {
+    0, 4, 8, 12, 16, 20, 28, 36, 44, 56, 68, 80, 96, 112, 128,
+};
+
+// bands tns may filter, long and short, by sampling index 3 (48kHz) and 4 (44.1kHz)
+static const uint8_t tns_max_bands[2][2] = { { 40, 14 }, { 42, 14 } };
+
+// tns reflection coefficients sin(c / (c >= 0 ? iqfac : iqfac_m)), Q31, for 3 and 4 bit resolution
+static const int32_t tns_coef_3[8] = {
+    -2114858546, -1859775393, -1380375881, -734482665, 0, 931758235, 1678970324, 2093641749,
+};
+static const int32_t tns_coef_4[16] = {
+    -2138322861, -2065504841, -1922348530, -1713728946, -1446750378, -1130504462, -775760571, -394599085,
+    0, 446486956, 873460290, 1262259218, 1595891361, 1859775393, 2042378317, 2135719508,
+};
+
+// 2^(i / 4), Q14
+static const int16_t pow2_quarter[4] = { 16384, 19484, 23170, 27554 };
+
+
+// Huffman codes of the spec are canonical: sorted by length, the codes of each
+// length are consecutive. So a codebook is the number of codes of every length
+// and the symbols in code order, a code is found by counting down the lengths.
+
+static const uint8_t counts_1[11] = {
+    1, 0, 0, 0, 8, 0, 24, 0, 24, 8, 16,
+};
+static const uint16_t symbols_1[81] = {
+    40, 67, 13, 39, 49, 41, 37, 43, 31, 58, 22, 38, 46, 34, 42, 76, 36, 4, 28, 64,
+    48, 16, 44, 70, 32, 52, 50, 10, 68, 12, 66, 14, 30, 73, 19, 61, 51, 47, 35, 33,
+    55, 65, 45, 25, 15, 7, 29, 59, 57, 21, 1, 27, 53, 69, 77, 23, 79, 5, 9, 75,
+    63, 11, 3, 17, 71, 60, 20, 24, 56, 80, 8, 72, 6, 0, 74, 62, 26, 18, 2, 54,
+    78,
+};
+static const uint8_t counts_2[9] = {
+    0, 0, 1, 1, 7, 24, 15, 19, 14,
+};
+static const uint16_t symbols_2[81] = {
+    40, 67, 13, 41, 37, 39, 31, 43, 49, 34, 22, 46, 42, 48, 38, 12, 58, 64, 4, 36,
+    70, 68, 32, 16, 50, 28, 14, 30, 10, 76, 52, 44, 66, 47, 65, 19, 33, 61, 75, 71,
+    25, 29, 79, 15, 1, 11, 55, 73, 59, 21, 7, 17, 5, 3, 27, 69, 63, 45, 53, 23,
+    9, 51, 57, 35, 77, 60, 20, 56, 0, 24, 26, 80, 6, 62, 18, 8, 72, 54, 2, 74,
+    78,
+};
+static const uint8_t counts_3[16] = {
+    1, 0, 0, 4, 2, 6, 3, 5, 15, 15, 8, 9, 3, 3, 5, 2,
+};
+static const uint16_t symbols_3[81] = {
+    0, 27, 1, 9, 3, 36, 4, 12, 10, 30, 13, 28, 39, 40, 31, 37, 54, 2, 5, 63,
+    48, 7, 16, 45, 14, 66, 6, 21, 15, 18, 11, 57, 49, 22, 42, 43, 46, 33, 34, 19,
+    67, 41, 64, 32, 8, 17, 75, 51, 29, 55, 25, 72, 52, 38, 58, 44, 76, 24, 23, 35,
+    73, 69, 78, 26, 79, 70, 50, 53, 20, 60, 47, 61, 68, 65, 80, 77, 71, 59, 56, 74,
+    62,
+};
+static const uint8_t counts_4[12] = {
+    0, 0, 0, 10, 6, 0, 9, 21, 8, 14, 11, 2,
+};
+static const uint16_t symbols_4[81] = {
+    40, 13, 37, 39, 31, 27, 36, 0, 4, 30, 28, 12, 1, 10, 3, 9, 67, 43, 49, 41,
+    66, 64, 48, 58, 16, 14, 42, 22, 32, 46, 38, 34, 63, 57, 45, 55, 11, 21, 5, 15,
+    19, 29, 7, 33, 54, 2, 18, 6, 52, 76, 70, 44, 50, 68, 51, 75, 69, 25, 17, 73,
+    23, 61, 35, 79, 47, 59, 65, 53, 71, 77, 24, 72, 8, 60, 20, 56, 80, 26, 78, 74,
+    62,
+};
+static const uint8_t counts_5[13] = {
+    1, 0, 0, 4, 4, 0, 4, 12, 12, 12, 18, 10, 4,
+};
+static const uint16_t symbols_5[81] = {
+    40, 31, 49, 41, 39, 48, 32, 30, 50, 22, 42, 58, 38, 21, 59, 29, 51, 23, 57, 33,
+    47, 13, 67, 37, 43, 12, 52, 68, 28, 14, 66, 46, 34, 24, 60, 20, 56, 11, 65, 25,
+    55, 69, 61, 15, 19, 36, 4, 77, 76, 3, 44, 75, 27, 53, 35, 5, 45, 64, 10, 16,
+    26, 2, 78, 54, 62, 70, 6, 18, 74, 63, 1, 7, 71, 17, 79, 73, 9, 72, 8, 80,
+    0,
+};
+static const uint8_t counts_6[11] = {
+    0, 0, 0, 9, 0, 16, 13, 8, 23, 8, 4,
+};
+static const uint16_t symbols_6[81] = {
+    40, 49, 39, 41, 31, 50, 32, 48, 30, 57, 59, 23, 21, 22, 33, 58, 47, 51, 38, 29,
+    42, 56, 24, 20, 60, 14, 68, 66, 34, 12, 52, 46, 28, 67, 13, 37, 43, 69, 11, 25,
+    61, 65, 55, 19, 15, 70, 64, 10, 16, 45, 27, 77, 5, 3, 53, 75, 35, 36, 6, 2,
+    62, 18, 4, 78, 74, 26, 76, 54, 44, 9, 17, 63, 73, 71, 79, 7, 1, 80, 8, 0,
+    72,
+};
+static const uint8_t counts_7[12] = {
+    1, 0, 2, 1, 0, 4, 5, 10, 14, 15, 8, 4,
+};
+static const uint16_t symbols_7[64] = {
+    0, 8, 1, 9, 17, 10, 16, 2, 25, 11, 18, 24, 3, 19, 26, 12, 33, 13, 41, 27,
+    20, 4, 32, 34, 21, 42, 5, 49, 40, 14, 35, 29, 28, 43, 22, 50, 15, 30, 6, 48,
+    36, 57, 37, 58, 44, 51, 23, 59, 52, 45, 38, 31, 56, 7, 53, 46, 60, 39, 47, 61,
+    62, 54, 55, 63,
+};
+static const uint8_t counts_8[10] = {
+    0, 0, 1, 5, 7, 10, 14, 15, 8, 4,
+};
+static const uint16_t symbols_8[64] = {
+    9, 17, 8, 10, 1, 18, 0, 16, 2, 25, 11, 26, 19, 27, 33, 12, 34, 20, 24, 3,
+    35, 28, 42, 41, 21, 13, 43, 29, 36, 44, 4, 37, 32, 22, 50, 49, 14, 30, 51, 45,
+    40, 52, 5, 38, 57, 58, 23, 53, 59, 15, 46, 31, 54, 60, 48, 39, 6, 61, 62, 55,
+    47, 56, 7, 63,
+};
+static const uint8_t counts_9[15] = {
+    1, 0, 2, 1, 0, 4, 3, 8, 11, 20, 31, 38, 32, 14, 4,
+};
+static const uint16_t symbols_9[169] = {
+    0, 13, 1, 14, 27, 15, 26, 2, 40, 28, 16, 39, 3, 29, 41, 17, 53, 30, 18, 54,
+    42, 4, 52, 66, 31, 19, 43, 67, 79, 55, 5, 32, 65, 20, 44, 21, 105, 56, 68, 80,
+    92, 6, 106, 34, 45, 33, 57, 118, 22, 93, 78, 69, 81, 107, 7, 119, 47, 58, 46, 8,
+    131, 82, 35, 70, 104, 91, 94, 132, 120, 108, 23, 95, 83, 71, 60, 59, 48, 144, 73, 117,
+    109, 133, 36, 9, 145, 121, 84, 157, 61, 110, 24, 122, 134, 72, 96, 37, 25, 158, 146, 49,
+    74, 85, 111, 147, 10, 97, 159, 130, 135, 62, 86, 38, 123, 124, 63, 143, 87, 50, 75, 112,
+    99, 161, 51, 148, 98, 160, 149, 136, 64, 100, 76, 11, 162, 88, 156, 137, 77, 101, 125, 12,
+    150, 113, 126, 138, 102, 163, 89, 115, 151, 103, 90, 114, 139, 116, 127, 128, 129, 141, 165, 140,
+    152, 164, 153, 166, 167, 142, 154, 155, 168,
+};
+static const uint8_t counts_10[12] = {
+    0, 0, 0, 3, 8, 14, 17, 25, 31, 41, 22, 8,
+};
+static const uint16_t symbols_10[169] = {
+    14, 15, 27, 28, 13, 1, 16, 41, 40, 29, 42, 26, 2, 30, 54, 17, 53, 0, 55, 43,
+    39, 3, 56, 31, 67, 18, 66, 68, 44, 69, 57, 80, 32, 81, 52, 79, 4, 19, 45, 70,
+    82, 58, 83, 93, 46, 33, 71, 106, 94, 65, 92, 5, 105, 20, 107, 95, 59, 34, 84, 96,
+    21, 47, 108, 60, 72, 109, 73, 97, 85, 119, 78, 86, 120, 48, 118, 35, 6, 110, 121, 61,
+    132, 22, 98, 111, 122, 99, 133, 74, 134, 36, 131, 49, 123, 87, 104, 62, 91, 145, 100, 146,
+    136, 23, 144, 124, 7, 112, 135, 50, 75, 113, 148, 8, 147, 37, 101, 88, 137, 63, 24, 158,
+    125, 159, 149, 76, 160, 150, 161, 51, 89, 117, 138, 130, 157, 9, 64, 126, 162, 38, 114, 127,
+    25, 151, 163, 102, 77, 90, 139, 115, 164, 10, 103, 143, 140, 152, 153, 11, 154, 128, 141, 156,
+    116, 165, 142, 129, 155, 167, 12, 166, 168,
+};
+static const uint8_t counts_11[12] = {
+    0, 0, 0, 2, 6, 7, 16, 59, 55, 95, 43, 6,
+};
+static const uint16_t symbols_11[289] = {
+    0, 18, 288, 17, 1, 35, 19, 36, 20, 52, 53, 34, 37, 2, 54, 69, 21, 70, 38, 71,
+    55, 51, 3, 86, 87, 39, 72, 22, 88, 56, 89, 73, 104, 40, 103, 105, 57, 23, 84, 67,
+    277, 275, 276, 106, 278, 68, 74, 4, 50, 90, 101, 279, 274, 280, 41, 121, 58, 107, 91, 118,
+    282, 122, 120, 281, 135, 33, 24, 75, 283, 123, 284, 152, 273, 108, 169, 42, 92, 186, 285, 139,
+    138, 59, 85, 286, 203, 124, 76, 109, 125, 5, 140, 287, 220, 25, 137, 254, 93, 237, 60, 141,
+    126, 43, 142, 155, 156, 271, 77, 110, 102, 157, 94, 143, 127, 26, 173, 6, 172, 154, 158, 78,
+    44, 159, 61, 111, 174, 144, 175, 160, 190, 27, 119, 176, 128, 62, 95, 171, 79, 189, 223, 112,
+    224, 45, 272, 96, 192, 191, 161, 129, 145, 16, 81, 7, 64, 193, 222, 225, 207, 47, 226, 146,
+    113, 178, 177, 240, 208, 28, 80, 188, 63, 30, 206, 130, 65, 97, 98, 242, 82, 194, 241, 209,
+    227, 210, 136, 195, 46, 162, 243, 115, 180, 257, 147, 163, 244, 179, 99, 196, 239, 48, 114, 29,
+    229, 8, 228, 131, 211, 132, 258, 205, 116, 49, 260, 259, 31, 164, 83, 245, 149, 230, 148, 100,
+    66, 181, 197, 212, 261, 262, 150, 256, 133, 153, 9, 166, 165, 213, 246, 183, 247, 214, 117, 134,
+    167, 263, 198, 201, 32, 182, 184, 232, 231, 200, 199, 151, 249, 233, 217, 264, 248, 170, 215, 168,
+    10, 216, 187, 218, 185, 234, 13, 250, 265, 266, 202, 251, 221, 11, 235, 267, 268, 219, 238, 252,
+    236, 204, 253, 14, 12, 269, 255, 15, 270,
+};
+static const uint8_t counts_sf[19] = {
+    1, 0, 1, 3, 2, 4, 3, 5, 4, 6, 6, 6, 5, 8, 4, 7, 3, 7, 46,
+};
+static const uint16_t symbols_sf[121] = {
+    60, 59, 61, 58, 62, 57, 63, 56, 64, 55, 65, 66, 54, 67, 53, 68, 52, 69, 51, 70,
+    50, 49, 71, 72, 48, 73, 47, 74, 46, 76, 75, 77, 78, 45, 43, 44, 79, 42, 41, 80,
+    40, 81, 39, 82, 38, 83, 37, 35, 85, 33, 36, 34, 84, 32, 87, 89, 30, 31, 86, 29,
+    26, 27, 28, 24, 88, 25, 22, 23, 90, 21, 19, 3, 1, 2, 0, 98, 99, 100, 101, 102,
+    117, 97, 91, 92, 93, 94, 95, 96, 104, 111, 112, 113, 114, 115, 116, 110, 105, 106, 107, 108,
+    109, 118, 6, 8, 9, 10, 5, 103, 120, 119, 4, 7, 15, 16, 18, 20, 17, 11, 12, 14,
+    13,
+};
+
+typedef struct {
+    uint8_t max_bits;
+    const uint8_t *counts;    // codes of 1, 2, .. max_bits bits
+    const uint16_t *symbols;  // in code order
+} huffman_t;
+
+static const huffman_t huffman_sf = { 19, counts_sf, symbols_sf };
+
+// spectral codebooks 1-11, how their symbols pack values: dimension, values per dimension, signed or not
+static const struct {
+    huffman_t huffman;
+    uint8_t dimension;
+    uint8_t modulo;
+    bool    is_signed;
+} codebooks[ESC_HCB] = {
+    { { 11, counts_1,  symbols_1  }, 4,  3, true  },
+    { {  9, counts_2,  symbols_2  }, 4,  3, true  },
+    { { 16, counts_3,  symbols_3  }, 4,  3, false },
+    { { 12, counts_4,  symbols_4  }, 4,  3, false },
+    { { 13, counts_5,  symbols_5  }, 2,  9, true  },
+    { { 11, counts_6,  symbols_6  }, 2,  9, true  },
+    { { 12, counts_7,  symbols_7  }, 2,  8, false },
+    { { 10, counts_8,  symbols_8  }, 2,  8, false },
+    { { 15, counts_9,  symbols_9  }, 2, 13, false },
+    { { 12, counts_10, symbols_10 }, 2, 13, false },
+    { { 12, counts_11, symbols_11 }, 2, 17, false },
+};
+
+
+// tables computed once by aac_decoder_init(), shared by all decoders
+static struct {
+    bool    ready;
+    int32_t pow43[LONG_SAMPLES + 1];                    // n^(4/3), Q13
+    int16_t long_window[2][LONG_SAMPLES];               // rising halves, sine and kbd, Q15
+    int16_t short_window[2][SHORT_SAMPLES];
+    int16_t long_twiddle[2][LONG_SAMPLES / 2];          // cos and sin of 2 pi (k + 1/8) / 2048, Q15
+    int16_t short_twiddle[2][SHORT_SAMPLES / 2];        // same for 256
+    int16_t fft_twiddle[2][FFT_SIZE / 2];               // cos and sin of 2 pi k / 512, Q15
+} _tables;
+
+
+typedef struct {
+    uint8_t window_sequence;
+    uint8_t window_shape;
+    uint8_t max_sfb;
+    uint8_t num_windows;
+    uint8_t num_groups;
+    uint8_t group_len[MAX_WINDOWS];
+    uint8_t num_swb;
+    const uint16_t *swb_offset;
+} ics_info_t;
+
+typedef struct {
+    uint8_t n_filt[MAX_WINDOWS];
+    uint8_t coef_res[MAX_WINDOWS];
+    uint8_t length[MAX_WINDOWS][MAX_FILTERS];
+    uint8_t order[MAX_WINDOWS][MAX_FILTERS];
+    uint8_t direction[MAX_WINDOWS][MAX_FILTERS];
+    int8_t  coef[MAX_WINDOWS][MAX_FILTERS][TNS_MAX_ORDER];
+} tns_t;
+
+typedef struct {
+    ics_info_t info;
+    uint8_t  band_type[MAX_BANDS];      // by group and band
+    int16_t  scale_factor[MAX_BANDS];   // or intensity position or noise energy, by band type
+    uint32_t noise_seed[MAX_BANDS];     // of noise bands, for correlated noise in m/s bands
+    bool     tns_present;
+    tns_t    tns;
+} ics_t;
+
+typedef struct {
+    uint8_t ms_mask_present;            // 0 none, 1 by band, 2 all
+    uint8_t ms_used[MAX_BANDS];
+} stereo_t;
+
+// what the elements of the access unit being decoded signal, about 3KB, too much
+// for the 2KB stacks of the pico, so it is static and shared like the tables
+static struct {
+    ics_t    ics[AAC_DECODER_CHANNELS];
+    stereo_t stereo;
+} _element;
+
+
+// (a * b) >> 16
+static inline int32_t mul_q16(int32_t a, int16_t b) {
+#ifdef __ARM_FEATURE_DSP
+    return __smulwb(a, b);
+#else
+    // the same with 32 bit products, the cortex-m0+ has no long multiply
+    return (a >> 16) * b + (((a & 0xffff) * b) >> 16);
+#endif
+}
+
+
+// x * 2^shift, saturated
+static inline int32_t shift_saturate(int32_t x, int shift) {
+    if (shift <= 0) {
+        return shift > -32 ? x >> -shift : x >> 31;
+    }
+    int32_t limit = shift < 31 ? INT32_MAX >> shift : 0;
+    if (x > limit) return INT32_MAX;
+    if (x < -limit) return -INT32_MAX;
+    return (int32_t)((uint32_t)x << shift);
+}
+
+
+// --- bitstream
+
+typedef struct {
+    const uint8_t *data;
+    uint32_t size;       // bytes
+    uint32_t position;   // bits, can run past the end, which is checked at the end of elements
+} bit_reader_t;
+
+// up to 25 bits, msb first, zeros past the end
+static inline uint32_t peek_bits(const bit_reader_t *reader, uint8_t num_bits) {
+    uint32_t index = reader->position >> 3;
+    uint32_t word;
+    if (index + 3 < reader->size) {
+        word = ((uint32_t)reader->data[index] << 24) | (reader->data[index + 1] << 16) |
+               (reader->data[index + 2] << 8) | reader->data[index + 3];
+    } else {
+        word = 0;
+        for (uint32_t i = 0; i < 4; i++) {
+            word = (word << 8) | (index + i < reader->size ? reader->data[index + i] : 0);
+        }
+    }
+    return (word << (reader->position & 7)) >> (32 - num_bits);
+}
+
+static inline uint32_t read_bits(bit_reader_t *reader, uint8_t num_bits) {
+    if (!num_bits) return 0;
+    uint32_t value = peek_bits(reader, num_bits);
+    reader->position += num_bits;
+    return value;
+}
+
+static inline bool read_bit(bit_reader_t *reader) {
+    return read_bits(reader, 1);
+}
+
+static inline bool overrun(const bit_reader_t *reader) {
+    return reader->position > 8 * reader->size;
+}
+
+static uint32_t read_huffman(bit_reader_t *reader, const huffman_t *huffman) {
+    uint32_t word = peek_bits(reader, huffman->max_bits);
+    uint32_t first = 0;  // code of the first symbol with this many bits
+    uint32_t index = 0;  // of that symbol
+    for (uint8_t bits = 1; bits <= huffman->max_bits; bits++) {
+        uint32_t code = word >> (huffman->max_bits - bits);
+        uint32_t count = huffman->counts[bits - 1];
+        if (code - first < count) {
+            reader->position += bits;
+            return huffman->symbols[index + code - first];
+        }
+        index += count;
+        first = (first + count) << 1;
+    }
+    return 0;  // not reached, the codes are complete
+}
+
+
+// --- syntax, 4.4.2
+
+static bool read_ics_info(bit_reader_t *reader, ics_info_t *info) {
+    read_bit(reader);  // reserved
+    info->window_sequence = read_bits(reader, 2);
+    info->window_shape = read_bit(reader);
+    if (info->window_sequence == EIGHT_SHORT_SEQUENCE) {
+        info->max_sfb = read_bits(reader, 4);
+        info->num_windows = MAX_WINDOWS;
+        info->num_groups = 1;
+        info->group_len[0] = 1;
+        for (int i = 0; i < MAX_WINDOWS - 1; i++) {
+            if (read_bit(reader)) {
+                info->group_len[info->num_groups - 1]++;
+            } else {
+                info->group_len[info->num_groups++] = 1;
+            }
+        }
+        info->num_swb = NUM_SWB_SHORT;
+        info->swb_offset = swb_offset_short;
+    } else {
+        info->max_sfb = read_bits(reader, 6);
+        info->num_windows = 1;
+        info->num_groups = 1;
+        info->group_len[0] = 1;
+        info->num_swb = NUM_SWB_LONG;
+        info->swb_offset = swb_offset_long;
+        if (read_bit(reader)) return false;  // prediction, main profile only
+    }
+    return info->max_sfb <= info->num_swb;
+}
+
+
+static bool read_section_data(bit_reader_t *reader, ics_t *ics) {
+    const ics_info_t *info = &ics->info;
+    uint8_t bits = info->window_sequence == EIGHT_SHORT_SEQUENCE ? 3 : 5;
+    uint8_t escape = (1 << bits) - 1;
+    uint8_t *band_type = ics->band_type;
+
+    for (int g = 0; g < info->num_groups; g++) {
+        int k = 0;
+        while (k < info->max_sfb) {
+            uint8_t type = read_bits(reader, 4);
+            if (type == 12) return false;  // reserved
+            int end = k;
+            uint8_t increment;
+            do {
+                increment = read_bits(reader, bits);
+                end += increment;
+                if (end > info->max_sfb || overrun(reader)) return false;
+            } while (increment == escape);
+            while (k < end) {
+                *band_type++ = type;
+                k++;
+            }
+        }
+    }
+    return true;
+}
+
+
+static bool read_scale_factors(bit_reader_t *reader, ics_t *ics, uint8_t global_gain) {
+    const ics_info_t *info = &ics->info;
+    int scale_factor = global_gain;
+    int position = 0;                  // intensity
+    int energy = global_gain - 90;     // noise
+    bool first_noise = true;
+
+    int idx = 0;
+    for (int g = 0; g < info->num_groups; g++) {
+        for (int sfb = 0; sfb < info->max_sfb; sfb++, idx++) {
+            switch (ics->band_type[idx]) {
+                case ZERO_HCB:
+                    ics->scale_factor[idx] = 0;
+                    break;
+                case INTENSITY_HCB:
+                case INTENSITY_HCB2:
+                    position += (int)read_huffman(reader, &huffman_sf) - 60;
+                    ics->scale_factor[idx] = position;
+                    break;
+                case NOISE_HCB:
+                    if (first_noise) {
+                        energy += (int)read_bits(reader, 9) - 256;
+                        first_noise = false;
+                    } else {
+                        energy += (int)read_huffman(reader, &huffman_sf) - 60;
+                    }
+                    ics->scale_factor[idx] = energy;
+                    break;
+                default:
+                    scale_factor += (int)read_huffman(reader, &huffman_sf) - 60;
+                    if (scale_factor < 0 || scale_factor > 255) return false;
+                    ics->scale_factor[idx] = scale_factor;
+                    break;
+            }
+        }
+    }
+    return !overrun(reader);
+}
+
+
+static bool read_tns_data(bit_reader_t *reader, ics_t *ics) {
+    bool is_short = ics->info.window_sequence == EIGHT_SHORT_SEQUENCE;
+    uint8_t max_order = is_short ? TNS_MAX_ORDER_SHORT : TNS_MAX_ORDER;
+    tns_t *tns = &ics->tns;
+
+    for (int w = 0; w < ics->info.num_windows; w++) {
+        tns->n_filt[w] = read_bits(reader, is_short ? 1 : 2);
+        if (!tns->n_filt[w]) continue;
+        tns->coef_res[w] = read_bit(reader);
+        for (int f = 0; f < tns->n_filt[w]; f++) {
+            tns->length[w][f] = read_bits(reader, is_short ? 4 : 6);
+            tns->order[w][f] = read_bits(reader, is_short ? 3 : 5);
+            if (tns->order[w][f] > max_order) return false;
+            if (!tns->order[w][f]) continue;
+            tns->direction[w][f] = read_bit(reader);
+            uint8_t bits = tns->coef_res[w] + 3 - read_bit(reader);  // coef_compress drops the msb
+            for (int i = 0; i < tns->order[w][f]; i++) {
+                int8_t coef = read_bits(reader, bits);
+                tns->coef[w][f][i] = coef >= (1 << (bits - 1)) ? coef - (1 << bits) : coef;
+            }
+        }
+    }
+    return true;
+}
+
+
+// quantized values of the bands with spectral codebooks, short windows deinterleaved
+static bool read_spectral_data(bit_reader_t *reader, const ics_t *ics, int32_t *spectrum) {
+    const ics_info_t *info = &ics->info;
+    int idx = 0;
+    int window = 0;
+
+    for (int g = 0; g < info->num_groups; g++) {
+        for (int sfb = 0; sfb < info->max_sfb; sfb++, idx++) {
+            uint8_t type = ics->band_type[idx];
+            if (type == ZERO_HCB || type > ESC_HCB) continue;
+
+            const huffman_t *huffman = &codebooks[type - 1].huffman;
+            uint8_t dimension = codebooks[type - 1].dimension;
+            uint8_t modulo = codebooks[type - 1].modulo;
+            bool is_signed = codebooks[type - 1].is_signed;
+            int offset = is_signed ? modulo / 2 : 0;
+            for (int w = window; w < window + info->group_len[g]; w++) {
+                int32_t *value = &spectrum[w * SHORT_SAMPLES + info->swb_offset[sfb]];
+                int32_t *end = &spectrum[w * SHORT_SAMPLES + info->swb_offset[sfb + 1]];
+                for (; value < end; value += dimension) {
+                    uint32_t symbol = read_huffman(reader, huffman);
+                    if (dimension == 4) {
+                        value[0] = (int32_t)(symbol / 27) - offset;
+                        value[1] = (int32_t)(symbol / 9 % 3) - offset;
+                        value[2] = (int32_t)(symbol / 3 % 3) - offset;
+                        value[3] = (int32_t)(symbol % 3) - offset;
+                    } else {
+                        value[0] = (int32_t)(symbol / modulo) - offset;
+                        value[1] = (int32_t)(symbol % modulo) - offset;
+                    }
+                    if (is_signed) continue;
+
+                    // unsigned codebooks: sign bits of the non zero values, then the escapes
+                    for (int i = 0; i < dimension; i++) {
+                        if (value[i] && read_bit(reader)) {
+                            value[i] = -value[i];
+                        }
+                    }
+                    if (type != ESC_HCB) continue;
+                    for (int i = 0; i < 2; i++) {
+                        if (value[i] != 16 && value[i] != -16) continue;
+                        uint8_t n = 0;
+                        while (read_bit(reader)) {
+                            if (++n > 8) return false;
+                        }
+                        int32_t escaped = (1 << (n + 4)) + read_bits(reader, n + 4);
+                        value[i] = value[i] < 0 ? -escaped : escaped;
+                    }
+                }
+                if (overrun(reader)) return false;
+            }
+        }
+        window += info->group_len[g];
+    }
+    return true;
+}
+
+
+typedef struct {
+    uint8_t  count;
+    uint16_t position[MAX_PULSES];
+    uint8_t  amplitude[MAX_PULSES];
+} pulses_t;
+
+static bool read_pulse_data(bit_reader_t *reader, const ics_info_t *info, pulses_t *pulses) {
+    if (info->window_sequence == EIGHT_SHORT_SEQUENCE) return false;
+    pulses->count = read_bits(reader, 2) + 1;
+    uint8_t start_sfb = read_bits(reader, 6);
+    if (start_sfb >= info->num_swb) return false;
+
+    int position = info->swb_offset[start_sfb];
+    for (int i = 0; i < pulses->count; i++) {
+        position += read_bits(reader, 5);
+        if (position >= LONG_SAMPLES) return false;
+        pulses->position[i] = position;
+        pulses->amplitude[i] = read_bits(reader, 4);
+    }
+    return true;
+}
+
+
+// --- dequantization, 4.6.1-4.6.3 and noise, 4.6.13
+
+// |q|^(4/3), Q13, interpolated above the table
+static inline int32_t pow43(int32_t q) {
+    if (q < 0) q = -q;
+    if (q <= LONG_SAMPLES) return _tables.pow43[q];
+    if (q > 8191) q = 8191;
+    const int32_t *p = &_tables.pow43[q >> 3];
+    return (p[0] << 4) + (p[1] - p[0]) * (q & 7) * 2;
+}
+
+static void dequantize_band(int32_t *value, int width, int scale_factor, int32_t gain) {
+    // value = sign * |q|^(4/3) * 2^((scale factor - 100) / 4) * gain, Q4
+    int exponent = scale_factor - 100;
+    int16_t mantissa = (pow2_quarter[exponent & 3] * gain) >> VOLUME_SHIFT;
+    int shift = (exponent >> 2) + COEF_SHIFT + 16 - 13 - 14;
+    for (int i = 0; i < width; i++) {
+        if (!value[i]) continue;
+        int32_t magnitude = shift_saturate(mul_q16(pow43(value[i]), mantissa), shift);
+        value[i] = value[i] < 0 ? -magnitude : magnitude;
+    }
+}
+
+static uint32_t isqrt(uint32_t x) {
+    uint32_t root = 0;
+    for (uint32_t bit = 1u << 30; bit; bit >>= 2) {
+        if (x >= root + bit) {
+            x -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+    }
+    return root;
+}
+
+// random values with the band energy 2^(energy / 2)
+static void noise_band(int32_t *value, int width, int energy, uint32_t *seed, int32_t gain) {
+    uint32_t random = *seed;
+    uint32_t sum = 0;
+    for (int i = 0; i < width; i++) {
+        random = random * 1664525 + 1013904223;
+        value[i] = (int32_t)random >> 22;
+        sum += value[i] * value[i];
+    }
+    *seed = random;
+    uint32_t root = isqrt(sum);
+    if (!root) return;
+
+    // value / root * 2^(energy / 4) * gain, Q4
+    int32_t mantissa = (pow2_quarter[energy & 3] * gain) >> VOLUME_SHIFT;
+    int32_t factor = (mantissa << 15) / (int32_t)root;
+    int shift = (energy >> 2) + COEF_SHIFT - 14 - 15;
+    for (int i = 0; i < width; i++) {
+        value[i] = shift_saturate(value[i] * factor, shift);
+    }
+}
+
+// from quantized values to the spectrum, noise for the right channel of an m/s band with noise in both is the left one's
+static void dequantize(aac_decoder_t *decoder, ics_t *ics, int32_t *spectrum, const ics_t *left, const stereo_t *stereo) {
+    const ics_info_t *info = &ics->info;
+    int idx = 0;
+    int window = 0;
+
+    for (int g = 0; g < info->num_groups; g++) {
+        for (int sfb = 0; sfb < info->max_sfb; sfb++, idx++) {
+            uint8_t type = ics->band_type[idx];
+            int width = info->swb_offset[sfb + 1] - info->swb_offset[sfb];
+            if (type == ZERO_HCB || type == INTENSITY_HCB || type == INTENSITY_HCB2) continue;
+
+            uint32_t *seed = &decoder->random;
+            if (type == NOISE_HCB) {
+                uint32_t correlated;
+                if (left && stereo->ms_used[idx] && left->band_type[idx] == NOISE_HCB) {
+                    correlated = left->noise_seed[idx];
+                    seed = &correlated;
+                }
+                ics->noise_seed[idx] = *seed;
+            }
+            for (int w = window; w < window + info->group_len[g]; w++) {
+                int32_t *value = &spectrum[w * SHORT_SAMPLES + info->swb_offset[sfb]];
+                if (type == NOISE_HCB) {
+                    noise_band(value, width, ics->scale_factor[idx], seed, decoder->gain);
+                } else {
+                    dequantize_band(value, width, ics->scale_factor[idx], decoder->gain);
+                }
+            }
+        }
+        window += info->group_len[g];
+    }
+}
+
+
+
+static bool read_individual_channel_stream(aac_decoder_t *decoder, bit_reader_t *reader, ics_t *ics, int32_t *spectrum,
+    bool common_window, const ics_t *left, const stereo_t *stereo) {
+    uint8_t global_gain = read_bits(reader, 8);
+    if (!common_window && !read_ics_info(reader, &ics->info)) return false;
+    if (!read_section_data(reader, ics)) return false;
+    if (!read_scale_factors(reader, ics, global_gain)) return false;
+
+    pulses_t pulses = { 0 };
+    if (read_bit(reader) && !read_pulse_data(reader, &ics->info, &pulses)) return false;
+    ics->tns_present = read_bit(reader);
+    if (ics->tns_present && !read_tns_data(reader, ics)) return false;
+    if (read_bit(reader)) return false;  // gain control, ssr profile only
+
+    memset(spectrum, 0, LONG_SAMPLES * sizeof(int32_t));
+    if (!read_spectral_data(reader, ics, spectrum)) return false;
+    for (int i = 0; i < pulses.count; i++) {
+        int32_t *value = &spectrum[pulses.position[i]];
+        *value += *value > 0 ? pulses.amplitude[i] : -pulses.amplitude[i];
+    }
+    dequantize(decoder, ics, spectrum, left, stereo);
+    return true;
+}
+
+
+// --- stereo, 4.6.8
+
+static void apply_mid_side(const ics_t *ics, const stereo_t *stereo, int32_t *left, int32_t *right, const ics_t *right_ics) {
+    const ics_info_t *info = &ics->info;
+    int idx = 0;
+    int window = 0;
+
+    for (int g = 0; g < info->num_groups; g++) {
+        for (int sfb = 0; sfb < info->max_sfb; sfb++, idx++) {
+            // not for noise and intensity bands
+            if (!stereo->ms_used[idx] || ics->band_type[idx] >= NOISE_HCB || right_ics->band_type[idx] >= NOISE_HCB) continue;
+            for (int w = window; w < window + info->group_len[g]; w++) {
+                for (int k = w * SHORT_SAMPLES + info->swb_offset[sfb]; k < w * SHORT_SAMPLES + info->swb_offset[sfb + 1]; k++) {
+                    int32_t mid = left[k];
+                    int32_t side = right[k];
+                    left[k] = mid + side;
+                    right[k] = mid - side;
+                }
+            }
+        }
+        window += info->group_len[g];
+    }
+}
+
+static void apply_intensity(const ics_t *ics, const stereo_t *stereo, const int32_t *left, int32_t *right) {
+    const ics_info_t *info = &ics->info;
+    int idx = 0;
+    int window = 0;
+
+    for (int g = 0; g < info->num_groups; g++) {
+        for (int sfb = 0; sfb < info->max_sfb; sfb++, idx++) {
+            uint8_t type = ics->band_type[idx];
+            if (type != INTENSITY_HCB && type != INTENSITY_HCB2) continue;
+
+            // right = left * 2^(-position / 4), in or out of phase
+            bool invert = (type == INTENSITY_HCB2) != (stereo->ms_mask_present && stereo->ms_used[idx]);
+            int exponent = -ics->scale_factor[idx];
+            int16_t mantissa = pow2_quarter[exponent & 3];
+            int shift = (exponent >> 2) + 16 - 14;
+            for (int w = window; w < window + info->group_len[g]; w++) {
+                for (int k = w * SHORT_SAMPLES + info->swb_offset[sfb]; k < w * SHORT_SAMPLES + info->swb_offset[sfb + 1]; k++) {
+                    int32_t value = shift_saturate(mul_q16(left[k], mantissa), shift);
+                    right[k] = invert ? -value : value;
+                }
+            }
+        }
+        window += info->group_len[g];
+    }
+}
+
+
+// --- temporal noise shaping, 4.6.9
+
+static void apply_tns(const ics_t *ics, uint8_t sampling_index, int32_t *spectrum) {
+    const ics_info_t *info = &ics->info;
+    const tns_t *tns = &ics->tns;
+    bool is_short = info->window_sequence == EIGHT_SHORT_SEQUENCE;
+    uint8_t max_band = tns_max_bands[sampling_index == SAMPLING_INDEX_44100][is_short];
+    if (max_band > info->max_sfb) {
+        max_band = info->max_sfb;
+    }
+
+    for (int w = 0; w < info->num_windows; w++) {
+        int bottom = info->num_swb;
+        for (int f = 0; f < tns->n_filt[w]; f++) {
+            int top = bottom;
+            bottom = top > tns->length[w][f] ? top - tns->length[w][f] : 0;
+            int order = tns->order[w][f];
+            if (!order) continue;
+
+            // reflection to lpc coefficients, Q24
+            const int32_t *table = tns->coef_res[w] ? &tns_coef_4[8] : &tns_coef_3[4];
+            int32_t lpc[TNS_MAX_ORDER + 1];
+            int32_t previous[TNS_MAX_ORDER + 1];
+            lpc[0] = 1 << 24;
+            for (int m = 1; m <= order; m++) {
+                int32_t k = table[tns->coef[w][f][m - 1]];
+                memcpy(previous, lpc, m * sizeof(int32_t));
+                for (int i = 1; i < m; i++) {
+                    int64_t a = previous[i] + (((int64_t)k * previous[m - i]) >> 31);
+                    lpc[i] = a > INT32_MAX ? INT32_MAX : a < -INT32_MAX ? -INT32_MAX : (int32_t)a;
+                }
+                lpc[m] = k >> 7;
+            }
+
+            int start = info->swb_offset[bottom < max_band ? bottom : max_band];
+            int end = info->swb_offset[top < max_band ? top : max_band];
+            if (end <= start) continue;
+            int size = end - start;
+            int increment = 1;
+            if (tns->direction[w][f]) {
+                increment = -1;
+                start = end - 1;
+            }
+
+            // all pole filter over the spectrum, in place: y(n) = x(n) - sum lpc(i) y(n - i)
+            int32_t *value = &spectrum[w * SHORT_SAMPLES + start];
+            for (int n = 0; n < size; n++, value += increment) {
+                int64_t sum = (int64_t)*value << 24;
+                int taps = n < order ? n : order;
+                for (int i = 1; i <= taps; i++) {
+                    sum -= (int64_t)lpc[i] * value[-i * increment];
+                }
+                sum = (sum + (1 << 23)) >> 24;
+                *value = sum > INT32_MAX ? INT32_MAX : sum < -INT32_MAX ? -INT32_MAX : (int32_t)sum;
+            }
+        }
+    }
+}
+
+
+// --- filterbank, 4.6.11
+
+// in place, n complex values (interleaved), the inverse transform halving every stage
+static void fft(int32_t *z, int n) {
+    // bit reversed order
+    for (int i = 0, j = 0; i < n; i++) {
+        if (i < j) {
+            int32_t re = z[2 * i], im = z[2 * i + 1];
+            z[2 * i] = z[2 * j];
+            z[2 * i + 1] = z[2 * j + 1];
+            z[2 * j] = re;
+            z[2 * j + 1] = im;
+        }
+        int bit = n >> 1;
+        while (bit && (j & bit)) {
+            j ^= bit;
+            bit >>= 1;
+        }
+        j |= bit;
+    }
+
+    for (int span = 1; span < n; span <<= 1) {
+        int step = FFT_SIZE / (2 * span);
+        for (int j = 0; j < span; j++) {
+            int16_t c = _tables.fft_twiddle[0][j * step];
+            int16_t s = _tables.fft_twiddle[1][j * step];
+            for (int i = j; i < n; i += 2 * span) {
+                int32_t *a = &z[2 * i];
+                int32_t *b = &z[2 * (i + span)];
+                // t = b * e^(2 pi i j / (2 span)) / 2
+                int32_t re, im;
+                if (j == 0) {
+                    re = b[0] >> 1;
+                    im = b[1] >> 1;
+                } else {
+                    re = mul_q16(b[0], c) - mul_q16(b[1], s);
+                    im = mul_q16(b[0], s) + mul_q16(b[1], c);
+                }
+                int32_t a_re = a[0] >> 1, a_im = a[1] >> 1;
+                a[0] = a_re + re;
+                a[1] = a_im + im;
+                b[0] = a_re - re;
+                b[1] = a_im - im;
+            }
+        }
+    }
+}
+
+// in place: n / 2 coefficients, Q4, to the n / 2 outputs in the middle of the imdct of size n, Q(OUT_SHIFT + 1).
+// The first quarter of the output is the negated mirror of the second, the last the mirror of the third
+static void imdct(int32_t *data, int n) {
+    int n2 = n / 2, n4 = n / 4, n8 = n / 8;
+    const int16_t *c = n == 2 * LONG_SAMPLES ? _tables.long_twiddle[0] : _tables.short_twiddle[0];
+    const int16_t *s = n == 2 * LONG_SAMPLES ? _tables.long_twiddle[1] : _tables.short_twiddle[1];
+
+    // block floating point: as many bits as the fft can take
+    int32_t max = 0;
+    for (int i = 0; i < n2; i++) {
+        int32_t magnitude = data[i] < 0 ? -data[i] : data[i];
+        max |= magnitude;
+    }
+    if (!max) return;
+    int norm = __builtin_clz((uint32_t)max) - (32 - NORM_BITS);
+
+    // pre rotation, pairs of complex values read and write the same 4 places
+    for (int k = 0; k < n4 / 2; k++) {
+        int k2 = n4 - 1 - k;
+        int32_t re = shift_saturate(data[n2 - 1 - 2 * k], norm), im = shift_saturate(data[2 * k], norm);
+        int32_t re2 = shift_saturate(data[n2 - 1 - 2 * k2], norm), im2 = shift_saturate(data[2 * k2], norm);
+        data[2 * k] = mul_q16(re, c[k]) - mul_q16(im, s[k]);
+        data[2 * k + 1] = mul_q16(re, s[k]) + mul_q16(im, c[k]);
+        data[2 * k2] = mul_q16(re2, c[k2]) - mul_q16(im2, s[k2]);
+        data[2 * k2 + 1] = mul_q16(re2, s[k2]) + mul_q16(im2, c[k2]);
+    }
+
+    fft(data, n4);
+
+    // post rotation, and back from the block exponent: 2 + log2(n4) halvings make 1 / n, the spec scales 2 / n
+    int shift = OUT_SHIFT + 1 - COEF_SHIFT + 1 - norm;
+    for (int k = 0; k < n8; k++) {
+        int a = n8 - 1 - k, b = n8 + k;
+        int32_t a_re = data[2 * a], a_im = data[2 * a + 1];
+        int32_t b_re = data[2 * b], b_im = data[2 * b + 1];
+        int32_t r0 = mul_q16(a_re, c[a]) - mul_q16(a_im, s[a]);
+        int32_t i1 = -(mul_q16(a_im, c[a]) + mul_q16(a_re, s[a]));
+        int32_t r1 = mul_q16(b_re, c[b]) - mul_q16(b_im, s[b]);
+        int32_t i0 = -(mul_q16(b_im, c[b]) + mul_q16(b_re, s[b]));
+        data[2 * a] = shift_saturate(r0, shift);
+        data[2 * a + 1] = shift_saturate(i0, shift);
+        data[2 * b] = shift_saturate(r1, shift);
+        data[2 * b + 1] = shift_saturate(i1, shift);
+    }
+}
+
+
+static inline int16_t round_output(int32_t value) {
+    value = (value >> OUT_SHIFT) + ((value >> (OUT_SHIFT - 1)) & 1);
+    return value < INT16_MIN ? INT16_MIN : value > INT16_MAX ? INT16_MAX : (int16_t)value;
+}
+
+// windowed imdct output of a long window: first half from h[0..512), second half from h[512..1024)
+static inline int32_t long_output(const int32_t *h, int n) {
+    if (n < LONG_SAMPLES / 2) return -h[LONG_SAMPLES / 2 - 1 - n];
+    if (n < 3 * LONG_SAMPLES / 2) return h[n - LONG_SAMPLES / 2];
+    return h[5 * LONG_SAMPLES / 2 - 1 - n];
+}
+
+static inline int32_t short_output(const int32_t *h, int n) {
+    if (n < SHORT_SAMPLES / 2) return -h[SHORT_SAMPLES / 2 - 1 - n];
+    if (n < 3 * SHORT_SAMPLES / 2) return h[n - SHORT_SAMPLES / 2];
+    return h[5 * SHORT_SAMPLES / 2 - 1 - n];
+}
+
+// imdct, windows and overlap of one channel into every second sample of pcm
+static void synthesize(aac_channel_t *channel, const ics_info_t *info, int16_t *pcm) {
+    int32_t *h = channel->spectrum;
+    int32_t *overlap = channel->overlap;
+    const int16_t *long_rise = _tables.long_window[channel->window_shape];
+    const int16_t *long_fall = _tables.long_window[info->window_shape];
+    const int16_t *short_rise = _tables.short_window[channel->window_shape];
+    const int16_t *short_fall = _tables.short_window[info->window_shape];
+    const int flat = (LONG_SAMPLES - SHORT_SAMPLES) / 2;  // 448, where short windows start in a long frame
+
+    if (info->window_sequence == EIGHT_SHORT_SEQUENCE) {
+        for (int w = 0; w < MAX_WINDOWS; w++) {
+            imdct(&h[w * SHORT_SAMPLES], 2 * SHORT_SAMPLES);
+        }
+        for (int n = 0; n < flat; n++) {
+            pcm[2 * n] = round_output(overlap[n]);
+        }
+        // blocks of 128 from 448 on: the rising half of window b and the falling half of window b - 1
+        for (int b = 0; b <= MAX_WINDOWS; b++) {
+            for (int j = 0; j < SHORT_SAMPLES; j++) {
+                int32_t value = 0;
+                if (b < MAX_WINDOWS) {
+                    value += mul_q16(short_output(&h[b * SHORT_SAMPLES], j), b ? _tables.short_window[info->window_shape][j] : short_rise[j]);
+                }
+                if (b > 0) {
+                    value += mul_q16(short_output(&h[(b - 1) * SHORT_SAMPLES], SHORT_SAMPLES + j), short_fall[SHORT_SAMPLES - 1 - j]);
+                }
+                int n = flat + b * SHORT_SAMPLES + j;
+                if (n < LONG_SAMPLES) {
+                    pcm[2 * n] = round_output(overlap[n] + value);
+                } else {
+                    overlap[n - LONG_SAMPLES] = value;
+                }
+            }
+        }
+        memset(&overlap[flat + SHORT_SAMPLES], 0, (LONG_SAMPLES - flat - SHORT_SAMPLES) * sizeof(int32_t));
+        channel->window_shape = info->window_shape;
+        return;
+    }
+
+    imdct(h, 2 * LONG_SAMPLES);
+
+    // first half onto the overlap
+    for (int n = 0; n < LONG_SAMPLES; n++) {
+        int32_t value;
+        if (info->window_sequence != LONG_STOP_SEQUENCE) {
+            value = mul_q16(long_output(h, n), long_rise[n]);
+        } else if (n < flat) {
+            value = 0;
+        } else if (n < flat + SHORT_SAMPLES) {
+            value = mul_q16(long_output(h, n), short_rise[n - flat]);
+        } else {
+            value = long_output(h, n) >> 1;
+        }
+        pcm[2 * n] = round_output(overlap[n] + value);
+    }
+
+    // second half is the next overlap
+    for (int n = 0; n < LONG_SAMPLES; n++) {
+        int32_t value;
+        if (info->window_sequence != LONG_START_SEQUENCE) {
+            value = mul_q16(long_output(h, LONG_SAMPLES + n), long_fall[LONG_SAMPLES - 1 - n]);
+        } else if (n < flat) {
+            value = long_output(h, LONG_SAMPLES + n) >> 1;
+        } else if (n < flat + SHORT_SAMPLES) {
+            value = mul_q16(long_output(h, LONG_SAMPLES + n), short_fall[SHORT_SAMPLES - 1 - (n - flat)]);
+        } else {
+            value = 0;
+        }
+        overlap[n] = value;
+    }
+    channel->window_shape = info->window_shape;
+}
+
+
+// --- elements, 4.4.2.1
+
+static bool skip_bits(bit_reader_t *reader, uint32_t num_bits) {
+    reader->position += num_bits;
+    return !overrun(reader);
+}
+
+static bool read_channel_pair(aac_decoder_t *decoder, bit_reader_t *reader, ics_t *ics, stereo_t *stereo) {
+    read_bits(reader, 4);  // element instance tag
+    bool common_window = read_bit(reader);
+    memset(stereo, 0, sizeof(*stereo));
+    if (common_window) {
+        if (!read_ics_info(reader, &ics[0].info)) return false;
+        stereo->ms_mask_present = read_bits(reader, 2);
+        if (stereo->ms_mask_present == 3) return false;
+        int num_bands = ics[0].info.num_groups * ics[0].info.max_sfb;
+        for (int idx = 0; idx < num_bands; idx++) {
+            stereo->ms_used[idx] = stereo->ms_mask_present == 2 ? 1 : read_bit(reader);
+        }
+        ics[1].info = ics[0].info;
+    }
+
+    if (!read_individual_channel_stream(decoder, reader, &ics[0], decoder->channel[0].spectrum, common_window, NULL, NULL)) return false;
+    if (!read_individual_channel_stream(decoder, reader, &ics[1], decoder->channel[1].spectrum, common_window, &ics[0], stereo)) return false;
+
+    if (common_window && stereo->ms_mask_present) {
+        apply_mid_side(&ics[0], stereo, decoder->channel[0].spectrum, decoder->channel[1].spectrum, &ics[1]);
+    }
+    apply_intensity(&ics[1], stereo, decoder->channel[0].spectrum, decoder->channel[1].spectrum);
+    return true;
+}
+
+static bool decode_raw_data_block(aac_decoder_t *decoder, bit_reader_t *reader, int16_t *pcm) {
+    ics_t *ics = _element.ics;
+    stereo_t *stereo = &_element.stereo;
+    int num_channels = 0;
+
+    for (;;) {
+        uint8_t id = read_bits(reader, 3);
+        if (id == ID_END) break;
+
+        switch (id) {
+            case ID_SCE:
+                if (num_channels) return false;
+                read_bits(reader, 4);  // element instance tag
+                if (!read_individual_channel_stream(decoder, reader, &ics[0], decoder->channel[0].spectrum, false, NULL, NULL)) return false;
+                num_channels = 1;
+                break;
+            case ID_CPE:
+                if (num_channels) return false;
+                if (!read_channel_pair(decoder, reader, ics, stereo)) return false;
+                num_channels = 2;
+                break;
+            case ID_FIL: {
+                uint32_t count = read_bits(reader, 4);
+                if (count == 15) {
+                    count += read_bits(reader, 8) - 1;
+                }
+                if (!skip_bits(reader, 8 * count)) return false;
+                break;
+            }
+            case ID_DSE: {
+                read_bits(reader, 4);  // element instance tag
+                bool align = read_bit(reader);
+                uint32_t count = read_bits(reader, 8);
+                if (count == 255) {
+                    count += read_bits(reader, 8);
+                }
+                if (align) {
+                    reader->position = (reader->position + 7) & ~7u;
+                }
+                if (!skip_bits(reader, 8 * count)) return false;
+                break;
+            }
+            default:
+                return false;  // coupling, lfe and program config are not for stereo
+        }
+        if (overrun(reader)) return false;
+    }
+    if (!num_channels) return false;
+
+    for (int c = 0; c < num_channels; c++) {
+        if (ics[c].tns_present) {
+            apply_tns(&ics[c], decoder->sampling_index, decoder->channel[c].spectrum);
+        }
+        synthesize(&decoder->channel[c], &ics[c].info, pcm + c);
+    }
+    if (num_channels == 1) {
+        for (int n = 0; n < LONG_SAMPLES; n++) {
+            pcm[2 * n + 1] = pcm[2 * n];
+        }
+    }
+    return true;
+}
+
+
+// --- latm, 1.7.3
+
+static uint32_t latm_get_value(bit_reader_t *reader) {
+    uint8_t bytes = read_bits(reader, 2) + 1;
+    uint32_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value = (value << 8) | read_bits(reader, 8);
+    }
+    return value;
+}
+
+// 1.6.2.1, only what lc in stereo or mono needs
+static bool read_audio_specific_config(aac_decoder_t *decoder, bit_reader_t *reader) {
+    uint8_t object_type = read_bits(reader, 5);
+    if (object_type == 31) {
+        object_type = 32 + read_bits(reader, 6);
+    }
+    uint8_t sampling_index = read_bits(reader, 4);
+    if (sampling_index == 15) {
+        read_bits(reader, 24);
+    }
+    uint8_t channel_configuration = read_bits(reader, 4);
+    if (object_type != AOT_AAC_LC ||
+        (sampling_index != SAMPLING_INDEX_44100 && sampling_index != SAMPLING_INDEX_48000) ||
+        (channel_configuration != 1 && channel_configuration != 2)) {
+        return false;
+    }
+
+    // GASpecificConfig
+    if (read_bit(reader)) return false;  // 960 sample frames
+    if (read_bit(reader)) {
+        read_bits(reader, 14);  // core coder delay
+    }
+    read_bit(reader);  // extension flag, nothing to extend for lc
+
+    decoder->sampling_index = sampling_index;
+    decoder->channel_configuration = channel_configuration;
+    return true;
+}
+
+static bool read_stream_mux_config(aac_decoder_t *decoder, bit_reader_t *reader) {
+    bool version = read_bit(reader);
+    if (version && read_bit(reader)) return false;  // audioMuxVersionA, reserved
+    if (version) {
+        latm_get_value(reader);  // taraBufferFullness
+    }
+    read_bit(reader);  // allStreamsSameTimeFraming
+    if (read_bits(reader, 6)) return false;  // numSubFrames, more than one access unit per element
+    if (read_bits(reader, 4)) return false;  // numProgram
+    if (read_bits(reader, 3)) return false;  // numLayer
+
+    if (version) {
+        uint32_t length = latm_get_value(reader);
+        uint32_t start = reader->position;
+        if (!read_audio_specific_config(decoder, reader)) return false;
+        if (!skip_bits(reader, length - (reader->position - start))) return false;
+    } else if (!read_audio_specific_config(decoder, reader)) {
+        return false;
+    }
+
+    if (read_bits(reader, 3)) return false;  // frameLengthType, only variable length payloads
+    read_bits(reader, 8);  // latmBufferFullness
+
+    if (read_bit(reader)) {  // otherDataPresent, the length is not needed, the other data comes last
+        if (version) {
+            latm_get_value(reader);
+        } else {
+            bool escape;
+            do {
+                escape = read_bit(reader);
+                read_bits(reader, 8);
+            } while (escape);
+        }
+    }
+    if (read_bit(reader)) {
+        read_bits(reader, 8);  // crc
+    }
+    return !overrun(reader);
+}
+
+
+// --- interface
+
+// I0(2 half) by its series
+static float bessel_i0(float half) {
+    float term = 1.0f, sum = 1.0f;
+    for (int k = 1; k < 50; k++) {
+        term *= half / k;
+        sum += term * term;
+    }
+    return sum;
+}
+
+// rising halves of the sine and kaiser bessel derived windows of 4.6.11.3.2, size values each
+static void init_windows(int16_t *sine, int16_t *kbd, int size, float alpha) {
+    const float pi = 3.14159265358979f;
+
+    // the kbd window is the root of the running sum of a kaiser window of size + 1 points
+    float total = 0.0f;
+    for (int n = 0; n <= size; n++) {
+        float x = (float)(n - size / 2) / (size / 2);
+        total += bessel_i0(pi * alpha * sqrtf(1.0f - x * x) / 2.0f);
+    }
+    float sum = 0.0f;
+    for (int n = 0; n < size; n++) {
+        float x = (float)(n - size / 2) / (size / 2);
+        sum += bessel_i0(pi * alpha * sqrtf(1.0f - x * x) / 2.0f);
+        float values[2] = { sinf(pi * (n + 0.5f) / (2 * size)), sqrtf(sum / total) };
+        int16_t *windows[2] = { sine, kbd };
+        for (int i = 0; i < 2; i++) {
+            int32_t value = (int32_t)lrintf(values[i] * 32768.0f);
+            windows[i][n] = value > INT16_MAX ? INT16_MAX : (int16_t)value;
+        }
+    }
+}
+
+
+static void init_tables(void) {
+    const float pi = 3.14159265358979f;
+
+    for (int i = 0; i <= LONG_SAMPLES; i++) {
+        _tables.pow43[i] = (int32_t)(powf((float)i, 4.0f / 3.0f) * (1 << 13) + 0.5f);
+    }
+    init_windows(_tables.long_window[0], _tables.long_window[1], LONG_SAMPLES, 4.0f);
+    init_windows(_tables.short_window[0], _tables.short_window[1], SHORT_SAMPLES, 6.0f);
+
+    for (int k = 0; k < LONG_SAMPLES / 2; k++) {
+        float angle = 2.0f * pi * (k + 0.125f) / (2 * LONG_SAMPLES);
+        _tables.long_twiddle[0][k] = (int16_t)lrintf(cosf(angle) * 32767.0f);
+        _tables.long_twiddle[1][k] = (int16_t)lrintf(sinf(angle) * 32767.0f);
+    }
+    for (int k = 0; k < SHORT_SAMPLES / 2; k++) {
+        float angle = 2.0f * pi * (k + 0.125f) / (2 * SHORT_SAMPLES);
+        _tables.short_twiddle[0][k] = (int16_t)lrintf(cosf(angle) * 32767.0f);
+        _tables.short_twiddle[1][k] = (int16_t)lrintf(sinf(angle) * 32767.0f);
+    }
+    for (int k = 0; k < FFT_SIZE / 2; k++) {
+        float angle = 2.0f * pi * k / FFT_SIZE;
+        _tables.fft_twiddle[0][k] = (int16_t)lrintf(cosf(angle) * 32767.0f);
+        _tables.fft_twiddle[1][k] = (int16_t)lrintf(sinf(angle) * 32767.0f);
+    }
+    _tables.ready = true;
+}
+
+
+void aac_decoder_init(aac_decoder_t *decoder) {
+    if (!_tables.ready) {
+        init_tables();
+    }
+    decoder->sampling_index = 0;
+    decoder->channel_configuration = 0;
+    decoder->mux_configured = false;
+    decoder->random = 0x1f2e3d4c;
+    decoder->gain = VOLUME_UNITY;
+    decoder->errors = 0;
+    aac_decoder_reset(decoder);
+}
+
+
+void aac_decoder_reset(aac_decoder_t *decoder) {
+    for (int c = 0; c < AAC_DECODER_CHANNELS; c++) {
+        memset(decoder->channel[c].overlap, 0, sizeof(decoder->channel[c].overlap));
+        decoder->channel[c].window_shape = 0;
+    }
+}
+
+
+void aac_decoder_set_gain(aac_decoder_t *decoder, int32_t gain) {
+    decoder->gain = gain;
+}
+
+
+bool aac_decoder_set_sampling_frequency(aac_decoder_t *decoder, uint32_t sampling_frequency) {
+    switch (sampling_frequency) {
+        case 44100: decoder->sampling_index = SAMPLING_INDEX_44100; return true;
+        case 48000: decoder->sampling_index = SAMPLING_INDEX_48000; return true;
+        default: return false;
+    }
+}
+
+
+uint32_t aac_decoder_decode(aac_decoder_t *decoder, const uint8_t *data, uint32_t size, int16_t *pcm) {
+    bit_reader_t reader = { data, size, 0 };
+    if (!decoder->sampling_index || !decode_raw_data_block(decoder, &reader, pcm)) {
+        decoder->errors++;
+        return 0;
+    }
+    return AAC_DECODER_FRAME_SAMPLES;
+}
+
+
+uint32_t aac_decoder_decode_latm(aac_decoder_t *decoder, const uint8_t *data, uint32_t size, int16_t *pcm) {
+    bit_reader_t reader = { data, size, 0 };
+
+    // AudioMuxElement(1)
+    if (!read_bit(&reader)) {  // useSameStreamMux
+        decoder->mux_configured = read_stream_mux_config(decoder, &reader);
+    }
+    if (!decoder->mux_configured) {
+        decoder->errors++;
+        return 0;
+    }
+
+    // PayloadLengthInfo, then the access unit
+    uint32_t length = 0;
+    uint8_t byte;
+    do {
+        byte = read_bits(&reader, 8);
+        length += byte;
+    } while (byte == 255 && !overrun(&reader));
+    if (reader.position + 8 * length > 8 * size) {
+        decoder->errors++;
+        return 0;
+    }
+    reader.size = (reader.position + 8 * length + 7) / 8;  // the payload is not byte aligned
+    if (!decode_raw_data_block(decoder, &reader, pcm)) {
+        decoder->errors++;
+        return 0;
+    }
+    return AAC_DECODER_FRAME_SAMPLES;
+}
+
+
+uint32_t aac_decoder_get_errors(const aac_decoder_t *decoder) {
+    return decoder->errors;
+}
+
+
+uint32_t aac_decoder_get_static_size(void) {
+    return sizeof(_tables) + sizeof(_element);
+}
@@ -0,0 +1,66 @@
+#ifndef aac_decoder_h
+#define aac_decoder_h
+
+// Fixed point MPEG-4 AAC-LC decoder for 44.1 and 48kHz, mono or stereo.
+// Huffman coded spectra are dequantized with the scale factors, joined by
+// mid/side and intensity stereo, filled with noise (pns), shaped by the tns
+// filters and transformed by an imdct with sine or kbd windows, long or 8 short.
+// Like the sbc decoder, the gain is folded into the dequantization, so the
+// filterbank directly produces scaled pcm without a per sample volume pass.
+// Spectra are Q4 in units of the 16 bit output; every imdct normalizes its
+// input (block floating point) and runs an fft with 32x16 bit products.
+// Access units come raw (e.g. from adts) or in the LATM AudioMuxElements of
+// a2dp (muxConfigPresent 1, one access unit each). Not supported: main, ssr
+// or ltp profile tools, program config elements, sbr/ps, more than 2 channels.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+#define AAC_DECODER_FRAME_SAMPLES  1024  // audio frames per access unit
+#define AAC_DECODER_CHANNELS       2     // output is always stereo, mono is duplicated
+
+
+typedef struct {
+    int32_t spectrum[AAC_DECODER_FRAME_SAMPLES];  // Q4, then the imdct output in place
+    int32_t overlap[AAC_DECODER_FRAME_SAMPLES];   // windowed second half of the last imdct, Q8
+    uint8_t window_shape;                         // of the last frame, 1 for kbd
+} aac_channel_t;
+
+typedef struct {
+    aac_channel_t channel[AAC_DECODER_CHANNELS];
+    uint8_t  sampling_index;   // 3 for 48kHz, 4 for 44.1kHz, 0 if not configured
+    uint8_t  channel_configuration;
+    bool     mux_configured;   // a StreamMuxConfig has been seen
+    uint32_t random;           // noise substitution
+    int32_t  gain;             // Q15, VOLUME_UNITY passes the audio unchanged
+    uint32_t errors;           // access units that could not be decoded
+} aac_decoder_t;
+
+
+void aac_decoder_init(aac_decoder_t *decoder);
+
+// forget the overlap of the filterbank, e.g. after a pause
+void aac_decoder_reset(aac_decoder_t *decoder);
+
+// applies from the next access unit on
+void aac_decoder_set_gain(aac_decoder_t *decoder, int32_t gain);
+
+// for raw access units, LATM brings its own configuration. false if the rate is not supported
+bool aac_decoder_set_sampling_frequency(aac_decoder_t *decoder, uint32_t sampling_frequency);
+
+// decode a raw_data_block into AAC_DECODER_FRAME_SAMPLES interleaved stereo audio frames,
+// returns the audio frames, 0 if it is corrupt or uses unsupported tools, then pcm is unchanged
+uint32_t aac_decoder_decode(aac_decoder_t *decoder, const uint8_t *data, uint32_t size, int16_t *pcm);
+
+// same for an AudioMuxElement with in band StreamMuxConfig (the a2dp payload after the rtp header)
+uint32_t aac_decoder_decode_latm(aac_decoder_t *decoder, const uint8_t *data, uint32_t size, int16_t *pcm);
+
+// access units that failed so far
+uint32_t aac_decoder_get_errors(const aac_decoder_t *decoder);
+
+// bytes of static ram all decoders share: the tables the first aac_decoder_init() computes
+// and the parse state of an access unit, so only one decoder at a time may decode
+uint32_t aac_decoder_get_static_size(void);
+
+#endif
@@ -0,0 +1,393 @@
+#include "aptx_decoder.h"
+
+#include <string.h>
+
+#include "volume.h"
+
+
+// A port of the reference decoder, every shift and rounding as there.
+// Samples are 24 bit, multiplications of two of them need 64 bits.
+
+#define LF  0
+#define MLF 1
+#define MHF 2
+#define HF  3
+
+
+// half band qmf of the outer (full band) and inner (half band) stage, by polyphase branch
+static const int32_t qmf_outer[2][APTX_DECODER_FILTER_TAPS] = {
+    {    730,    -413,   -9611,   43626, -121026,  269973, -585547, 2801966,
+      697128, -160481,   27611,    8478,  -10043,    3511,     688,    -897 },
+    {   -897,     688,    3511,  -10043,    8478,   27611, -160481,  697128,
+     2801966, -585547,  269973, -121026,   43626,   -9611,    -413,     730 },
+};
+static const int32_t qmf_inner[2][APTX_DECODER_FILTER_TAPS] = {
+    {   1033,    -584,  -13592,   61697, -171156,  381799, -828088, 3962579,
+      985888, -226954,   39048,   11990,  -14203,    4966,     973,   -1268 },
+    {  -1268,     973,    4966,  -14203,   11990,   39048, -226954,  985888,
+     3962579, -828088,  381799, -171156,   61697,  -13592,    -584,    1033 },
+};
+
+// step size mantissas, 2048 * 2^(i / 32)
+static const int16_t quantization_factors[32] = {
+    2048, 2093, 2139, 2186, 2233, 2282, 2332, 2383, 2435, 2489, 2543, 2599, 2656, 2714, 2774, 2834,
+    2896, 2960, 3025, 3091, 3158, 3228, 3298, 3371, 3444, 3520, 3597, 3676, 3756, 3838, 3922, 4008,
+};
+
+// per subband: reconstruction levels (index 0 is only used by encoders), how much the dither
+// moves them, and how each level adapts the step size
+static const int32_t intervals_LF[65] = {
+      -9948,    9948,   29860,   49808,   69822,   89926,  110144,  130502,
+     151026,  171738,  192666,  213832,  235264,  256982,  279014,  301384,
+     324118,  347244,  370790,  394782,  419250,  444226,  469742,  495832,
+     522536,  549890,  577936,  606720,  636290,  666700,  698006,  730270,
+     763562,  797958,  833538,  870398,  908640,  948376,  989740, 1032874,
+    1077948, 1125150, 1174700, 1226850, 1281900, 1340196, 1402156, 1468282,
+    1539182, 1615610, 1698514, 1789098, 1888944, 2000168, 2125700, 2269750,
+    2438670, 2642660, 2899462, 3243240, 3746078, 4535138, 5664098, 7102424,
+    8897462,
+};
+
+static const int32_t dither_factors_LF[65] = {
+       9948,    9948,    9962,    9988,   10026,   10078,   10142,   10218,
+      10306,   10408,   10520,   10646,   10784,   10934,   11098,   11274,
+      11462,   11664,   11880,   12112,   12358,   12618,   12898,   13194,
+      13510,   13844,   14202,   14582,   14988,   15422,   15884,   16380,
+      16912,   17484,   18098,   18762,   19480,   20258,   21106,   22030,
+      23044,   24158,   25390,   26760,   28290,   30008,   31954,   34172,
+      36728,   39700,   43202,   47382,   52462,   58762,   66770,   77280,
+      91642,  112348,  144452,  199326,  303512,  485546,  643414,  794914,
+    1000124,
+};
+
+static const int16_t select_offsets_LF[65] = {
+      0, -21, -19, -17, -15, -12, -10,  -8,  -6,  -4,  -1,   1,   3,   6,   8,  10,
+     13,  15,  18,  20,  23,  26,  29,  31,  34,  37,  40,  43,  47,  50,  53,  57,
+     60,  64,  68,  72,  76,  80,  85,  89,  94,  99, 105, 110, 116, 123, 129, 136,
+    144, 152, 161, 171, 182, 194, 207, 223, 241, 263, 291, 328, 382, 467, 522, 522,
+    522,
+};
+
+static const int32_t intervals_MLF[9] = {
+     -89806,   89806,  278502,  494338,  759442, 1113112, 1652322, 2720256,
+    5190186,
+};
+
+static const int32_t dither_factors_MLF[9] = {
+      89806,   89806,   98890,  116946,  148158,  205512,  333698,  734236,
+    1735696,
+};
+
+static const int16_t select_offsets_MLF[9] = {
+      0, -14,   6,  29,  58,  96, 154, 270, 521,
+};
+
+static const int32_t intervals_MHF[3] = {
+    -194080,  194080,  890562,
+};
+
+static const int32_t dither_factors_MHF[3] = {
+     194080,  194080,  502402,
+};
+
+static const int16_t select_offsets_MHF[3] = {
+      0, -33, 136,
+};
+
+static const int32_t intervals_HF[5] = {
+    -163006,  163006,  542708, 1120554, 2669238,
+};
+
+static const int32_t dither_factors_HF[5] = {
+     163006,  163006,  216698,  361148, 1187538,
+};
+
+static const int16_t select_offsets_HF[5] = {
+      0,  -8,  33,  95, 262,
+};
+
+typedef struct {
+    const int32_t *intervals;
+    const int32_t *dither_factors;
+    const int16_t *select_offsets;
+    int32_t factor_max;
+    uint8_t order;  // of the zero predictor
+} subband_tables_t;
+
+static const subband_tables_t tables[APTX_DECODER_SUBBANDS] = {
+    [LF]  = { intervals_LF,  dither_factors_LF,  select_offsets_LF,  0x11FF, 24 },
+    [MLF] = { intervals_MLF, dither_factors_MLF, select_offsets_MLF, 0x14FF, 12 },
+    [MHF] = { intervals_MHF, dither_factors_MHF, select_offsets_MHF, 0x16FF,  6 },
+    [HF]  = { intervals_HF,  dither_factors_HF,  select_offsets_HF,  0x15FF, 12 },
+};
+
+
+static inline int32_t clip(int32_t value, int32_t min, int32_t max) {
+    return value < min ? min : value > max ? max : value;
+}
+
+
+static inline int32_t clip24(int64_t value) {
+    return value < -(1 << 23) ? -(1 << 23) : value > (1 << 23) - 1 ? (1 << 23) - 1 : (int32_t)value;
+}
+
+
+// rounded right shift, ties to even
+static inline int32_t rshift32(int32_t value, int shift) {
+    int32_t rounding = (int32_t)1 << (shift - 1);
+    int32_t mask = ((int32_t)1 << (shift + 1)) - 1;
+    return ((value + rounding) >> shift) - ((value & mask) == rounding);
+}
+
+
+static inline int64_t rshift64(int64_t value, int shift) {
+    int64_t rounding = (int64_t)1 << (shift - 1);
+    int64_t mask = ((int64_t)1 << (shift + 1)) - 1;
+    return ((value + rounding) >> shift) - ((value & mask) == rounding);
+}
+
+
+static inline int32_t sign(int32_t value) {
+    return (value > 0) - (value < 0);
+}
+
+
+static inline int32_t sign_extend(uint32_t value, int bits) {
+    return (int32_t)(value << (32 - bits)) >> (32 - bits);
+}
+
+
+static inline void filter_push(aptx_filter_t *filter, int32_t sample) {
+    filter->buffer[filter->pos] = sample;
+    filter->buffer[filter->pos + APTX_DECODER_FILTER_TAPS] = sample;
+    filter->pos = (filter->pos + 1) & (APTX_DECODER_FILTER_TAPS - 1);
+}
+
+
+static inline int32_t filter_convolve(const aptx_filter_t *filter, const int32_t *coeffs, int shift) {
+    const int32_t *signal = &filter->buffer[filter->pos];
+    int64_t sum = 0;
+    for (int i = 0; i < APTX_DECODER_FILTER_TAPS; i++) {
+        sum += (int64_t)signal[i] * coeffs[i];
+    }
+    return clip24(rshift64(sum, shift));
+}
+
+
+// join a low and a high band into two samples at twice the rate
+static inline void qmf_synthesis(aptx_filter_t filter[2], const int32_t coeffs[2][APTX_DECODER_FILTER_TAPS], int shift,
+    int32_t low, int32_t high, int32_t samples[2]) {
+    filter_push(&filter[0], low - high);
+    filter_push(&filter[1], low + high);
+    samples[0] = filter_convolve(&filter[0], coeffs[0], shift);
+    samples[1] = filter_convolve(&filter[1], coeffs[1], shift);
+}
+
+
+// the 4 subbands of a codeword make 4 samples
+static void synthesize(aptx_channel_t *channel, int32_t samples[APTX_DECODER_CODEWORD_SAMPLES]) {
+    int32_t halves[4];
+    qmf_synthesis(channel->inner[0], qmf_inner, 22, channel->subband[LF].reconstructed_sample,
+        channel->subband[MLF].reconstructed_sample, &halves[0]);
+    qmf_synthesis(channel->inner[1], qmf_inner, 22, channel->subband[MHF].reconstructed_sample,
+        channel->subband[HF].reconstructed_sample, &halves[2]);
+    qmf_synthesis(channel->outer, qmf_outer, 21, halves[0], halves[2], &samples[0]);
+    qmf_synthesis(channel->outer, qmf_outer, 21, halves[1], halves[3], &samples[2]);
+}
+
+
+// pseudo random dither from the codewords so far, the encoder did the same
+static void generate_dither(aptx_channel_t *channel) {
+    int32_t history = ((channel->subband[LF].quantized & 3) << 0) +
+                      ((channel->subband[MLF].quantized & 2) << 1) +
+                      ((channel->subband[MHF].quantized & 1) << 3);
+    channel->codeword_history = (int32_t)((uint32_t)history << 8) + (int32_t)((uint32_t)channel->codeword_history << 4);
+
+    int64_t m = (int64_t)5184443 * (channel->codeword_history >> 7);
+    int32_t d = (int32_t)(uint32_t)((m * 4) + (m >> 22));
+    for (int i = 0; i < APTX_DECODER_SUBBANDS; i++) {
+        channel->dither[i] = (int32_t)((uint32_t)d << (23 - 5 * i));
+    }
+    channel->dither_parity = (d >> 25) & 1;
+}
+
+
+static int32_t parity(const aptx_channel_t *channel) {
+    int32_t parity = channel->dither_parity;
+    for (int i = 0; i < APTX_DECODER_SUBBANDS; i++) {
+        parity ^= channel->subband[i].quantized;
+    }
+    return parity & 1;
+}
+
+
+// 7, 4, 2 and 3 bits of LF, MLF, MHF and HF, the lowest bit of HF is the parity
+static void unpack(aptx_channel_t *channel, uint16_t codeword) {
+    channel->subband[LF].quantized  = sign_extend(codeword >>  0, 7);
+    channel->subband[MLF].quantized = sign_extend(codeword >>  7, 4);
+    channel->subband[MHF].quantized = sign_extend(codeword >> 11, 2);
+    channel->subband[HF].quantized  = sign_extend(codeword >> 13, 3);
+    channel->subband[HF].quantized  = (channel->subband[HF].quantized & ~1) | parity(channel);
+}
+
+
+static void invert_quantization(aptx_subband_t *subband, int32_t dither, const subband_tables_t *table) {
+    int32_t quantized = subband->quantized;
+    int32_t index = (quantized ^ -(quantized < 0)) + 1;
+    int32_t level = table->intervals[index] / 2;
+    if (quantized < 0) level = -level;
+
+    level = clip24(rshift64((int64_t)level * ((int64_t)1 << 32) + (int64_t)dither * table->dither_factors[index], 32));
+    subband->reconstructed_difference = (int32_t)(((int64_t)subband->quantization_factor * level) >> 19);
+
+    // step size follows the levels used
+    int32_t factor_select = 32620 * subband->factor_select;
+    factor_select = rshift32(factor_select + table->select_offsets[index] * (1 << 15), 15);
+    subband->factor_select = clip(factor_select, 0, table->factor_max);
+
+    index = (subband->factor_select & 0xFF) >> 3;
+    int shift = (table->factor_max - subband->factor_select) >> 8;
+    subband->quantization_factor = (quantization_factors[index] << 11) >> shift;
+}
+
+
+static void predict(aptx_subband_t *subband, uint8_t order) {
+    int32_t difference = subband->reconstructed_difference;
+
+    // pole part, two taps of reconstructed samples
+    int32_t reconstructed = clip24((int64_t)difference + subband->predicted_sample);
+    int32_t predictor = clip24(((int64_t)subband->s_weight[0] * subband->reconstructed_sample +
+                                (int64_t)subband->s_weight[1] * reconstructed) >> 22);
+    subband->reconstructed_sample = reconstructed;
+
+    // zero part, order taps of reconstructed differences, the newest at differences[order + pos]
+    int32_t *older = subband->differences;
+    int32_t *newer = older + order;
+    older[subband->pos] = newer[subband->pos];
+    subband->pos = subband->pos + 1 < order ? subband->pos + 1 : 0;
+    newer[subband->pos] = difference;
+    int32_t *differences = &newer[subband->pos];
+
+    int32_t sign0 = sign(difference) * (1 << 23);
+    int64_t predicted = 0;
+    for (int i = 0; i < order; i++) {
+        int32_t sign1 = (differences[-i - 1] >> 31) | 1;
+        subband->d_weight[i] -= rshift32(subband->d_weight[i] - sign1 * sign0, 8);
+        predicted += (int64_t)differences[-i] * subband->d_weight[i];
+    }
+    subband->predicted_difference = clip24(predicted >> 22);
+    subband->predicted_sample = clip24((int64_t)predictor + subband->predicted_difference);
+}
+
+
+static void process_subband(aptx_subband_t *subband, int32_t dither, const subband_tables_t *table) {
+    invert_quantization(subband, dither, table);
+
+    // adapt the pole weights to the sign changes of the reconstructed signal
+    int32_t s = sign(subband->reconstructed_difference + subband->predicted_difference);
+    int32_t same_sign[2] = { s * subband->prev_sign[0], s * subband->prev_sign[1] };
+    subband->prev_sign[0] = subband->prev_sign[1];
+    subband->prev_sign[1] = s | 1;
+
+    int32_t sw1 = rshift32(-same_sign[1] * subband->s_weight[1], 1);
+    sw1 = (clip(sw1, -0x100000, 0x100000) & ~0xF) * 16;
+
+    int32_t weight = 254 * subband->s_weight[0] + 0x800000 * same_sign[0] + sw1;
+    subband->s_weight[0] = clip(rshift32(weight, 8), -0x300000, 0x300000);
+
+    int32_t range = 0x3C0000 - subband->s_weight[0];
+    weight = 255 * subband->s_weight[1] + 0xC00000 * same_sign[1];
+    subband->s_weight[1] = clip(rshift32(weight, 8), -range, range);
+
+    predict(subband, table->order);
+}
+
+
+// one codeword of each channel into 4 samples per channel, 24 bit
+static void decode_codeword(aptx_decoder_t *decoder, const uint8_t *data, int32_t samples[APTX_DECODER_CHANNELS][APTX_DECODER_CODEWORD_SAMPLES]) {
+    for (int c = 0; c < APTX_DECODER_CHANNELS; c++) {
+        aptx_channel_t *channel = &decoder->channel[c];
+        generate_dither(channel);
+        unpack(channel, (data[2 * c] << 8) | data[2 * c + 1]);
+        for (int i = 0; i < APTX_DECODER_SUBBANDS; i++) {
+            process_subband(&channel->subband[i], channel->dither[i], &tables[i]);
+        }
+    }
+
+    // the parities of both channels are even, except for every 8th codeword
+    bool eighth = decoder->sync_index == 7;
+    decoder->sync_index = (decoder->sync_index + 1) & 7;
+    if ((parity(&decoder->channel[0]) ^ parity(&decoder->channel[1])) != eighth) {
+        decoder->sync_errors++;
+    }
+
+    for (int c = 0; c < APTX_DECODER_CHANNELS; c++) {
+        synthesize(&decoder->channel[c], samples[c]);
+    }
+}
+
+
+void aptx_decoder_init(aptx_decoder_t *decoder) {
+    decoder->gain = VOLUME_UNITY;
+    decoder->sync_errors = 0;
+    aptx_decoder_reset(decoder);
+}
+
+
+void aptx_decoder_reset(aptx_decoder_t *decoder) {
+    memset(decoder->channel, 0, sizeof(decoder->channel));
+    for (int c = 0; c < APTX_DECODER_CHANNELS; c++) {
+        for (int i = 0; i < APTX_DECODER_SUBBANDS; i++) {
+            decoder->channel[c].subband[i].prev_sign[0] = 1;
+            decoder->channel[c].subband[i].prev_sign[1] = 1;
+        }
+    }
+    decoder->sync_index = 0;
+}
+
+
+void aptx_decoder_set_gain(aptx_decoder_t *decoder, int32_t gain) {
+    decoder->gain = gain;
+}
+
+
+uint32_t aptx_decoder_decode(aptx_decoder_t *decoder, const uint8_t *data, uint32_t size, int16_t *pcm) {
+    int32_t samples[APTX_DECODER_CHANNELS][APTX_DECODER_CODEWORD_SAMPLES];
+    uint32_t codewords = size / APTX_DECODER_CODEWORD_SIZE;
+
+    // 24 bit times Q15 gain, rounded to 16 bit
+    const int shift = 8 + VOLUME_SHIFT;
+    for (uint32_t n = 0; n < codewords; n++) {
+        decode_codeword(decoder, data, samples);
+        for (int i = 0; i < APTX_DECODER_CODEWORD_SAMPLES; i++) {
+            for (int c = 0; c < APTX_DECODER_CHANNELS; c++) {
+                int64_t sample = ((int64_t)samples[c][i] * decoder->gain + ((int64_t)1 << (shift - 1))) >> shift;
+                *pcm++ = sample < INT16_MIN ? INT16_MIN : sample > INT16_MAX ? INT16_MAX : (int16_t)sample;
+            }
+        }
+        data += APTX_DECODER_CODEWORD_SIZE;
+    }
+    return codewords * APTX_DECODER_CODEWORD_SAMPLES;
+}
+
+
+uint32_t aptx_decoder_decode_24(aptx_decoder_t *decoder, const uint8_t *data, uint32_t size, int32_t *pcm) {
+    int32_t samples[APTX_DECODER_CHANNELS][APTX_DECODER_CODEWORD_SAMPLES];
+    uint32_t codewords = size / APTX_DECODER_CODEWORD_SIZE;
+
+    for (uint32_t n = 0; n < codewords; n++) {
+        decode_codeword(decoder, data, samples);
+        for (int i = 0; i < APTX_DECODER_CODEWORD_SAMPLES; i++) {
+            for (int c = 0; c < APTX_DECODER_CHANNELS; c++) {
+                *pcm++ = samples[c][i];
+            }
+        }
+        data += APTX_DECODER_CODEWORD_SIZE;
+    }
+    return codewords * APTX_DECODER_CODEWORD_SAMPLES;
+}
+
+
+uint32_t aptx_decoder_get_sync_errors(const aptx_decoder_t *decoder) {
+    return decoder->sync_errors;
+}
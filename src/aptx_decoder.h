@@ -0,0 +1,81 @@
+#ifndef aptx_decoder_h
+#define aptx_decoder_h
+
+// Fixed point aptX (classic, not HD) decoder.
+// Every 16 bit codeword carries 4 subbands of one channel, adpcm coded:
+// inverse quantization with an adaptive step, a pole-zero predictor per
+// subband, then a two stage qmf tree joins the subbands into 4 samples.
+// Bit exact with the decoder of ffmpeg (and libfreeaptx, same arithmetic), which give
+// 24 bit samples. The 16 bit output applies the gain while rounding those,
+// so volume costs no extra pass and quiet listening keeps its resolution.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+#define APTX_DECODER_CHANNELS     2
+#define APTX_DECODER_SUBBANDS     4
+#define APTX_DECODER_CODEWORD_SIZE (2 * APTX_DECODER_CHANNELS)  // bytes, big endian, left first
+#define APTX_DECODER_CODEWORD_SAMPLES 4                          // audio frames per codeword
+
+#define APTX_DECODER_FILTER_TAPS  16
+#define APTX_DECODER_MAX_ORDER    24  // of the zero predictor, in the lowest subband
+
+
+typedef struct {
+    int32_t buffer[2 * APTX_DECODER_FILTER_TAPS];  // every sample twice, so the taps are contiguous
+    uint8_t pos;
+} aptx_filter_t;
+
+typedef struct {
+    // inverse quantization
+    int32_t quantized;
+    int32_t quantization_factor;
+    int32_t factor_select;
+    int32_t reconstructed_difference;
+    // prediction
+    int32_t prev_sign[2];
+    int32_t s_weight[2];
+    int32_t d_weight[APTX_DECODER_MAX_ORDER];
+    int32_t differences[2 * APTX_DECODER_MAX_ORDER];  // every one twice, like the filters
+    uint8_t pos;
+    int32_t reconstructed_sample;
+    int32_t predicted_difference;
+    int32_t predicted_sample;
+} aptx_subband_t;
+
+typedef struct {
+    int32_t codeword_history;
+    int32_t dither_parity;
+    int32_t dither[APTX_DECODER_SUBBANDS];
+    aptx_subband_t subband[APTX_DECODER_SUBBANDS];
+    aptx_filter_t inner[2][2];  // synthesis of the low and the high half
+    aptx_filter_t outer[2];
+} aptx_channel_t;
+
+typedef struct {
+    aptx_channel_t channel[APTX_DECODER_CHANNELS];
+    uint8_t  sync_index;    // every 8th codeword has odd parity
+    uint32_t sync_errors;   // codewords with the wrong parity
+    int32_t  gain;          // Q15, VOLUME_UNITY passes the audio unchanged
+} aptx_decoder_t;
+
+
+void aptx_decoder_init(aptx_decoder_t *decoder);
+
+// forget the adpcm and filter state, e.g. after a pause
+void aptx_decoder_reset(aptx_decoder_t *decoder);
+
+// applies from the next call on
+void aptx_decoder_set_gain(aptx_decoder_t *decoder, int32_t gain);
+
+// decode the whole codewords in size bytes into interleaved stereo pcm, returns the audio frames
+uint32_t aptx_decoder_decode(aptx_decoder_t *decoder, const uint8_t *data, uint32_t size, int16_t *pcm);
+
+// same, but the 24 bit samples of the reference decoders, without gain
+uint32_t aptx_decoder_decode_24(aptx_decoder_t *decoder, const uint8_t *data, uint32_t size, int32_t *pcm);
+
+// codewords that failed the parity check so far, a hint for corrupt or misaligned data
+uint32_t aptx_decoder_get_sync_errors(const aptx_decoder_t *decoder);
+
+#endif
@@ -1,9 +1,12 @@
 #include "avrcp.h"
 
+#include "timing.h"
+#include "trace.h"
+
 
 static uint16_t _cid = 0;
 static bool _playing = false;
-static uint8_t _volume = 0;
+static uint8_t _volume = 127;  // full until the source sets one, 0 mutes
 
 
 static void avrcp_volume_changed(uint8_t volume){
@@ -24,6 +27,8 @@ static void connection_handler(uint8_t packet_type, uint16_t channel, uint8_t *p
     if (packet_type != HCI_EVENT_PACKET) return;
     if (hci_event_packet_get_type(packet) != HCI_EVENT_AVRCP_META) return;
 
+    trace_bt(TRACE_AVRCP, packet[2], little_endian_read_16(packet, 3));  // connection subevents start with the cid
+
     switch (packet[2]) {
         case AVRCP_SUBEVENT_CONNECTION_ESTABLISHED:
             cid = avrcp_subevent_connection_established_get_avrcp_cid(packet);
@@ -117,6 +122,7 @@ static void target_handler(uint8_t packet_type, uint16_t channel, uint8_t *packe
     switch (packet[2]){
         case AVRCP_SUBEVENT_NOTIFICATION_VOLUME_CHANGED:
             _volume = avrcp_subevent_notification_volume_changed_get_absolute_volume(packet);
+            trace_bt(TRACE_AVRCP, packet[2], _volume);
             // volume_percentage = volume * 100 / 127;
             // printf("AVRCP Target    : Volume set to %d%% (%d)\n", volume_percentage, volume);
             avrcp_volume_changed(_volume);
@@ -144,14 +150,34 @@ static void target_handler(uint8_t packet_type, uint16_t channel, uint8_t *packe
 }
 
 
+// as registered, so each handler is timed as a whole
+static void timed_connection_handler(uint8_t packet_type, uint16_t channel, uint8_t *packet, uint16_t size) {
+    TIMING_BEGIN(TIMING_AVRCP);
+    connection_handler(packet_type, channel, packet, size);
+    TIMING_END(TIMING_AVRCP);
+}
+
+static void timed_controller_handler(uint8_t packet_type, uint16_t channel, uint8_t *packet, uint16_t size) {
+    TIMING_BEGIN(TIMING_AVRCP);
+    controller_handler(packet_type, channel, packet, size);
+    TIMING_END(TIMING_AVRCP);
+}
+
+static void timed_target_handler(uint8_t packet_type, uint16_t channel, uint8_t *packet, uint16_t size) {
+    TIMING_BEGIN(TIMING_AVRCP);
+    target_handler(packet_type, channel, packet, size);
+    TIMING_END(TIMING_AVRCP);
+}
+
+
 void avrcp_begin() {
     avrcp_init();
     avrcp_controller_init();
     avrcp_target_init();
 
-    avrcp_register_packet_handler(connection_handler);
-    avrcp_controller_register_packet_handler(controller_handler);
-    avrcp_target_register_packet_handler(target_handler);
+    avrcp_register_packet_handler(timed_connection_handler);
+    avrcp_controller_register_packet_handler(timed_controller_handler);
+    avrcp_target_register_packet_handler(timed_target_handler);
 }
 
 
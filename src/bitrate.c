@@ -0,0 +1,147 @@
+#include "bitrate.h"
+
+
+#define WINDOW_MS          1000
+#define LOSS_PERCENT       5     // of the packets of a window
+#define LATE_MS            100   // arrival spread, about what the jitter buffer can take on a busy band
+#define HOLD_WINDOWS       5     // after a change, the stream restarts in between
+#define STABLE_WINDOWS     60    // before the first step up
+#define MAX_STABLE_WINDOWS 960   // a step up that keeps failing is tried every 16 minutes
+#define PROVEN_WINDOWS     30    // a step up that lasts that long is fine
+
+
+// max bitpools to step through, 35 and 53 are middle and high quality of the a2dp spec
+static const uint8_t _ladder[] = { 35, 45, 53 };
+
+
+static uint8_t step_down(uint8_t max_bitpool) {
+    for (int i = sizeof(_ladder) - 1; i >= 0; i--) {
+        if (_ladder[i] < max_bitpool) return _ladder[i];
+    }
+    return 0;
+}
+
+
+static uint8_t step_up(uint8_t max_bitpool, uint8_t ceiling) {
+    for (unsigned i = 0; i < sizeof(_ladder); i++) {
+        if (_ladder[i] > max_bitpool) return _ladder[i] < ceiling ? _ladder[i] : ceiling;
+    }
+    return max_bitpool < ceiling ? ceiling : 0;
+}
+
+
+void bitrate_init(bitrate_t *bitrate, uint8_t ceiling) {
+    bitrate->ceiling = ceiling;
+    bitrate->bad_windows = 0;
+    bitrate->steps_down = 0;
+    bitrate->steps_up = 0;
+    bitrate_reset(bitrate);
+}
+
+
+void bitrate_reset(bitrate_t *bitrate) {
+    bitrate->configured = 0;
+    bitrate->requested = 0;
+    bitrate->refused = false;
+    bitrate->good_windows = 0;
+    bitrate->stable_windows = STABLE_WINDOWS;
+    bitrate->stepped_up = false;
+    bitrate_restart(bitrate);
+}
+
+
+void bitrate_set_ceiling(bitrate_t *bitrate, uint8_t ceiling) {
+    bitrate->ceiling = ceiling;
+}
+
+
+void bitrate_restart(bitrate_t *bitrate) {
+    bitrate->started = false;
+    bitrate->hold_windows = HOLD_WINDOWS;
+}
+
+
+static void start_window(bitrate_t *bitrate, uint32_t now_ms, uint32_t lost_packets, uint32_t underrun_frames,
+                         uint32_t spread_ms) {
+    bitrate->started = true;
+    bitrate->window_start_ms = now_ms;
+    bitrate->packets = 0;
+    bitrate->lost_packets = lost_packets;
+    bitrate->underrun_frames = underrun_frames;
+    bitrate->spread_ms = spread_ms;
+    bitrate->max_spread_ms = spread_ms;
+}
+
+
+uint8_t bitrate_update(bitrate_t *bitrate, uint32_t now_ms, uint32_t lost_packets, uint32_t underrun_frames,
+                       uint32_t spread_ms, uint8_t current_max) {
+    if (!bitrate->started) {
+        start_window(bitrate, now_ms, lost_packets, underrun_frames, spread_ms);
+    }
+    bitrate->packets++;
+    if (spread_ms > bitrate->max_spread_ms) bitrate->max_spread_ms = spread_ms;
+    if (now_ms - bitrate->window_start_ms < WINDOW_MS) return 0;
+
+    uint32_t lost = lost_packets - bitrate->lost_packets;
+    bool bad = underrun_frames != bitrate->underrun_frames ||
+               lost * 100 >= LOSS_PERCENT * (bitrate->packets + lost) ||
+               (bitrate->max_spread_ms > bitrate->spread_ms && bitrate->max_spread_ms >= LATE_MS);
+    start_window(bitrate, now_ms, lost_packets, underrun_frames, spread_ms);
+
+    if (bitrate->hold_windows) {
+        bitrate->hold_windows--;
+        return 0;
+    }
+    if (bad) bitrate->bad_windows++;
+
+    // a request the source did not follow is not repeated, every try suspends the stream
+    if (bitrate->requested && bitrate->requested != current_max) {
+        bitrate->refused = true;
+    }
+    if (bitrate->refused) return 0;
+
+    if (bad) {
+        bitrate->good_windows = 0;
+        if (bitrate->stepped_up) {
+            bitrate->stepped_up = false;
+            bitrate->stable_windows = bitrate->stable_windows * 2 < MAX_STABLE_WINDOWS ? bitrate->stable_windows * 2 : MAX_STABLE_WINDOWS;
+        }
+        return step_down(current_max);
+    }
+
+    bitrate->good_windows++;
+    if (bitrate->stepped_up && bitrate->good_windows >= PROVEN_WINDOWS) {
+        bitrate->stepped_up = false;
+    }
+    if (bitrate->good_windows < bitrate->stable_windows) return 0;
+    return step_up(current_max, bitrate->configured < bitrate->ceiling ? bitrate->configured : bitrate->ceiling);
+}
+
+
+void bitrate_requested(bitrate_t *bitrate, uint8_t max_bitpool, uint8_t current_max) {
+    if (max_bitpool < current_max) {
+        if (!bitrate->configured) bitrate->configured = current_max;
+        bitrate->steps_down++;
+    } else {
+        bitrate->steps_up++;
+        bitrate->stepped_up = true;
+    }
+    bitrate->requested = max_bitpool;
+    bitrate->good_windows = 0;
+    bitrate->hold_windows = HOLD_WINDOWS;
+}
+
+
+uint32_t bitrate_get_bad_windows(const bitrate_t *bitrate) {
+    return bitrate->bad_windows;
+}
+
+
+uint32_t bitrate_get_steps_down(const bitrate_t *bitrate) {
+    return bitrate->steps_down;
+}
+
+
+uint32_t bitrate_get_steps_up(const bitrate_t *bitrate) {
+    return bitrate->steps_up;
+}
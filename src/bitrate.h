@@ -0,0 +1,66 @@
+#ifndef bitrate_h
+#define bitrate_h
+
+// Sbc bitpool against the condition of the radio link. Judges windows of a
+// second of packet arrivals: one with an underrun, with many lost packets or
+// with packets later than ever (the baseband retransmitting them) is bad, and
+// the source is asked for a lower max bitpool: fewer bytes per frame are fewer
+// acl packets to get through. After a long run of good windows it steps back
+// up to where the source started; a step up that soon fails doubles the wait
+// for the next one. Every change suspends the stream, so changes are rare and
+// held for a while.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+typedef struct {
+    uint8_t  ceiling;          // highest max bitpool to ask for
+    uint8_t  configured;       // by the source before the first step down, steps up go no higher
+    uint8_t  requested;        // of the last request, 0 if none
+    bool     refused;          // the source did not take a request, leave it
+    bool     started;          // the window is running
+    uint32_t window_start_ms;
+    uint32_t packets;          // current window
+    uint32_t lost_packets;     // running counts at the window start
+    uint32_t underrun_frames;
+    uint32_t spread_ms;        // arrival spread at the window start
+    uint32_t max_spread_ms;    // current window
+    uint32_t hold_windows;     // left to skip after a change or a restart
+    uint32_t good_windows;     // in a row
+    uint32_t stable_windows;   // good ones in a row before a step up
+    bool     stepped_up;       // the last change was up and is not proven yet
+    uint32_t bad_windows;
+    uint32_t steps_down;
+    uint32_t steps_up;
+} bitrate_t;
+
+
+void bitrate_init(bitrate_t *bitrate, uint8_t ceiling);
+
+// a new stream, maybe of another source: starts over, but keeps the ceiling and the counts
+void bitrate_reset(bitrate_t *bitrate);
+
+// e.g. when decoding could not keep up with higher bitpools
+void bitrate_set_ceiling(bitrate_t *bitrate, uint8_t ceiling);
+
+// playback (re)started: the first windows go to filling the buffer
+void bitrate_restart(bitrate_t *bitrate);
+
+// a packet arrived at now_ms. lost_packets and underrun_frames are running counts, spread_ms
+// how much later than the earliest packets arrive. current_max is the configured max bitpool,
+// returns the max bitpool to ask the source for if that should change, else 0. It is
+// asked again at the end of the next window until bitrate_requested() says it went out
+uint8_t bitrate_update(bitrate_t *bitrate, uint32_t now_ms, uint32_t lost_packets, uint32_t underrun_frames,
+                       uint32_t spread_ms, uint8_t current_max);
+
+// the source was asked for max_bitpool, up or down from current_max
+void bitrate_requested(bitrate_t *bitrate, uint8_t max_bitpool, uint8_t current_max);
+
+uint32_t bitrate_get_bad_windows(const bitrate_t *bitrate);
+
+uint32_t bitrate_get_steps_down(const bitrate_t *bitrate);
+
+uint32_t bitrate_get_steps_up(const bitrate_t *bitrate);
+
+#endif
@@ -0,0 +1,45 @@
+#include "boot_time.h"
+
+#include <stdio.h>
+
+#include "pico/time.h"
+
+
+static uint32_t _us[BOOT_PHASES];
+
+static const char *_names[BOOT_PHASES] = {
+    [BOOT_MAIN]      = "main",
+    [BOOT_CYW43]     = "cyw43",
+    [BOOT_HCI_UP]    = "hci_up",
+    [BOOT_CONNECTED] = "connected",
+    [BOOT_STREAM]    = "stream",
+    [BOOT_AUDIO]     = "audio",
+};
+
+
+void boot_time_mark(boot_phase_t phase) {
+    if (!_us[phase]) {
+        uint32_t now = time_us_32();
+        _us[phase] = now ? now : 1;
+    }
+}
+
+
+uint32_t boot_time_us(boot_phase_t phase) {
+    return _us[phase];
+}
+
+
+void boot_time_print(void) {
+    printf("boot phases, ms since reset (+ms after the phase before):");
+    uint32_t before = 0;
+    for (int phase = 0; phase < BOOT_PHASES; phase++) {
+        if (!_us[phase]) {
+            printf(" %s -", _names[phase]);
+            continue;
+        }
+        printf(" %s %u (+%u)", _names[phase], (unsigned)(_us[phase] / 1000), (unsigned)((_us[phase] - before) / 1000));
+        before = _us[phase];
+    }
+    printf("\n");
+}
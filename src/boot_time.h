@@ -0,0 +1,31 @@
+#ifndef boot_time_h
+#define boot_time_h
+
+// Where the time from power on to music goes: when each phase of getting
+// there was first reached, in microseconds of the timer that starts at reset.
+// On the pico main.c prints them for a 'b' on the console.
+
+#include <stdint.h>
+
+
+typedef enum {
+    BOOT_MAIN,       // runtime and clocks set up
+    BOOT_CYW43,      // wireless chip up, its firmware loaded
+    BOOT_HCI_UP,     // bluetooth stack working
+    BOOT_CONNECTED,  // first acl connection, paged or paged by the source
+    BOOT_STREAM,     // first a2dp stream established
+    BOOT_AUDIO,      // first audio to i2s
+    BOOT_PHASES
+} boot_phase_t;
+
+
+// the first time only, later calls keep it
+void boot_time_mark(boot_phase_t phase);
+
+// us since reset, 0 if not reached yet
+uint32_t boot_time_us(boot_phase_t phase);
+
+// in ms, with the time each phase took after the one before
+void boot_time_print(void);
+
+#endif
@@ -11,6 +11,22 @@
 
 #include <memory.h>
 
+#include "boot_time.h"
+#include "reconnect.h"
+#include "timing.h"
+#include "trace.h"
+
+
+// a source paging us is heard within one interval (0.625ms units): 320ms instead of
+// the default 1.28s, interlaced scan hears it within one window on either train
+#ifndef PAGE_SCAN_INTERVAL
+#define PAGE_SCAN_INTERVAL 0x0200
+#endif
+#define PAGE_SCAN_WINDOW   0x0012  // 11.25ms, the default
+
+// paging a remembered source that is not around gives up after this (0.625ms units), 2.5s
+#define PAGE_TIMEOUT 0x0FA0
+
 
 static bool _is_up = false;
 static bd_addr_t _local_addr = {0};
@@ -32,12 +48,35 @@ static void packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *packe
     switch(hci_event_packet_get_type(packet)) {
 
         case BTSTACK_EVENT_STATE:
+            trace_bt(TRACE_HCI_STATE, btstack_event_state_get_state(packet), 0);
             if (btstack_event_state_get_state(packet) != HCI_STATE_WORKING) return;
             gap_local_bd_addr(_local_addr);
             _is_up = true;
+            boot_time_mark(BOOT_HCI_UP);
+            reconnect_begin();
             if (_cb) (*_cb)(_data);
             break;
 
+        case HCI_EVENT_CONNECTION_COMPLETE:
+            trace_bt(TRACE_CONNECTED, hci_event_connection_complete_get_status(packet),
+                hci_event_connection_complete_get_connection_handle(packet));
+            if (hci_event_connection_complete_get_status(packet) == ERROR_CODE_SUCCESS) {
+                boot_time_mark(BOOT_CONNECTED);
+            }
+            hci_event_connection_complete_get_bd_addr(packet, address);
+            reconnect_connection_complete(address, hci_event_connection_complete_get_status(packet));
+            break;
+
+        case HCI_EVENT_LINK_KEY_NOTIFICATION:
+            hci_event_link_key_notification_get_bd_addr(packet, address);
+            reconnect_bonded(address);
+            break;
+
+        case HCI_EVENT_DISCONNECTION_COMPLETE:
+            trace_bt(TRACE_DISCONNECTED, hci_event_disconnection_complete_get_reason(packet),
+                hci_event_disconnection_complete_get_connection_handle(packet));
+            break;
+
         case HCI_EVENT_PIN_CODE_REQUEST:
             hci_event_pin_code_request_get_bd_addr(packet, address);
             gap_pin_code_response(address, _pin);
@@ -49,6 +88,14 @@ static void packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *packe
 }
 
 
+// as registered, timed as a whole
+static void timed_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *packet, uint16_t size) {
+    TIMING_BEGIN(TIMING_HCI);
+    packet_handler(packet_type, channel, packet, size);
+    TIMING_END(TIMING_HCI);
+}
+
+
 void bt_begin( const char *name, const char *pin, bt_on_up_cb_t cb, void *data ) {
     _name = name ? name : "Pico 00:00:00:00:00:00";
     _pin = pin ? pin : "0000";
@@ -66,8 +113,11 @@ void bt_begin( const char *name, const char *pin, bt_on_up_cb_t cb, void *data )
     gap_set_class_of_device(0x200414);  // Service Class: Audio, Major Device Class: Audio, Minor: Loudspeaker
     gap_set_default_link_policy_settings( LM_LINK_POLICY_ENABLE_ROLE_SWITCH | LM_LINK_POLICY_ENABLE_SNIFF_MODE );
     gap_set_allow_role_switch(true);  // A2DP Source, e.g. smartphone, can become master after re-connect.
+    gap_set_page_scan_type(PAGE_SCAN_MODE_INTERLACED);
+    gap_set_page_scan_activity(PAGE_SCAN_INTERVAL, PAGE_SCAN_WINDOW);
+    gap_set_page_timeout(PAGE_TIMEOUT);
 
-    _hci_registration.callback = &packet_handler;
+    _hci_registration.callback = &timed_packet_handler;
     hci_add_event_handler(&_hci_registration);
 }
 
@@ -52,33 +52,95 @@
 
 #include <stddef.h>
 #include <stdio.h>
+#include <hardware/clocks.h>
 #include <hardware/dma.h>
+#include <hardware/irq.h>
+#include <hardware/pio.h>
+#include <hardware/sync.h>
 
 #include "pico/audio_i2s.h"
 
-#define DRIVER_POLL_INTERVAL_MS   5
-#define SAMPLES_PER_BUFFER      512
+#ifdef I2S_CLOCK_TRIM
+#include "i2s_clock.h"
+#endif
+
+#include "timing.h"
+#ifdef TIMING
+#include "pico/time.h"
+#endif
+
+#ifdef DECODE_ON_CORE1
+#include "pico/multicore.h"
+#ifdef AUDIO_FIRST
+#error "AUDIO_FIRST is for decoding on core 0, with DECODE_ON_CORE1 the refill has a core of its own"
+#endif
+#endif
+
+// output buffering is I2S_BUFFER_COUNT * I2S_SAMPLES_PER_BUFFER, refilled as soon as dma frees a buffer
+#ifndef I2S_BUFFER_COUNT
+#define I2S_BUFFER_COUNT          3
+#endif
+#ifndef I2S_SAMPLES_PER_BUFFER
+#define I2S_SAMPLES_PER_BUFFER  512
+#endif
+#define I2S_PIO_SM                0
 
 // client
 static void (*playback_callback)(int16_t * buffer, uint16_t num_samples);
 
-// timer to fill output ring buffer
-static btstack_timer_source_t  driver_timer_sink;
+#if !defined(DECODE_ON_CORE1) && !defined(AUDIO_FIRST)
+// polled from the dma irq to fill output buffers
+static btstack_data_source_t   btstack_audio_pico_data_source;
+#endif
+#ifdef AUDIO_FIRST
+// refills in a spare irq above the low priority irq the bluetooth run loop works in,
+// so a slow handler is preempted instead of holding up the refill
+static int8_t btstack_audio_pico_refill_irq = -1;
+#endif
+#ifdef TIMING
+// when the dma irq found the first buffer that is not refilled yet, 0 if none
+static volatile uint32_t btstack_audio_pico_freed_us;
+#endif
+static bool btstack_audio_pico_irq_handler_added;
+
+#ifdef I2S_CLOCK_TRIM
+// pio state machine divider, trimmed by the client instead of resampling.
+// pico-extras only sets the divider again if the sample rate of the buffers changes.
+static i2s_clock_t btstack_audio_pico_clock;
+#endif
 
 
 static bool btstack_audio_pico_sink_active;
 
+#ifdef DECODE_ON_CORE1
+// core 1 refills the pool (and thereby decodes) while this is set
+static volatile bool btstack_audio_pico_core1_running;
+#define CORE1_STOPPED     0xC0DE0001
+#endif
+
 // from pico-playground/audio/sine_wave/sine_wave.c
 
 static audio_format_t        btstack_audio_pico_audio_format;
 static audio_buffer_format_t btstack_audio_pico_producer_format;
 static audio_buffer_pool_t * btstack_audio_pico_audio_buffer_pool;
-static uint8_t               btstack_audio_pico_channel_count;
 
-static audio_buffer_pool_t *init_audio(uint32_t sample_frequency, uint8_t channel_count) {
+// pico-extras sets the rate up once, with the divider for 64 pio cycles per frame (16.8 fixed point).
+// It sets it again only if the rate of its own buffers changes, which it never does, so it stays
+static void set_sample_frequency(uint32_t sample_frequency) {
+    btstack_audio_pico_audio_format.sample_freq = sample_frequency;
+    uint32_t divider = clock_get_hz(clk_sys) * 4 / sample_frequency;
+    pio_sm_set_clkdiv_int_frac(pio_get_instance(PICO_AUDIO_I2S_PIO), I2S_PIO_SM, divider >> 8, divider & 0xff);
+}
 
-    // num channels requested by application
-    btstack_audio_pico_channel_count = channel_count;
+// pico-extras has no teardown for i2s: its pio state machine and program, the dma channel,
+// the irq handler and the buffer pools can only be set up once. So they are, for the first
+// stream, and every later stream reuses them at its own rate. Setting up again would panic
+// on the state machine claimed already, that made a reconnect reboot.
+static audio_buffer_pool_t *init_audio(uint32_t sample_frequency) {
+    if (btstack_audio_pico_audio_buffer_pool) {
+        set_sample_frequency(sample_frequency);
+        return btstack_audio_pico_audio_buffer_pool;
+    }
 
     // always use stereo
     btstack_audio_pico_audio_format.format = AUDIO_BUFFER_FORMAT_PCM_S16;
@@ -88,13 +150,13 @@ static audio_buffer_pool_t *init_audio(uint32_t sample_frequency, uint8_t channe
     btstack_audio_pico_producer_format.format = &btstack_audio_pico_audio_format;
     btstack_audio_pico_producer_format.sample_stride = 2 * 2;
 
-    audio_buffer_pool_t * producer_pool = audio_new_producer_pool(&btstack_audio_pico_producer_format, 3, SAMPLES_PER_BUFFER); // todo correct size
+    audio_buffer_pool_t * producer_pool = audio_new_producer_pool(&btstack_audio_pico_producer_format, I2S_BUFFER_COUNT, I2S_SAMPLES_PER_BUFFER);
 
     audio_i2s_config_t config;
     config.data_pin       = PICO_AUDIO_I2S_DATA_PIN;
     config.clock_pin_base = PICO_AUDIO_I2S_CLOCK_PIN_BASE;  // BCK, LRCK = BCK+1
     config.dma_channel    = (int8_t) dma_claim_unused_channel(true);
-    config.pio_sm         = 0;
+    config.pio_sm         = I2S_PIO_SM;
 
     // audio_i2s_setup claims the channel again https://github.com/raspberrypi/pico-extras/issues/48
     dma_channel_unclaim(config.dma_channel);
@@ -116,45 +178,127 @@ static void btstack_audio_pico_sink_fill_buffers(void){
         if (audio_buffer == NULL){
             break;
         }
+#ifdef TIMING
+        if (btstack_audio_pico_freed_us){
+            TIMING_ADD_US(TIMING_REFILL_WAIT, time_us_32() - btstack_audio_pico_freed_us);
+            btstack_audio_pico_freed_us = 0;
+        }
+#endif
 
+        TIMING_BEGIN(TIMING_FILL);
         int16_t * buffer16 = (int16_t *) audio_buffer->buffer->bytes;
         (*playback_callback)(buffer16, audio_buffer->max_sample_count);
-
-        // duplicate samples for mono
-        if (btstack_audio_pico_channel_count == 1){
-            int16_t i;
-            for (i = SAMPLES_PER_BUFFER - 1 ; i >= 0; i--){
-                buffer16[2*i  ] = buffer16[i];
-                buffer16[2*i+1] = buffer16[i];
-            }
-        }
+        TIMING_END(TIMING_FILL);
 
         audio_buffer->sample_count = audio_buffer->max_sample_count;
         give_audio_buffer(btstack_audio_pico_audio_buffer_pool, audio_buffer);
+
+#ifdef I2S_CLOCK_TRIM
+        // one dithered divider step per buffer, the average rate is what the client asked for
+        uint32_t divider = i2s_clock_next_divider(&btstack_audio_pico_clock);
+        pio_sm_set_clkdiv_int_frac(pio_get_instance(PICO_AUDIO_I2S_PIO), I2S_PIO_SM, divider >> 8, divider & 0xff);
+#endif
     }
 }
 
-static void driver_timer_handler_sink(btstack_timer_source_t * ts){
+// runs after the pico-extras handler on the same irq, which has just given the played buffer back to the pool
+static void btstack_audio_pico_dma_irq_handler(void){
+#ifdef TIMING
+    if (!btstack_audio_pico_freed_us){
+        btstack_audio_pico_freed_us = time_us_32();
+    }
+#endif
+#if defined(DECODE_ON_CORE1)
+    __sev();
+#elif defined(AUDIO_FIRST)
+    irq_set_pending(btstack_audio_pico_refill_irq);
+#else
+    btstack_run_loop_poll_data_sources_from_irq();
+#endif
+}
+
+#ifdef DECODE_ON_CORE1
+
+// decode and refill on core 1, so the bluetooth run loop on core 0 never waits for it
+static void btstack_audio_pico_core1_entry(void){
+    // allow flash writes (e.g. link keys) from core 0 while we run
+    multicore_lockout_victim_init();
+#ifdef TIMING
+    timing_init_core();
+#endif
+
+    // sleep until the dma irq signals a free buffer, an event sent meanwhile is not lost
+    while (btstack_audio_pico_core1_running){
+        btstack_audio_pico_sink_fill_buffers();
+        __wfe();
+    }
+
+    multicore_fifo_push_blocking(CORE1_STOPPED);
+}
 
-    // refill
+static void btstack_audio_pico_core1_start(void){
+    btstack_audio_pico_core1_running = true;
+    multicore_launch_core1(&btstack_audio_pico_core1_entry);
+}
+
+static void btstack_audio_pico_core1_stop(void){
+    btstack_audio_pico_core1_running = false;
+    __sev();
+    while (multicore_fifo_pop_blocking() != CORE1_STOPPED);
+    multicore_reset_core1();
+}
+
+#elif defined(AUDIO_FIRST)
+
+static void btstack_audio_pico_refill_irq_handler(void){
     btstack_audio_pico_sink_fill_buffers();
+}
+
+#else
+
+static void btstack_audio_pico_data_source_process(btstack_data_source_t * ds, btstack_data_source_callback_type_t callback_type){
+    (void)ds;
+    if (callback_type != DATA_SOURCE_CALLBACK_POLL) return;
 
-    // re-set timer
-    btstack_run_loop_set_timer(ts, DRIVER_POLL_INTERVAL_MS);
-    btstack_run_loop_add_timer(ts);
+    // refill, also called for other sources, then there is simply nothing to take
+    if (btstack_audio_pico_sink_active){
+        btstack_audio_pico_sink_fill_buffers();
+    }
 }
 
+#endif
+
 static int btstack_audio_pico_sink_init(
     uint8_t channels,
     uint32_t samplerate, 
     void (*playback)(int16_t * buffer, uint16_t num_samples)
 ){
     btstack_assert(playback != NULL);
-    btstack_assert(channels != 0);
+    btstack_assert(channels == 2);  // stereo only, a2dp.c expands mono streams itself
 
     playback_callback  = playback;
 
-    btstack_audio_pico_audio_buffer_pool = init_audio(samplerate, channels);
+    btstack_audio_pico_audio_buffer_pool = init_audio(samplerate);
+#ifdef I2S_CLOCK_TRIM
+    i2s_clock_init(&btstack_audio_pico_clock, clock_get_hz(clk_sys), samplerate);
+#endif
+
+    // lowest order priority: after pico-extras has handled the dma completion
+    if (!btstack_audio_pico_irq_handler_added){
+        irq_add_shared_handler(DMA_IRQ_0 + PICO_AUDIO_I2S_DMA_IRQ, &btstack_audio_pico_dma_irq_handler, PICO_SHARED_IRQ_HANDLER_LOWEST_ORDER_PRIORITY);
+#ifdef AUDIO_FIRST
+        // the async context of the run loop works at the lowest priority
+        btstack_audio_pico_refill_irq = (int8_t) user_irq_claim_unused(true);
+        irq_set_exclusive_handler(btstack_audio_pico_refill_irq, &btstack_audio_pico_refill_irq_handler);
+        irq_set_priority(btstack_audio_pico_refill_irq, PICO_DEFAULT_IRQ_PRIORITY);
+#endif
+        btstack_audio_pico_irq_handler_added = true;
+    }
+
+#ifdef TIMING
+    // after a buffer is freed, the others play while it is refilled
+    timing_set_deadline_us((uint32_t)((I2S_BUFFER_COUNT - 1) * I2S_SAMPLES_PER_BUFFER * 1000000ull / samplerate));
+#endif
 
     return 0;
 }
@@ -165,13 +309,22 @@ static void btstack_audio_pico_sink_set_volume(uint8_t volume){
 
 static void btstack_audio_pico_sink_start_stream(void){
 
+#ifdef TIMING
+    btstack_audio_pico_freed_us = 0;  // the pre-fill waited for nothing
+#endif
     // pre-fill HAL buffers
     btstack_audio_pico_sink_fill_buffers();
 
-    // start timer
-    btstack_run_loop_set_timer_handler(&driver_timer_sink, &driver_timer_handler_sink);
-    btstack_run_loop_set_timer(&driver_timer_sink, DRIVER_POLL_INTERVAL_MS);
-    btstack_run_loop_add_timer(&driver_timer_sink);
+#if defined(DECODE_ON_CORE1)
+    btstack_audio_pico_core1_start();
+#elif defined(AUDIO_FIRST)
+    irq_set_enabled(btstack_audio_pico_refill_irq, true);
+#else
+    // refill when polled from the dma irq
+    btstack_run_loop_set_data_source_handler(&btstack_audio_pico_data_source, &btstack_audio_pico_data_source_process);
+    btstack_run_loop_enable_data_source_callbacks(&btstack_audio_pico_data_source, DATA_SOURCE_CALLBACK_POLL);
+    btstack_run_loop_add_data_source(&btstack_audio_pico_data_source);
+#endif
 
     // state
     btstack_audio_pico_sink_active = true;
@@ -183,12 +336,20 @@ static void btstack_audio_pico_sink_stop_stream(void){
 
     audio_i2s_set_enabled(false);
 
-    // stop timer
-    btstack_run_loop_remove_timer(&driver_timer_sink);
+#if defined(DECODE_ON_CORE1)
+    // returns once core 1 no longer touches decoder and buffers
+    btstack_audio_pico_core1_stop();
+#elif defined(AUDIO_FIRST)
+    // it preempts this, so it is not running now and will not again
+    irq_set_enabled(btstack_audio_pico_refill_irq, false);
+#else
+    btstack_run_loop_remove_data_source(&btstack_audio_pico_data_source);
+#endif
     // state
     btstack_audio_pico_sink_active = false;
 }
 
+// i2s stays set up for the next stream, see init_audio()
 static void btstack_audio_pico_sink_close(void){
     // stop stream if needed
     if (btstack_audio_pico_sink_active){
@@ -207,3 +368,10 @@ static const btstack_audio_sink_t btstack_audio_pico_sink = {
 const btstack_audio_sink_t * btstack_audio_pico_sink_get_instance(void){
     return &btstack_audio_pico_sink;
 }
+
+#ifdef I2S_CLOCK_TRIM
+// called from the playback callback, i.e. in the context that refills the buffers
+void btstack_audio_pico_sink_set_clock_trim(int32_t ppb){
+    i2s_clock_set_trim(&btstack_audio_pico_clock, ppb);
+}
+#endif
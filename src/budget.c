@@ -0,0 +1,54 @@
+#include "budget.h"
+
+
+#define WINDOW_MS 1000  // of audio
+
+
+void budget_init(budget_t *budget, uint32_t sample_rate, uint32_t limit_percent) {
+    budget->sample_rate = sample_rate;
+    budget->limit_percent = limit_percent;
+    budget->load_percent = 0;
+    budget->peak_percent = 0;
+    budget->exceeded_windows = 0;
+    budget_reset(budget);
+}
+
+
+void budget_reset(budget_t *budget) {
+    budget->busy_us = 0;
+    budget->audio_frames = 0;
+}
+
+
+bool budget_update(budget_t *budget, uint32_t busy_us, uint32_t audio_frames) {
+    budget->busy_us += busy_us;
+    budget->audio_frames += audio_frames;
+    if (budget->audio_frames < budget->sample_rate * WINDOW_MS / 1000) return false;
+
+    // busy time per audio time, both in us
+    uint64_t audio_us = (uint64_t)budget->audio_frames * 1000000 / budget->sample_rate;
+    budget->load_percent = (uint32_t)((uint64_t)budget->busy_us * 100 / audio_us);
+    if (budget->load_percent > budget->peak_percent) {
+        budget->peak_percent = budget->load_percent;
+    }
+    budget_reset(budget);
+
+    if (budget->load_percent <= budget->limit_percent) return false;
+    budget->exceeded_windows++;
+    return true;
+}
+
+
+uint32_t budget_get_load(const budget_t *budget) {
+    return budget->load_percent;
+}
+
+
+uint32_t budget_get_peak(const budget_t *budget) {
+    return budget->peak_percent;
+}
+
+
+uint32_t budget_get_exceeded(const budget_t *budget) {
+    return budget->exceeded_windows;
+}
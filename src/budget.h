@@ -0,0 +1,41 @@
+#ifndef budget_h
+#define budget_h
+
+// Decode cost against real time. Sums the time spent decoding and the audio
+// it produced over windows of a second of audio: their ratio is the share of
+// the core the decoder takes. A window above the limit leaves too little for
+// i2s refill, bluetooth and the odd slow frame, the stream should then fall
+// back to a cheaper configuration.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+typedef struct {
+    uint32_t sample_rate;
+    uint32_t limit_percent;
+    uint32_t busy_us;           // current window
+    uint32_t audio_frames;      // current window
+    uint32_t load_percent;      // of the last complete window
+    uint32_t peak_percent;      // highest complete window
+    uint32_t exceeded_windows;  // above the limit
+} budget_t;
+
+
+void budget_init(budget_t *budget, uint32_t sample_rate, uint32_t limit_percent);
+
+// start a new window, e.g. after the stream was suspended, keeps the peak
+void budget_reset(budget_t *budget);
+
+// busy_us of decoding produced audio_frames,
+// true if that completed a window above the limit
+bool budget_update(budget_t *budget, uint32_t busy_us, uint32_t audio_frames);
+
+// decoding time per audio time of the last complete window
+uint32_t budget_get_load(const budget_t *budget);
+
+uint32_t budget_get_peak(const budget_t *budget);
+
+uint32_t budget_get_exceeded(const budget_t *budget);
+
+#endif
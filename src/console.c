@@ -0,0 +1,101 @@
+#include "console.h"
+
+#include <stdio.h>
+#include "btstack_run_loop.h"
+#include "pico/stdio.h"
+#include "pico/time.h"
+
+#include "timing.h"
+
+
+#define MAX_COMMANDS 12
+#define PROBE_MS 100
+
+
+typedef struct {
+    char command;
+    void (*handler)(void);
+    const char *help;
+} console_command_t;
+
+static console_command_t _commands[MAX_COMMANDS];
+static int _num_commands = 0;
+static btstack_data_source_t _input;  // polled from the stdio irq when characters arrive
+static volatile bool _input_pending = true;  // typed before the console began
+#ifdef TIMING
+static btstack_timer_source_t _probe_timer;  // how long handlers hold up the run loop, wakes it, so timing builds only
+static uint32_t _probe_due_us;
+#endif
+
+
+static void help(void) {
+    for (int i = 0; i < _num_commands; i++) {
+        printf("%c  %s\n", _commands[i].command, _commands[i].help);
+    }
+}
+
+
+// stdio irq
+static void chars_available(void *param) {
+    (void)param;
+    _input_pending = true;
+    btstack_run_loop_poll_data_sources_from_irq();
+}
+
+
+static void input_process(btstack_data_source_t *ds, btstack_data_source_callback_type_t callback_type) {
+    (void)ds;
+    // also called for other sources, then there is nothing to read
+    if (callback_type != DATA_SOURCE_CALLBACK_POLL || !_input_pending) return;
+    _input_pending = false;
+
+    int c;
+    while ((c = getchar_timeout_us(0)) != PICO_ERROR_TIMEOUT) {
+        for (int i = 0; i < _num_commands; i++) {
+            if (_commands[i].command == c) {
+                _commands[i].handler();
+                break;
+            }
+        }
+    }
+}
+
+
+#ifdef TIMING
+static void schedule_probe(void) {
+    _probe_due_us = time_us_32() + PROBE_MS * 1000;
+    btstack_run_loop_set_timer(&_probe_timer, PROBE_MS);
+    btstack_run_loop_add_timer(&_probe_timer);
+}
+
+
+static void probe_handler(btstack_timer_source_t *ts) {
+    (void)ts;
+    int32_t late_us = (int32_t)(time_us_32() - _probe_due_us);
+    TIMING_ADD_US(TIMING_LOOP_LATE, late_us > 0 ? late_us : 0);
+    schedule_probe();
+}
+#endif
+
+
+bool console_register(char command, void (*handler)(void), const char *help) {
+    if (_num_commands == MAX_COMMANDS) return false;
+    for (int i = 0; i < _num_commands; i++) {
+        if (_commands[i].command == command) return false;
+    }
+    _commands[_num_commands++] = (console_command_t){ command, handler, help };
+    return true;
+}
+
+
+void console_begin(void) {
+    console_register('h', &help, "this list");
+    btstack_run_loop_set_data_source_handler(&_input, &input_process);
+    btstack_run_loop_enable_data_source_callbacks(&_input, DATA_SOURCE_CALLBACK_POLL);
+    btstack_run_loop_add_data_source(&_input);
+    stdio_set_chars_available_callback(&chars_available, NULL);
+#ifdef TIMING
+    btstack_run_loop_set_timer_handler(&_probe_timer, &probe_handler);
+    schedule_probe();
+#endif
+}
@@ -0,0 +1,18 @@
+#ifndef console_h
+#define console_h
+
+// Single character commands on stdio, e.g. typed into a terminal on the usb
+// serial port. Read on the bluetooth run loop when characters arrive, without a
+// periodic wakeup, so the commands run on core 0 like the bluetooth handlers.
+// 'h' lists the registered commands.
+
+#include <stdbool.h>
+
+
+// false if the command is taken or there is no room for more
+bool console_register(char command, void (*handler)(void), const char *help);
+
+// start reading, once the run loop is initialized
+void console_begin(void);
+
+#endif
@@ -0,0 +1,69 @@
+#include "delay.h"
+
+
+#define AVERAGE_SHIFT        6     // 64 packets, about a second
+#define REPORT_STEP_100US    50    // 5ms, below what anyone sees in lip sync
+#define REPORT_INTERVAL_MS   1000
+#define MAX_DELAY_100US      0xFFFF
+
+
+void delay_init(delay_t *delay, uint32_t sample_rate) {
+    delay->sample_rate = sample_rate;
+    delay->reported = false;
+    delay->reported_100us = 0;
+    delay->reported_ms = 0;
+    delay->reports = 0;
+    delay_restart(delay);
+}
+
+
+void delay_restart(delay_t *delay) {
+    delay->measuring = false;
+    delay->average = 0;
+}
+
+
+uint32_t delay_compute_100us(uint32_t sample_rate, uint32_t source_frames, uint32_t factor, uint32_t sink_frames) {
+    if (!sample_rate || !factor) return 0;
+    // played frames of the source audio, rounded
+    uint64_t frames = (((uint64_t)source_frames << 16) + factor / 2) / factor + sink_frames;
+    uint64_t delay = (frames * 10000 + sample_rate / 2) / sample_rate;
+    return delay > MAX_DELAY_100US ? MAX_DELAY_100US : (uint32_t)delay;
+}
+
+
+bool delay_update(delay_t *delay, uint32_t now_ms, uint32_t source_frames, uint32_t factor, uint32_t sink_frames) {
+    uint32_t measured = delay_compute_100us(delay->sample_rate, source_frames, factor, sink_frames) << AVERAGE_SHIFT;
+    if (!delay->measuring) {
+        delay->average = measured;
+        delay->measuring = true;
+    } else {
+        delay->average = delay->average + (int32_t)(measured - delay->average) / (1 << AVERAGE_SHIFT);
+    }
+
+    uint16_t current = delay_get_100us(delay);
+    if (delay->reported) {
+        uint16_t change = current > delay->reported_100us ? current - delay->reported_100us : delay->reported_100us - current;
+        if (change <= REPORT_STEP_100US || now_ms - delay->reported_ms < REPORT_INTERVAL_MS) return false;
+    }
+    delay->reported = true;
+    delay->reported_100us = current;
+    delay->reported_ms = now_ms;
+    delay->reports++;
+    return true;
+}
+
+
+uint16_t delay_get_100us(const delay_t *delay) {
+    return (delay->average + (1 << (AVERAGE_SHIFT - 1))) >> AVERAGE_SHIFT;
+}
+
+
+uint16_t delay_get_report_100us(const delay_t *delay) {
+    return delay->reported_100us;
+}
+
+
+uint32_t delay_get_reports(const delay_t *delay) {
+    return delay->reports;
+}
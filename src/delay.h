@@ -0,0 +1,48 @@
+#ifndef delay_h
+#define delay_h
+
+// Delay of the sink for avdtp delay reports, so sources can hold video in sync.
+// Audio arriving now is heard after everything buffered ahead of it: undecoded
+// frames in the queue and decoded audio waiting for i2s, both at the source
+// rate and stretched by the resampling factor, then what the i2s buffers hold.
+// Measured at every packet arrival, the fill swings with each packet and
+// decode, so the reported delay follows the average. A new report is due when
+// that moved by more than a step, at most once per interval.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+typedef struct {
+    uint32_t sample_rate;
+    bool     measuring;        // average is seeded
+    uint32_t average;          // 100us << AVERAGE_SHIFT of delay.c
+    bool     reported;         // a report went out
+    uint16_t reported_100us;
+    uint32_t reported_ms;
+    uint32_t reports;
+} delay_t;
+
+
+void delay_init(delay_t *delay, uint32_t sample_rate);
+
+// forget the average, e.g. when playback starts: the next measurement replaces it, reports go on
+void delay_restart(delay_t *delay);
+
+// delay in units of 100us of source_frames buffered at the source rate, played with the
+// resampling factor (0x10000 is nominal, above consumes faster), then sink_frames at the sink rate
+uint32_t delay_compute_100us(uint32_t sample_rate, uint32_t source_frames, uint32_t factor, uint32_t sink_frames);
+
+// a packet arrived at now_ms with that much buffered ahead of it,
+// true if a report of delay_get_report_100us() is due. The first measurement is reported right away
+bool delay_update(delay_t *delay, uint32_t now_ms, uint32_t source_frames, uint32_t factor, uint32_t sink_frames);
+
+// averaged delay, 100us
+uint16_t delay_get_100us(const delay_t *delay);
+
+// the value for the report that is due, and the last one sent
+uint16_t delay_get_report_100us(const delay_t *delay);
+
+uint32_t delay_get_reports(const delay_t *delay);
+
+#endif
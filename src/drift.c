@@ -0,0 +1,106 @@
+#include "drift.h"
+
+
+// Loop dynamics: the fill changes by sample_rate * 1e-6 audio frames per second
+// for every ppm of uncompensated drift. With that plant the PI gains follow from
+// the natural frequency and damping of the closed loop. It is kept slow, so
+// bursty arrival does not modulate the pitch: a 200 ppm offset is absorbed
+// with about one sbc frame of error and settled within a minute or two.
+#define LOOP_BANDWIDTH  0.04f    // natural frequency, rad/s
+#define LOOP_DAMPING    1.0f
+
+#define FILTER_TIME     0.75f    // s, smooths out packet bursts
+#define MAX_PPM         1000.0f  // correction range, beyond any real crystal
+#define MAX_SLEW_PPM    50.0f    // per second, keeps pitch changes inaudible
+#define RAMP_PPM        1000.0f  // speed of target changes, 1.7 cents of pitch
+
+
+static float clamp(float value, float limit) {
+    if (value > limit) return limit;
+    if (value < -limit) return -limit;
+    return value;
+}
+
+
+void drift_init(drift_t *drift, uint32_t sample_rate, uint32_t target) {
+    float plant = sample_rate * 1e-6f;
+
+    drift->gain_p = 2.0f * LOOP_DAMPING * LOOP_BANDWIDTH / plant;
+    drift->gain_i = LOOP_BANDWIDTH * LOOP_BANDWIDTH / plant;
+    drift->sample_rate = sample_rate;
+    drift->target = target;
+    drift->integral_ppm = 0.0f;
+    drift->ppm = 0.0f;
+    drift->correction_ppm = 0.0f;
+    drift->factor = 0x10000;
+    drift_restart(drift);
+}
+
+
+void drift_restart(drift_t *drift) {
+    drift->measuring = false;
+    drift->error = 0.0f;
+    drift->occupancy = drift->target;
+    drift->reference = drift->target;
+    drift->ramp_ppm = 0.0f;
+}
+
+
+void drift_set_target(drift_t *drift, uint32_t target) {
+    drift->target = target;
+}
+
+
+// called once per i2s buffer, float is cheap enough at that rate
+uint32_t drift_update(drift_t *drift, uint32_t occupancy, uint32_t elapsed) {
+    float dt = (float)elapsed / drift->sample_rate;
+
+    if (!drift->measuring) {
+        drift->occupancy = occupancy;
+        drift->reference = occupancy;
+        drift->measuring = true;
+    }
+    float alpha = dt / FILTER_TIME;
+    if (alpha > 1.0f) alpha = 1.0f;
+    drift->occupancy += alpha * (occupancy - drift->occupancy);
+
+    // move the reference towards the target, playing slower or faster by RAMP_PPM
+    float max_move = RAMP_PPM * 1e-6f * drift->sample_rate * dt;
+    float move = clamp(drift->target - drift->reference, max_move);
+    drift->reference += move;
+    drift->ramp_ppm = max_move > 0.0f ? -move / max_move * RAMP_PPM : 0.0f;
+
+    // positive error: buffer too full, source is faster, consume faster
+    float error = drift->occupancy - drift->reference;
+    drift->error = error;
+
+    drift->integral_ppm = clamp(drift->integral_ppm + drift->gain_i * error * dt, MAX_PPM);
+    float ppm = clamp(drift->gain_p * error + drift->integral_ppm, MAX_PPM);
+
+    float max_step = MAX_SLEW_PPM * dt;
+    drift->ppm += clamp(ppm - drift->ppm, max_step);
+
+    drift->correction_ppm = drift->ppm + drift->ramp_ppm;
+    drift->factor = (uint32_t)(0x10000 * (1.0f + drift->correction_ppm * 1e-6f) + 0.5f);
+    return drift->factor;
+}
+
+
+int32_t drift_get_ppm(const drift_t *drift) {
+    return (int32_t)drift->integral_ppm;
+}
+
+
+int32_t drift_get_error(const drift_t *drift) {
+    return (int32_t)drift->error;
+}
+
+
+uint32_t drift_get_factor(const drift_t *drift) {
+    return drift->factor;
+}
+
+
+int32_t drift_get_correction_ppb(const drift_t *drift) {
+    return (int32_t)(drift->correction_ppm * 1000.0f);
+}
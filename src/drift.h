@@ -0,0 +1,53 @@
+#ifndef drift_h
+#define drift_h
+
+// Clock drift compensation between the bluetooth source and the i2s clock.
+// A PI controller keeps the buffered audio at a target fill by fine tuning the
+// resampling factor. The fill is measured in audio frames (sub sbc frame
+// resolution) once per i2s buffer and low pass filtered against arrival jitter.
+// The integral part converges to the clock difference of source and sink.
+// Target changes are followed along a reference ramp with a feed forward rate,
+// so they do not disturb the drift estimate.
+// The correction can be applied as resampling factor or by trimming the i2s clock.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+typedef struct {
+    float    gain_p;           // ppm per audio frame of error
+    float    gain_i;           // ppm per audio frame of error and second
+    uint32_t sample_rate;
+    uint32_t target;           // audio frames
+    float    reference;        // fill to hold now, moves towards target
+    float    ramp_ppm;         // feed forward while the reference moves
+    bool     measuring;        // filter is seeded
+    float    error;            // filtered fill - reference, audio frames
+    float    occupancy;        // filtered, audio frames
+    float    integral_ppm;     // estimated source clock offset
+    float    ppm;              // current correction, slew limited
+    float    correction_ppm;   // ppm plus ramp feed forward, consume that much faster
+    uint32_t factor;           // resampling factor, 0x10000 is nominal
+} drift_t;
+
+
+// start from nominal rate, target is the buffer fill to hold in audio frames
+void drift_init(drift_t *drift, uint32_t sample_rate, uint32_t target);
+
+// forget the filtered fill after a pause, keeps the clock estimate.
+// The next measured fill becomes the reference, then it moves towards the target.
+void drift_restart(drift_t *drift);
+
+void drift_set_target(drift_t *drift, uint32_t target);
+
+// feed the buffer fill measured after elapsed audio frames were played,
+// returns the resampling factor to use
+uint32_t drift_update(drift_t *drift, uint32_t occupancy, uint32_t elapsed);
+
+// controller state, for monitoring
+int32_t drift_get_ppm(const drift_t *drift);     // estimated source clock offset
+int32_t drift_get_error(const drift_t *drift);   // filtered fill - reference, audio frames
+uint32_t drift_get_factor(const drift_t *drift);
+int32_t drift_get_correction_ppb(const drift_t *drift);  // what the factor encodes, finer resolution
+
+#endif
@@ -0,0 +1,27 @@
+#include "i2s_clock.h"
+
+
+void i2s_clock_init(i2s_clock_t *clock, uint32_t sys_hz, uint32_t sample_rate) {
+    clock->nominal = ((uint64_t)sys_hz << 24) / ((uint64_t)I2S_CLOCK_CYCLES_PER_FRAME * sample_rate);
+    clock->residue = 0;
+    i2s_clock_set_trim(clock, 0);
+}
+
+
+// the period scales with 1 / (1 + trim), exact even at the clamp limits of the drift controller
+void i2s_clock_set_trim(i2s_clock_t *clock, int32_t ppb) {
+    clock->divider = clock->nominal * 1000000000u / (uint64_t)(1000000000 + (int64_t)ppb);
+}
+
+
+uint32_t i2s_clock_next_divider(i2s_clock_t *clock) {
+    clock->residue += clock->divider & 0xffff;
+    uint32_t divider = (uint32_t)(clock->divider >> 16) + (clock->residue >> 16);
+    clock->residue &= 0xffff;
+    return divider;
+}
+
+
+uint32_t i2s_clock_step_ppb(const i2s_clock_t *clock) {
+    return (uint32_t)((1000000000ull << 16) / clock->nominal);
+}
@@ -0,0 +1,36 @@
+#ifndef i2s_clock_h
+#define i2s_clock_h
+
+// Fine tuning of the i2s sample rate through the pio clock divider, as an
+// alternative to resampling for clock drift compensation.
+// The divider has only 8 fraction bits: at 125 MHz and 44.1 kHz one step
+// changes the rate by about 88 ppm. The wanted divider is kept with 24
+// fraction bits and the lower 16 of them are dithered (first order sigma
+// delta) over successive i2s buffers, so the average rate is exact while the
+// instantaneous rate never deviates by more than one step.
+
+#include <stdint.h>
+
+
+#define I2S_CLOCK_CYCLES_PER_FRAME 64  // pio cycles per stereo frame of the pico-extras i2s program
+
+
+typedef struct {
+    uint64_t nominal;   // divider for the exact sample rate, 24 fraction bits
+    uint64_t divider;   // trimmed, 24 fraction bits
+    uint32_t residue;   // dither accumulator of the bits the pio does not take
+} i2s_clock_t;
+
+
+void i2s_clock_init(i2s_clock_t *clock, uint32_t sys_hz, uint32_t sample_rate);
+
+// play faster (positive) or slower than nominal, parts per billion
+void i2s_clock_set_trim(i2s_clock_t *clock, int32_t ppb);
+
+// divider for the next i2s buffer: 16 integer and 8 fraction bits like the pio takes it
+uint32_t i2s_clock_next_divider(i2s_clock_t *clock);
+
+// rate change of one divider step, parts per billion
+uint32_t i2s_clock_step_ppb(const i2s_clock_t *clock);
+
+#endif
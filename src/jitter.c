@@ -0,0 +1,91 @@
+#include "jitter.h"
+
+
+#define WINDOW_MS 2000  // JITTER_WINDOWS of these are remembered
+#define LOST_MS      5  // untimed: a later earliest arrival than this is taken as lost audio
+
+
+void jitter_init(jitter_t *jitter, uint32_t sample_rate) {
+    jitter->sample_rate = sample_rate;
+    jitter->untimed = false;
+    jitter_reset(jitter);
+}
+
+
+void jitter_set_untimed(jitter_t *jitter, bool untimed) {
+    jitter->untimed = untimed;
+}
+
+
+void jitter_reset(jitter_t *jitter) {
+    jitter->started = false;
+    jitter->spread = 0;
+}
+
+
+// untimed: lost audio delays all later packets for good, the
+// older windows are moved by that once a window shows it throughout
+static void follow_lost_audio(jitter_t *jitter) {
+    int64_t window_min = jitter->min_transit[jitter->window];
+    int64_t older_min = window_min;
+    for (uint8_t i = 0; i < JITTER_WINDOWS; i++) {
+        if (i != jitter->window && jitter->min_transit[i] < older_min) older_min = jitter->min_transit[i];
+    }
+
+    int64_t lost = window_min - older_min;
+    if (lost <= (int64_t)jitter->sample_rate * LOST_MS / 1000) return;
+    for (uint8_t i = 0; i < JITTER_WINDOWS; i++) {
+        if (i != jitter->window) {
+            jitter->min_transit[i] += lost;
+            jitter->max_transit[i] += lost;
+        }
+    }
+}
+
+
+static void start_window(jitter_t *jitter, uint8_t window, uint32_t now_ms, int64_t transit) {
+    jitter->window = window;
+    jitter->window_start_ms = now_ms;
+    jitter->min_transit[window] = transit;
+    jitter->max_transit[window] = transit;
+}
+
+
+void jitter_update(jitter_t *jitter, uint32_t arrival_ms, uint32_t timestamp) {
+    if (!jitter->started) {
+        jitter->first_ms = arrival_ms;
+        jitter->first_timestamp = timestamp;
+        jitter->started = true;
+        for (uint8_t i = 0; i < JITTER_WINDOWS; i++) {
+            start_window(jitter, i, arrival_ms, 0);
+        }
+        return;
+    }
+
+    // transit time up to a constant, in audio frames. Includes the clock drift,
+    // which is slow enough to not matter within the windows.
+    int64_t arrival = (int64_t)(uint32_t)(arrival_ms - jitter->first_ms) * jitter->sample_rate / 1000;
+    int64_t transit = arrival - (uint32_t)(timestamp - jitter->first_timestamp);
+
+    if (arrival_ms - jitter->window_start_ms >= WINDOW_MS) {
+        if (jitter->untimed) {
+            follow_lost_audio(jitter);
+        }
+        start_window(jitter, (jitter->window + 1) % JITTER_WINDOWS, arrival_ms, transit);
+    }
+    if (transit < jitter->min_transit[jitter->window]) jitter->min_transit[jitter->window] = transit;
+    if (transit > jitter->max_transit[jitter->window]) jitter->max_transit[jitter->window] = transit;
+
+    int64_t min_transit = jitter->min_transit[0];
+    int64_t max_transit = jitter->max_transit[0];
+    for (uint8_t i = 1; i < JITTER_WINDOWS; i++) {
+        if (jitter->min_transit[i] < min_transit) min_transit = jitter->min_transit[i];
+        if (jitter->max_transit[i] > max_transit) max_transit = jitter->max_transit[i];
+    }
+    jitter->spread = (uint32_t)(max_transit - min_transit);
+}
+
+
+uint32_t jitter_get_spread(const jitter_t *jitter) {
+    return jitter->spread;
+}
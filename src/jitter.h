@@ -0,0 +1,49 @@
+#ifndef jitter_h
+#define jitter_h
+
+// Arrival jitter of media packets. Compares the arrival time of each packet
+// with its rtp timestamp: the spread of this transit time over the last
+// seconds is how much later than the earliest a packet may arrive, which is
+// what the buffer has to cover. Grows with the first late packet, shrinks
+// only after the window has passed without one.
+// Sources without timestamps (aptx) are measured against the audio received.
+// Then a lost packet looks like all later ones are late: with untimed set, a
+// window whose earliest packet was clearly later than before moves the older
+// windows along, the buffer refills like after clock drift.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+#define JITTER_WINDOWS 8
+
+
+typedef struct {
+    uint32_t sample_rate;
+    bool     started;
+    bool     untimed;                       // timestamps count the audio received
+    uint32_t first_ms;
+    uint32_t first_timestamp;
+    uint32_t window_start_ms;
+    uint8_t  window;                        // current one
+    int64_t  min_transit[JITTER_WINDOWS];   // audio frames
+    int64_t  max_transit[JITTER_WINDOWS];
+    uint32_t spread;                        // audio frames
+} jitter_t;
+
+
+void jitter_init(jitter_t *jitter, uint32_t sample_rate);
+
+// timestamps are not from the source but count the audio received, losses can not be seen
+void jitter_set_untimed(jitter_t *jitter, bool untimed);
+
+// forget all, e.g. after the stream was suspended
+void jitter_reset(jitter_t *jitter);
+
+// a packet with rtp timestamp arrived at arrival_ms
+void jitter_update(jitter_t *jitter, uint32_t arrival_ms, uint32_t timestamp);
+
+// max lateness seen in the window, audio frames
+uint32_t jitter_get_spread(const jitter_t *jitter);
+
+#endif
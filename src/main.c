@@ -2,13 +2,19 @@
 #include "pico/cyw43_arch.h"
 #include "hardware/watchdog.h"
 
+#include "a2dp.h"
+#include "boot_time.h"
 #include "bt.h"
+#include "console.h"
+#include "timing.h"
+#include "trace.h"
 
 
 // Unrecoverable error happened. Reboot by setting watchdog.
 // Blink led until watchdog fires
 // If RUN_PIN is defined then try reset via run pin after 5 blinks
 void fatal() {
+    trace_bt(TRACE_FATAL, 0, 0);
     watchdog_enable(1000, true);  // reboot in 1s
     #ifdef RUN_PIN
         unsigned count = 0;
@@ -32,11 +38,47 @@ void fatal() {
 
 void on_bt_up( void * ) {
     printf("Bluetooth stack is up\n");
+    if (trace_has_previous()) {
+        trace_print(true);  // what led to the reboot, 'p' shows it again
+    }
     cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, false);
 }
 
 
+// media pipeline counters on the console, to size the buffers
+static void print_stats(void) {
+    stats_t stats;
+    a2dp_sink_get_stats(&stats);
+    stats_print(&stats, "");
+}
+
+
+static void print_previous_trace(void) {
+    trace_print(true);
+}
+
+
+static void print_trace(void) {
+    trace_print(false);
+}
+
+
+#ifdef TIMING
+// binary record for timing-report, raw so no byte of it becomes \r\n
+static void send_timing(void) {
+    uint8_t record[TIMING_RECORD_SIZE];
+    uint32_t size = timing_encode(record, sizeof(record));
+    for (uint32_t i = 0; i < size; i++) {
+        putchar_raw(record[i]);
+    }
+    stdio_flush();
+}
+#endif
+
+
 int main() {
+    boot_time_mark(BOOT_MAIN);
+    trace_init();
     stdio_init_all();
 
     // initialize CYW43 driver architecture (will enable BT if/because CYW43_ENABLE_BLUETOOTH == 1)
@@ -45,12 +87,24 @@ int main() {
         fatal();
         return -1;
     }
+    boot_time_mark(BOOT_CYW43);
 
     // led on during setup until bt is up
     cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, true);
 
     bt_begin(BT_NAME, BT_PIN, on_bt_up, NULL);
 
+    console_register('s', &print_stats, "media pipeline stats");
+    console_register('z', &a2dp_sink_reset_stats, "reset the stats");
+    console_register('p', &print_previous_trace, "trace of the boot before");
+    console_register('e', &print_trace, "trace of this boot");
+    console_register('b', &boot_time_print, "boot phases, from reset to the first audio");
+#ifdef TIMING
+    console_register('t', &send_timing, "stage timing record, for timing-report");
+    console_register('r', &timing_reset, "reset the stage timing");
+#endif
+    console_begin();
+
     printf("Setup done\n");
     bt_run();
 
@@ -0,0 +1,138 @@
+#include "plc.h"
+
+#include <string.h>
+
+
+#define MIN_PERIOD   32    // audio frames, ~1.4 kHz at 44.1 kHz
+#define MAX_PERIOD   (PLC_HISTORY_FRAMES - WINDOW)
+#define WINDOW       128   // audio frames compared for the period search
+#define FADE_IN      64    // audio frames cross-faded into good audio after a loss
+#define HOLD         441   // audio frames repeated at full level, 10 ms at 44.1 kHz
+#define FADE_OUT     1764  // audio frames to fade to silence after that, 40 ms
+
+
+void plc_init(plc_t *plc) {
+    memset(plc, 0, sizeof(*plc));
+    plc->num_channels = 2;
+}
+
+
+// sample of channel ch, age 1 is the newest audio frame in the history
+static int16_t history_sample(const plc_t *plc, uint32_t age, uint8_t ch) {
+    int32_t pos = (int32_t)plc->history_end - (int32_t)age;
+    if (pos < 0) pos += PLC_HISTORY_FRAMES;
+    return plc->history[pos * plc->num_channels + ch];
+}
+
+
+// period that best continues the newest WINDOW frames, by normalized correlation of the
+// channel sum. Only runs when a loss begins, every other frame of the window is enough.
+static uint16_t find_period(const plc_t *plc) {
+    uint32_t max_period = plc->history_frames - WINDOW;
+    if (max_period > MAX_PERIOD) max_period = MAX_PERIOD;
+
+    float best_score = 0.0f;
+    uint16_t best_period = max_period;
+
+    for (uint32_t period = MIN_PERIOD; period <= max_period; period++) {
+        int64_t correlation = 0;
+        int64_t energy = 1;
+        for (uint32_t age = 1; age <= WINDOW; age += 2) {
+            int32_t recent = 0;
+            int32_t earlier = 0;
+            for (uint8_t ch = 0; ch < plc->num_channels; ch++) {
+                recent += history_sample(plc, age, ch);
+                earlier += history_sample(plc, age + period, ch);
+            }
+            correlation += (int64_t)recent * earlier;
+            energy += (int64_t)earlier * earlier;
+        }
+        if (correlation <= 0) continue;
+
+        // correlation / sqrt(energy), squared to save the root
+        float score = (float)correlation * (float)correlation / (float)energy;
+        if (score > best_score) {
+            best_score = score;
+            best_period = period;
+        }
+    }
+    return best_period;
+}
+
+
+// level of the repetition, Q15
+static int32_t conceal_gain(uint32_t concealed) {
+    if (concealed < HOLD) return 0x8000;
+    if (concealed >= HOLD + FADE_OUT) return 0;
+    return 0x8000 - (int32_t)((concealed - HOLD) * 0x8000 / FADE_OUT);
+}
+
+
+// next frame of the repetition, advances the phase
+static void synthesize(plc_t *plc, int16_t *frame) {
+    int32_t gain = conceal_gain(plc->concealed);
+    for (uint8_t ch = 0; ch < plc->num_channels; ch++) {
+        frame[ch] = (int16_t)((history_sample(plc, plc->period - plc->phase, ch) * gain) >> 15);
+    }
+    plc->phase = (plc->phase + 1) % plc->period;
+    plc->concealed++;
+}
+
+
+void plc_good_frames(plc_t *plc, int16_t *pcm, uint32_t num_frames, uint8_t num_channels) {
+    if (num_channels != plc->num_channels) {
+        plc->num_channels = num_channels;
+        plc->history_frames = 0;
+        plc->history_end = 0;
+        plc->concealing = false;
+    }
+
+    // blend from the repetition into the good audio
+    if (plc->concealing) {
+        uint32_t fade = num_frames < FADE_IN ? num_frames : FADE_IN;
+        for (uint32_t i = 0; i < fade; i++) {
+            int16_t synthetic[2];
+            synthesize(plc, synthetic);
+            for (uint8_t ch = 0; ch < num_channels; ch++) {
+                int16_t *sample = &pcm[i * num_channels + ch];
+                *sample = (int16_t)((*sample * (int32_t)i + synthetic[ch] * (int32_t)(fade - i)) / fade);
+            }
+        }
+        plc->concealing = false;
+    }
+
+    // remember, only the newest PLC_HISTORY_FRAMES matter
+    uint32_t skip = num_frames > PLC_HISTORY_FRAMES ? num_frames - PLC_HISTORY_FRAMES : 0;
+    for (uint32_t i = skip; i < num_frames; i++) {
+        memcpy(&plc->history[plc->history_end * num_channels], &pcm[i * num_channels], num_channels * sizeof(int16_t));
+        plc->history_end = (plc->history_end + 1) % PLC_HISTORY_FRAMES;
+    }
+    plc->history_frames += num_frames - skip;
+    if (plc->history_frames > PLC_HISTORY_FRAMES) plc->history_frames = PLC_HISTORY_FRAMES;
+}
+
+
+void plc_conceal(plc_t *plc, int16_t *pcm, uint32_t num_frames) {
+    // nothing to repeat yet
+    if (plc->history_frames < MIN_PERIOD + WINDOW) {
+        memset(pcm, 0, num_frames * plc->num_channels * sizeof(int16_t));
+        return;
+    }
+
+    // new loss: continue from the newest audio with its best matching period
+    if (!plc->concealing) {
+        plc->period = find_period(plc);
+        plc->phase = 0;
+        plc->concealed = 0;
+        plc->concealing = true;
+    }
+
+    for (uint32_t i = 0; i < num_frames; i++) {
+        synthesize(plc, &pcm[i * plc->num_channels]);
+    }
+}
+
+
+uint8_t plc_num_channels(const plc_t *plc) {
+    return plc->num_channels;
+}
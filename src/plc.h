@@ -0,0 +1,38 @@
+#ifndef plc_h
+#define plc_h
+
+// Packet loss concealment on decoded pcm. Audio of lost packets is synthesized
+// by repeating the last pitch period of the good audio, faded out when the loss
+// lasts longer. The first good audio after a loss is cross-faded with the
+// continued repetition, so there are no clicks at either end.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+#define PLC_HISTORY_FRAMES 640  // longest period plus correlation window
+
+
+typedef struct {
+    int16_t  history[PLC_HISTORY_FRAMES * 2];   // good audio, interleaved ring
+    uint16_t history_end;                       // next write position, audio frames
+    uint16_t history_frames;                    // valid audio frames
+    uint8_t  num_channels;
+    bool     concealing;
+    uint16_t period;                            // audio frames repeated
+    uint16_t phase;                             // position within the period
+    uint32_t concealed;                         // audio frames since the loss began
+} plc_t;
+
+
+void plc_init(plc_t *plc);
+
+// good audio, cross-faded in place after a loss, then remembered
+void plc_good_frames(plc_t *plc, int16_t *pcm, uint32_t num_frames, uint8_t num_channels);
+
+// synthesize num_frames of lost audio with plc_num_channels() channels
+void plc_conceal(plc_t *plc, int16_t *pcm, uint32_t num_frames);
+
+uint8_t plc_num_channels(const plc_t *plc);
+
+#endif
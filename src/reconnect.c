@@ -0,0 +1,116 @@
+#include "reconnect.h"
+
+#include <btstack.h>
+#include <string.h>
+
+#include "a2dp.h"
+#include "trace.h"
+
+
+#ifndef RECONNECT_SOURCES
+#define RECONNECT_SOURCES 2
+#endif
+
+#define SOURCES_TAG 0x52535243  // "RSRC", the addresses of the sources, most recent first
+
+
+static bd_addr_t _sources[RECONNECT_SOURCES > 0 ? RECONNECT_SOURCES : 1];
+static int _num_sources = 0;
+static int _next_source = 0;  // to page
+static bool _paging = false;
+static bd_addr_t _paged;
+
+
+static void load_sources(void) {
+    const btstack_tlv_t *tlv = NULL;
+    void *context = NULL;
+    btstack_tlv_get_instance(&tlv, &context);
+    if (!tlv) return;
+
+    int size = tlv->get_tag(context, SOURCES_TAG, (uint8_t *)_sources, sizeof(_sources));
+    _num_sources = size > 0 ? size / BD_ADDR_LEN : 0;
+}
+
+
+static void store_sources(void) {
+    const btstack_tlv_t *tlv = NULL;
+    void *context = NULL;
+    btstack_tlv_get_instance(&tlv, &context);
+    if (!tlv) return;
+
+    tlv->store_tag(context, SOURCES_TAG, (const uint8_t *)_sources, _num_sources * BD_ADDR_LEN);
+}
+
+
+// to the front, flash is only written if the order changes
+static void remember(bd_addr_t address) {
+    if (RECONNECT_SOURCES == 0) return;
+
+    int i = 0;
+    while (i < _num_sources && bd_addr_cmp(_sources[i], address)) {
+        i++;
+    }
+    if (i == 0 && _num_sources) return;
+    if (i == _num_sources && _num_sources < RECONNECT_SOURCES) {
+        _num_sources++;
+    }
+    if (i == RECONNECT_SOURCES) {
+        i--;  // the oldest goes
+    }
+    memmove(&_sources[1], &_sources[0], i * BD_ADDR_LEN);
+    bd_addr_copy(_sources[0], address);
+    store_sources();
+}
+
+
+// the next remembered source that still has a link key, it may have been unpaired meanwhile
+static void page_next(void) {
+    _paging = false;
+    while (_next_source < _num_sources) {
+        int source = _next_source++;
+        link_key_t link_key;
+        link_key_type_t type;
+        if (!gap_get_link_key_for_bd_addr(_sources[source], link_key, &type)) continue;
+
+        bd_addr_copy(_paged, _sources[source]);
+        if (a2dp_sink_connect(_paged) == ERROR_CODE_SUCCESS) {
+            trace_bt(TRACE_PAGE, source, 0);
+            _paging = true;
+            return;
+        }
+    }
+}
+
+
+void reconnect_begin(void) {
+    if (RECONNECT_SOURCES == 0) return;  // only waits for the sources
+
+    load_sources();
+    _next_source = 0;
+    page_next();
+}
+
+
+void reconnect_connection_complete(bd_addr_t address, uint8_t status) {
+    if (status == ERROR_CODE_SUCCESS) {
+        // a source is here, paged or by itself: page no more
+        _next_source = _num_sources;
+        _paging = false;
+
+        link_key_t link_key;
+        link_key_type_t type;
+        if (gap_get_link_key_for_bd_addr(address, link_key, &type)) {
+            remember(address);
+        }
+        return;
+    }
+
+    if (_paging && !bd_addr_cmp(address, _paged)) {
+        page_next();
+    }
+}
+
+
+void reconnect_bonded(bd_addr_t address) {
+    remember(address);
+}
@@ -0,0 +1,23 @@
+#ifndef reconnect_h
+#define reconnect_h
+
+// Reconnect to the sources last used once bluetooth is up, instead of waiting
+// for the phone. The most recent bonded sources, up to RECONNECT_SOURCES, are
+// remembered in the tlv store next to their link keys (flash), most recent first.
+// At boot they are paged one after the other until one answers or a source
+// connects by itself. bt.c feeds in the hci events.
+
+#include <bluetooth.h>
+#include <stdint.h>
+
+
+// bluetooth is up: page the remembered sources
+void reconnect_begin(void);
+
+// an acl connection completed, or failed, e.g. a page timed out
+void reconnect_connection_complete(bd_addr_t address, uint8_t status);
+
+// a source bonded anew
+void reconnect_bonded(bd_addr_t address);
+
+#endif
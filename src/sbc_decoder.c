@@ -0,0 +1,394 @@
+#include "sbc_decoder.h"
+
+#include <string.h>
+
+#include "volume.h"
+
+#ifdef __ARM_FEATURE_DSP
+#include <arm_acle.h>
+#endif
+
+
+// see A2DP spec 12.6 (bit allocation), 12.6.4 (reconstruction) and 12.8 (synthesis)
+
+#define SB_SHIFT   11   // fraction bits of subband samples
+#define OUT_SHIFT   8   // fraction bits of the synthesis output, SB_SHIFT - 1 (matrixing) - 2 (window)
+
+
+// bit allocation offsets for loudness, by sampling frequency index
+static const int8_t offset4[4][4] = {
+    { -1, 0, 0, 0 }, { -2, 0, 0, 1 }, { -2, 0, 0, 1 }, { -2, 0, 0, 1 } };
+static const int8_t offset8[4][8] = {
+    { -2, 0, 0, 0, 0, 0, 0, 1 }, { -3, 0, 0, 0, 0, 0, 1, 2 },
+    { -4, 0, 0, 0, 0, 0, 1, 2 }, { -4, 0, 0, 0, 0, 0, 1, 2 } };
+
+// 2^(30 + bits) / (2^bits - 1): dequantization without division
+static const uint32_t reciprocal[17] = {
+    0, 2147483648u, 1431655765, 1227133513, 1145324612, 1108378657, 1090785345, 1082196484, 1077952576,
+    1075843080, 1074791425, 1074266368, 1074004032, 1073872912, 1073807364, 1073774593, 1073758208 };
+
+// The synthesis of 12.8 is restructured, the result is the same up to rounding:
+// of the 2 * subbands matrixed values of a block only subbands are independent,
+// V(k') = -V(2M - k') and V(2M + j) = V(2M - j) for k' = k + M/2, V(M) = 0,
+// and of those the window only reads half, alternating with the age of the block.
+// So only the rows k' = M + 1..2M are matrixed, into u, with the mirrored signs
+// and the unused half folded into the window. The columns of these rows are
+// (anti)symmetric, cos((M - 1 - i + 0.5) k' pi / M) = (-1)^k' cos((i + 0.5) k' pi / M),
+// so pairs of subband samples are summed or subtracted first.
+
+// matrixing, rows k' = 5..8 of cos((i + 0.5) * k' * pi / 4), Q15, [m][i]
+static const int16_t matrix4[4][2] = {
+    { -12540,  30274 },
+    { -23170,  23170 },
+    { -30274, -12540 },
+    { -32768, -32768 },
+};
+
+// matrixing, rows k' = 9..16 of cos((i + 0.5) * k' * pi / 8), Q15, [m][i]
+static const int16_t matrix8[8][4] = {
+    {  -6393,  18205, -27246,  32138 },
+    { -12540,  30274, -30274,  12540 },
+    { -18205,  32138,  -6393, -27246 },
+    { -23170,  23170,  23170, -23170 },
+    { -27246,   6393,  32138,  18205 },
+    { -30274, -12540,  12540,  30274 },
+    { -32138, -27246, -18205,  -6393 },
+    { -32768, -32768, -32768, -32768 },
+};
+
+// window: -4 * Proto_4_40 of the A2DP spec, Q14, by age of the block and output sample
+static const int16_t window4[SBC_DECODER_HISTORY][4] = {
+    {      0,     35,      0,   -179 },
+    {   -251,   -255,   -122,    201 },
+    {    715,   1339,      0,  -2110 },
+    {  -1696,   -402,   1889,   5089 },
+    {   8886,  12779,      0, -18470 },
+    { -19288, -18470, -16164, -12779 },
+    {  -8886,  -5089,      0,   -402 },
+    {  -1696,  -2110,  -1892,  -1339 },
+    {   -715,   -201,      0,   -255 },
+    {   -251,   -179,    -98,    -35 },
+};
+
+// window: -8 * Proto_8_80 of the A2DP spec, Q14, by age of the block and output sample
+static const int16_t window8[SBC_DECODER_HISTORY][8] = {
+    {      0,     21,     45,     73,      0,   -149,   -194,   -234 },
+    {   -264,   -276,   -261,   -212,   -118,     23,    216,    458 },
+    {    742,   1052,   1371,   1671,      0,  -2085,  -2126,  -2008 },
+    {  -1696,  -1161,   -383,    644,   1919,   3422,   5122,   6971 },
+    {   8913,  10877,  12789,  14575,      0, -17467, -18449, -19057 },
+    { -19262, -19057, -18449, -17467, -16157, -14575, -12789, -10877 },
+    {  -8913,  -6971,  -5122,  -3422,      0,    644,   -383,  -1161 },
+    {  -1696,  -2008,  -2126,  -2085,  -1921,  -1671,  -1371,  -1052 },
+    {   -742,   -458,   -216,    -23,      0,   -212,   -261,   -276 },
+    {   -264,   -234,   -194,   -149,   -108,    -73,    -45,    -21 },
+};
+
+// which of the u of a block the window reads for an output sample, for even and odd ages
+static const uint8_t taps4[2][4] = { { 1, 0, 0, 0 }, { 1, 2, 3, 2 } };
+static const uint8_t taps8[2][8] = { { 3, 2, 1, 0, 0, 0, 1, 2 }, { 3, 4, 5, 6, 7, 6, 5, 4 } };
+
+
+// sum + (a * b) >> 16
+static inline int32_t mac_q16(int32_t sum, int32_t a, int16_t b) {
+#ifdef __ARM_FEATURE_DSP
+    return __smlawb(a, b, sum);
+#else
+    // the same with 32 bit products, the cortex-m0+ has no long multiply
+    return sum + (a >> 16) * b + (((a & 0xffff) * b) >> 16);
+#endif
+}
+
+
+typedef struct {
+    const uint8_t *data;
+    uint32_t size;
+    uint32_t position;   // bits
+} bit_reader_t;
+
+// up to 16 bits, msb first, zeros past the end
+static inline uint32_t read_bits(bit_reader_t *reader, uint8_t num_bits) {
+    uint32_t index = reader->position >> 3;
+    uint32_t word;
+    if (index + 2 < reader->size) {
+        word = (reader->data[index] << 16) | (reader->data[index + 1] << 8) | reader->data[index + 2];
+    } else {
+        word = 0;
+        for (uint32_t i = 0; i < 3; i++) {
+            word = (word << 8) | (index + i < reader->size ? reader->data[index + i] : 0);
+        }
+    }
+    uint32_t value = (word >> (24 - (reader->position & 7) - num_bits)) & ((1u << num_bits) - 1);
+    reader->position += num_bits;
+    return value;
+}
+
+
+// crc8 of the spec (x^8 + x^4 + x^3 + x^2 + 1), msb first
+static uint8_t crc8(uint8_t crc, const uint8_t *data, uint32_t num_bits) {
+    for (uint32_t i = 0; i < num_bits; i++) {
+        uint8_t bit = (data[i >> 3] >> (7 - (i & 7))) & 1;
+        crc = (uint8_t)(crc << 1) ^ ((((crc >> 7) ^ bit) & 1) ? 0x1d : 0);
+    }
+    return crc;
+}
+
+
+// bits per subband sample for the channels first..first+num_channels-1 that share the bitpool
+static void allocate(const sbc_header_t *header, uint8_t frequency_index,
+                     const uint8_t scale_factors[][SBC_DECODER_MAX_SUBBANDS], uint8_t bits[][SBC_DECODER_MAX_SUBBANDS],
+                     uint8_t first, uint8_t num_channels) {
+    uint8_t subbands = header->subbands;
+    const int8_t *offset = subbands == 4 ? offset4[frequency_index] : offset8[frequency_index];
+    int8_t bitneed[SBC_DECODER_MAX_CHANNELS][SBC_DECODER_MAX_SUBBANDS];
+    int max_bitneed = INT8_MIN;
+
+    for (uint8_t ch = first; ch < first + num_channels; ch++) {
+        for (uint8_t sb = 0; sb < subbands; sb++) {
+            int need;
+            if (header->allocation_method == AVDTP_SBC_ALLOCATION_METHOD_SNR) {
+                need = scale_factors[ch][sb];
+            } else if (scale_factors[ch][sb] == 0) {
+                need = -5;
+            } else {
+                int loudness = scale_factors[ch][sb] - offset[sb];
+                need = loudness > 0 ? loudness / 2 : loudness;
+            }
+            bitneed[ch][sb] = need;
+            if (need > max_bitneed) max_bitneed = need;
+        }
+    }
+
+    // lower the slice until the bitpool is used up
+    int bitcount = 0;
+    int slicecount = 0;
+    int bitslice = max_bitneed + 1;
+    do {
+        bitslice--;
+        bitcount += slicecount;
+        slicecount = 0;
+        for (uint8_t ch = first; ch < first + num_channels; ch++) {
+            for (uint8_t sb = 0; sb < subbands; sb++) {
+                if (bitneed[ch][sb] > bitslice + 1 && bitneed[ch][sb] < bitslice + 16) {
+                    slicecount++;
+                } else if (bitneed[ch][sb] == bitslice + 1) {
+                    slicecount += 2;
+                }
+            }
+        }
+    } while (bitcount + slicecount < header->bitpool);
+    if (bitcount + slicecount == header->bitpool) {
+        bitcount += slicecount;
+        bitslice--;
+    }
+
+    for (uint8_t ch = first; ch < first + num_channels; ch++) {
+        for (uint8_t sb = 0; sb < subbands; sb++) {
+            int need = bitneed[ch][sb] - bitslice;
+            bits[ch][sb] = bitneed[ch][sb] < bitslice + 2 ? 0 : need > 16 ? 16 : need;
+        }
+    }
+
+    // distribute what is left, subband by subband, channels of the group alternating
+    uint8_t count = subbands * num_channels;
+    for (uint8_t i = 0; i < count && bitcount < header->bitpool; i++) {
+        uint8_t ch = first + i % num_channels;
+        uint8_t sb = i / num_channels;
+        if (bits[ch][sb] >= 2 && bits[ch][sb] < 16) {
+            bits[ch][sb]++;
+            bitcount++;
+        } else if (bitneed[ch][sb] == bitslice + 1 && header->bitpool > bitcount + 1) {
+            bits[ch][sb] = 2;
+            bitcount += 2;
+        }
+    }
+    for (uint8_t i = 0; i < count && bitcount < header->bitpool; i++) {
+        uint8_t ch = first + i % num_channels;
+        uint8_t sb = i / num_channels;
+        if (bits[ch][sb] < 16) {
+            bits[ch][sb]++;
+            bitcount++;
+        }
+    }
+}
+
+
+// one block of one channel: subband samples to subbands pcm samples, stride apart.
+// u is the history of the channel from the slot of this block on, older blocks follow.
+static inline __attribute__((always_inline))
+void synthesize(int32_t (*u)[SBC_DECODER_MAX_SUBBANDS], const int32_t *samples, const uint8_t subbands, int16_t *pcm, const uint8_t stride) {
+    const int16_t *matrix = subbands == 4 ? &matrix4[0][0] : &matrix8[0][0];  // [m][i]
+    const int16_t *window = subbands == 4 ? &window4[0][0] : &window8[0][0];  // [age][j]
+    const uint8_t *taps = subbands == 4 ? &taps4[0][0] : &taps8[0][0];        // [age & 1][j]
+    const uint8_t half = subbands / 2;
+    int32_t sums[SBC_DECODER_MAX_SUBBANDS / 2];
+    int32_t differences[SBC_DECODER_MAX_SUBBANDS / 2];
+
+    for (uint8_t i = 0; i < half; i++) {
+        sums[i] = samples[i] + samples[subbands - 1 - i];
+        differences[i] = samples[i] - samples[subbands - 1 - i];
+    }
+
+    // k' = M + 1 + m is odd for even m, those rows are antisymmetric
+    for (uint8_t m = 0; m < subbands; m++) {
+        const int32_t *pairs = m & 1 ? sums : differences;
+        int32_t sum = 0;
+        for (uint8_t i = 0; i < half; i++) {
+            sum = mac_q16(sum, pairs[i], matrix[m * half + i]);
+        }
+        u[0][m] = u[SBC_DECODER_HISTORY][m] = sum;
+    }
+
+    for (uint8_t j = 0; j < subbands; j++) {
+        int32_t sum = 1 << (OUT_SHIFT - 1);
+        for (uint8_t age = 0; age < SBC_DECODER_HISTORY; age++) {
+            sum = mac_q16(sum, u[age][taps[(age & 1) * subbands + j]], window[age * subbands + j]);
+        }
+        sum >>= OUT_SHIFT;
+        pcm[j * stride] = sum > INT16_MAX ? INT16_MAX : sum < INT16_MIN ? INT16_MIN : sum;
+    }
+}
+
+
+// the frame after its header, with the layout as parameters: constants in the
+// specialized decoders below, so the compiler unrolls and folds the loops for them
+static inline __attribute__((always_inline))
+bool decode_frame(sbc_decoder_t *decoder, const uint8_t *data, const sbc_header_t *header, int16_t *pcm,
+                  const uint8_t subbands, const uint8_t blocks, const uint8_t num_channels, const bool shared, const bool joint) {
+    bit_reader_t reader = { data, header->frame_length, 32 };
+    uint8_t join = 0;
+    if (joint) {
+        for (uint8_t sb = 0; sb < subbands; sb++) {
+            join |= read_bits(&reader, 1) << sb;
+        }
+    }
+    uint8_t scale_factors[SBC_DECODER_MAX_CHANNELS][SBC_DECODER_MAX_SUBBANDS];
+    for (uint8_t ch = 0; ch < num_channels; ch++) {
+        for (uint8_t sb = 0; sb < subbands; sb++) {
+            scale_factors[ch][sb] = read_bits(&reader, 4);
+        }
+    }
+
+    // covers the header except sync word and crc itself, join flags and scale factors
+    uint8_t crc = crc8(0x0f, &data[1], 16);
+    crc = crc8(crc, &data[4], reader.position - 32);
+    if (crc != data[3]) return false;
+
+    uint8_t bits[SBC_DECODER_MAX_CHANNELS][SBC_DECODER_MAX_SUBBANDS];
+    uint8_t frequency_index = (data[1] >> 6) & 0x03;
+    if (shared) {
+        allocate(header, frequency_index, scale_factors, bits, 0, 2);
+    } else {
+        for (uint8_t ch = 0; ch < num_channels; ch++) {
+            allocate(header, frequency_index, scale_factors, bits, ch, 1);
+        }
+    }
+
+    // sample = 2^(scale factor + 1) * ((2 * quantized + 1) / levels - 1) * gain,
+    // everything but the odd numerator is constant for the frame. The factor is
+    // at most 2^30 / levels, so the products fit 32 bits (no long multiply on the m0+)
+    int32_t factor[SBC_DECODER_MAX_CHANNELS][SBC_DECODER_MAX_SUBBANDS];
+    uint8_t shift[SBC_DECODER_MAX_CHANNELS][SBC_DECODER_MAX_SUBBANDS];
+    for (uint8_t ch = 0; ch < num_channels; ch++) {
+        for (uint8_t sb = 0; sb < subbands; sb++) {
+            uint8_t num_bits = bits[ch][sb];
+            factor[ch][sb] = (int32_t)(((uint64_t)reciprocal[num_bits] * (uint32_t)decoder->gain) >> (VOLUME_SHIFT + num_bits));
+            shift[ch][sb] = 30 - (scale_factors[ch][sb] + 1) - SB_SHIFT;
+        }
+    }
+
+    if (subbands != decoder->subbands) {
+        sbc_decoder_reset(decoder);
+        decoder->subbands = subbands;
+    }
+
+    for (uint8_t blk = 0; blk < blocks; blk++) {
+        int32_t samples[SBC_DECODER_MAX_CHANNELS][SBC_DECODER_MAX_SUBBANDS];
+        for (uint8_t ch = 0; ch < num_channels; ch++) {
+            for (uint8_t sb = 0; sb < subbands; sb++) {
+                uint8_t num_bits = bits[ch][sb];
+                if (num_bits == 0) {
+                    samples[ch][sb] = 0;
+                    continue;
+                }
+                int32_t levels = (1 << num_bits) - 1;
+                int32_t numerator = 2 * (int32_t)read_bits(&reader, num_bits) + 1 - levels;
+                samples[ch][sb] = (numerator * factor[ch][sb]) >> shift[ch][sb];
+            }
+        }
+
+        // joint subbands carry (left + right) / 2 and (left - right) / 2
+        for (uint8_t sb = 0; joint && sb < subbands; sb++) {
+            if (join & (1 << sb)) {
+                int32_t mid = samples[0][sb];
+                int32_t side = samples[1][sb];
+                samples[0][sb] = mid + side;
+                samples[1][sb] = mid - side;
+            }
+        }
+
+        // the history moves by one slot per block, the slot is also written
+        // SBC_DECODER_HISTORY further on, so the window always sees it contiguous
+        decoder->position = decoder->position ? decoder->position - 1 : SBC_DECODER_HISTORY - 1;
+        for (uint8_t ch = 0; ch < num_channels; ch++) {
+            synthesize(&decoder->u[ch][decoder->position], samples[ch], subbands, &pcm[blk * subbands * num_channels + ch], num_channels);
+        }
+    }
+    return true;
+}
+
+
+static bool decode_generic(sbc_decoder_t *decoder, const uint8_t *data, const sbc_header_t *header, int16_t *pcm) {
+    bool joint = header->channel_mode == AVDTP_CHANNEL_MODE_JOINT_STEREO;
+    bool shared = joint || header->channel_mode == AVDTP_CHANNEL_MODE_STEREO;
+    return decode_frame(decoder, data, header, pcm, header->subbands, header->block_length, header->num_channels, shared, joint);
+}
+
+
+#ifndef SBC_DECODER_GENERIC_ONLY
+
+// what nearly every source sends: 8 subbands, 16 blocks, (joint) stereo
+static bool decode_8_16_stereo(sbc_decoder_t *decoder, const uint8_t *data, const sbc_header_t *header, int16_t *pcm) {
+    return decode_frame(decoder, data, header, pcm, 8, 16, 2, true, false);
+}
+
+static bool decode_8_16_joint(sbc_decoder_t *decoder, const uint8_t *data, const sbc_header_t *header, int16_t *pcm) {
+    return decode_frame(decoder, data, header, pcm, 8, 16, 2, true, true);
+}
+
+#endif
+
+
+void sbc_decoder_init(sbc_decoder_t *decoder) {
+    decoder->gain = VOLUME_UNITY;
+    sbc_decoder_reset(decoder);
+}
+
+
+void sbc_decoder_reset(sbc_decoder_t *decoder) {
+    memset(decoder->u, 0, sizeof(decoder->u));
+    decoder->position = 0;
+    decoder->subbands = 0;
+}
+
+
+void sbc_decoder_set_gain(sbc_decoder_t *decoder, int32_t gain) {
+    decoder->gain = gain;
+}
+
+
+bool sbc_decoder_decode(sbc_decoder_t *decoder, const uint8_t *data, uint32_t size, int16_t *pcm, sbc_header_t *header) {
+    if (!sbc_header_parse(data, size, header) || header->frame_length > size) return false;
+
+    // more than all subbands can take would never finish the allocation
+    bool shared = header->channel_mode == AVDTP_CHANNEL_MODE_JOINT_STEREO || header->channel_mode == AVDTP_CHANNEL_MODE_STEREO;
+    if (header->bitpool > (shared ? 32 : 16) * header->subbands) return false;
+
+#ifndef SBC_DECODER_GENERIC_ONLY
+    if (header->subbands == 8 && header->block_length == 16) {
+        if (header->channel_mode == AVDTP_CHANNEL_MODE_JOINT_STEREO) return decode_8_16_joint(decoder, data, header, pcm);
+        if (header->channel_mode == AVDTP_CHANNEL_MODE_STEREO) return decode_8_16_stereo(decoder, data, header, pcm);
+    }
+#endif
+    return decode_generic(decoder, data, header, pcm);
+}
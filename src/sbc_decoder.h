@@ -0,0 +1,51 @@
+#ifndef sbc_decoder_h
+#define sbc_decoder_h
+
+// Fixed point sbc decoder with volume in the subband domain.
+// The gain is folded into the dequantization of the subband samples, so the
+// synthesis filterbank directly produces scaled pcm: there is no per sample
+// volume pass and quiet audio is rounded to 16 bit only once, at the end.
+// Subband samples are Q11 in units of the 16 bit output, products are 32x16
+// bit (smlawb on the Cortex-M33, two 16 bit multiplies on the Cortex-M0+).
+// Frames with 8 subbands, 16 blocks and (joint) stereo, what nearly every
+// source sends, take decoders specialized for that layout, everything else
+// the generic one. Both give the same result. SBC_DECODER_GENERIC_ONLY
+// leaves the specialized ones out, e.g. to save flash.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sbc_header.h"
+
+
+#define SBC_DECODER_MAX_CHANNELS   2
+#define SBC_DECODER_MAX_SUBBANDS   8
+#define SBC_DECODER_MAX_BLOCKS    16
+#define SBC_DECODER_MAX_SAMPLES   (SBC_DECODER_MAX_BLOCKS * SBC_DECODER_MAX_SUBBANDS)
+
+
+#define SBC_DECODER_HISTORY       10  // blocks the synthesis window spans
+
+
+typedef struct {
+    // matrixed blocks of the synthesis, every slot twice, the newest at position
+    int32_t u[SBC_DECODER_MAX_CHANNELS][2 * SBC_DECODER_HISTORY][SBC_DECODER_MAX_SUBBANDS];
+    uint8_t position;
+    uint8_t subbands;   // the history belongs to
+    int32_t gain;       // Q15, VOLUME_UNITY passes the audio unchanged
+} sbc_decoder_t;
+
+
+void sbc_decoder_init(sbc_decoder_t *decoder);
+
+// forget the synthesis history, e.g. after a pause
+void sbc_decoder_reset(sbc_decoder_t *decoder);
+
+// applies from the next frame on
+void sbc_decoder_set_gain(sbc_decoder_t *decoder, int32_t gain);
+
+// decode the frame at the start of data into interleaved pcm of header->num_samples audio frames,
+// false if it is incomplete or corrupt (crc mismatch), then pcm is unchanged
+bool sbc_decoder_decode(sbc_decoder_t *decoder, const uint8_t *data, uint32_t size, int16_t *pcm, sbc_header_t *header);
+
+#endif
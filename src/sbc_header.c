@@ -0,0 +1,40 @@
+#include "sbc_header.h"
+
+
+#define SBC_SYNCWORD 0x9c
+
+
+bool sbc_header_parse(const uint8_t *data, uint32_t size, sbc_header_t *header) {
+    static const uint16_t frequencies[] = { 16000, 32000, 44100, 48000 };
+    static const avdtp_channel_mode_t modes[] = {
+        AVDTP_CHANNEL_MODE_MONO, AVDTP_CHANNEL_MODE_DUAL_CHANNEL,
+        AVDTP_CHANNEL_MODE_STEREO, AVDTP_CHANNEL_MODE_JOINT_STEREO };
+
+    if (size < 4 || data[0] != SBC_SYNCWORD) return false;
+
+    header->sampling_frequency = frequencies[(data[1] >> 6) & 0x03];
+    header->block_length = 4 * (((data[1] >> 4) & 0x03) + 1);
+    header->channel_mode = modes[(data[1] >> 2) & 0x03];
+    header->allocation_method = (data[1] & 0x02) ? AVDTP_SBC_ALLOCATION_METHOD_SNR : AVDTP_SBC_ALLOCATION_METHOD_LOUDNESS;
+    header->subbands = (data[1] & 0x01) ? 8 : 4;
+    header->bitpool = data[2];
+    header->num_channels = header->channel_mode == AVDTP_CHANNEL_MODE_MONO ? 1 : 2;
+    header->num_samples = header->block_length * header->subbands;
+
+    // bits for the quantized subband samples, see A2DP spec 12.9
+    uint32_t bits;
+    switch (header->channel_mode) {
+        case AVDTP_CHANNEL_MODE_MONO:
+        case AVDTP_CHANNEL_MODE_DUAL_CHANNEL:
+            bits = header->block_length * header->num_channels * header->bitpool;
+            break;
+        case AVDTP_CHANNEL_MODE_JOINT_STEREO:
+            bits = header->subbands + header->block_length * header->bitpool;
+            break;
+        default:
+            bits = header->block_length * header->bitpool;
+            break;
+    }
+    header->frame_length = 4 + (4 * header->subbands * header->num_channels) / 8 + (bits + 7) / 8;
+    return true;
+}
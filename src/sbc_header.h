@@ -0,0 +1,29 @@
+#ifndef sbc_header_h
+#define sbc_header_h
+
+// Parser for the 4 byte header in front of every sbc frame, used to slice
+// media packets into frames and to learn their length and duration.
+
+#include <btstack.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+typedef struct {
+    uint16_t sampling_frequency;
+    avdtp_channel_mode_t channel_mode;
+    avdtp_sbc_allocation_method_t allocation_method;
+    uint8_t  num_channels;
+    uint8_t  block_length;
+    uint8_t  subbands;
+    uint8_t  bitpool;
+    uint16_t frame_length;   // bytes including the header
+    uint16_t num_samples;    // audio frames per channel, block_length * subbands
+} sbc_header_t;
+
+
+// false if data does not start with an sbc frame header
+bool sbc_header_parse(const uint8_t *data, uint32_t size, sbc_header_t *header);
+
+#endif
@@ -0,0 +1,143 @@
+#include "sbc_queue.h"
+
+#include <string.h>
+
+
+// frame indices run from 0 to 2*max_frames-1, so a full queue can be told from an empty one
+
+
+static uint32_t advance(const sbc_queue_t *queue, uint32_t index, uint32_t count) {
+    index += count;
+    if (index >= 2 * queue->max_frames) index -= 2 * queue->max_frames;
+    return index;
+}
+
+
+static uint32_t distance(const sbc_queue_t *queue, uint32_t from, uint32_t to) {
+    return to >= from ? to - from : to + 2 * queue->max_frames - from;
+}
+
+
+static uint32_t position(const sbc_queue_t *queue, uint32_t index) {
+    return index < queue->max_frames ? index : index - queue->max_frames;
+}
+
+
+void sbc_queue_init(sbc_queue_t *queue, uint8_t *storage, uint32_t size, sbc_frame_t *frames, uint32_t max_frames) {
+    queue->storage = storage;
+    queue->size = size;
+    queue->frames = frames;
+    queue->max_frames = max_frames;
+    sbc_queue_reset(queue);
+}
+
+
+void sbc_queue_reset(sbc_queue_t *queue) {
+    queue->write_offset = 0;
+    queue->bytes_written = 0;
+    atomic_store_explicit(&queue->bytes_read, 0, memory_order_relaxed);
+    atomic_store_explicit(&queue->samples_written, 0, memory_order_relaxed);
+    atomic_store_explicit(&queue->samples_read, 0, memory_order_relaxed);
+    atomic_store_explicit(&queue->write_index, 0, memory_order_relaxed);
+    atomic_store_explicit(&queue->read_index, 0, memory_order_release);
+}
+
+
+// find room for length contiguous bytes behind the newest frame, or at the start of
+// storage if they do not fit before its end. Bytes in front of the oldest frame are in use.
+static bool reserve(sbc_queue_t *queue, uint32_t read_index, uint32_t write_index, uint32_t length, uint32_t *offset) {
+    if (read_index == write_index) {
+        // empty, the consumer holds no frame data
+        queue->write_offset = 0;
+        *offset = 0;
+        return length <= queue->size;
+    }
+
+    uint32_t newest_end = queue->write_offset;
+    if (queue->bytes_written == atomic_load_explicit(&queue->bytes_read, memory_order_acquire)) {
+        // only lost audio queued, all storage is free. Their offsets still mark where
+        // frame data behind them starts, so keep going from the newest end.
+        *offset = newest_end + length <= queue->size ? newest_end : 0;
+        return length <= queue->size;
+    }
+
+    uint32_t oldest = queue->frames[position(queue, read_index)].offset;
+
+    if (newest_end > oldest) {
+        if (newest_end + length <= queue->size) {
+            *offset = newest_end;
+            return true;
+        }
+        *offset = 0;
+        return length <= oldest;
+    }
+    *offset = newest_end;
+    return newest_end + length <= oldest;
+}
+
+
+bool sbc_queue_write(sbc_queue_t *queue, const uint8_t *data, uint16_t length, uint16_t samples, uint32_t timestamp) {
+    uint32_t write_index = atomic_load_explicit(&queue->write_index, memory_order_relaxed);
+    uint32_t read_index = atomic_load_explicit(&queue->read_index, memory_order_acquire);
+
+    if (distance(queue, read_index, write_index) == queue->max_frames) return false;
+
+    uint32_t offset;
+    if (!reserve(queue, read_index, write_index, length, &offset)) return false;
+
+    // copy frame and descriptor, then publish
+    if (length) memcpy(&queue->storage[offset], data, length);
+    sbc_frame_t *frame = &queue->frames[position(queue, write_index)];
+    frame->offset = offset;
+    frame->length = length;
+    frame->samples = samples;
+    frame->timestamp = timestamp;
+    queue->write_offset = offset + length;
+    queue->bytes_written += length;
+
+    uint32_t samples_written = atomic_load_explicit(&queue->samples_written, memory_order_relaxed);
+    atomic_store_explicit(&queue->samples_written, samples_written + samples, memory_order_release);
+    atomic_store_explicit(&queue->write_index, advance(queue, write_index, 1), memory_order_release);
+    return true;
+}
+
+
+const sbc_frame_t * sbc_queue_peek(sbc_queue_t *queue, uint32_t n) {
+    uint32_t read_index = atomic_load_explicit(&queue->read_index, memory_order_relaxed);
+    uint32_t write_index = atomic_load_explicit(&queue->write_index, memory_order_acquire);
+
+    if (n >= distance(queue, read_index, write_index)) return NULL;
+    return &queue->frames[position(queue, advance(queue, read_index, n))];
+}
+
+
+void sbc_queue_consume(sbc_queue_t *queue, uint32_t num_frames) {
+    uint32_t read_index = atomic_load_explicit(&queue->read_index, memory_order_relaxed);
+    uint32_t samples_read = atomic_load_explicit(&queue->samples_read, memory_order_relaxed);
+    uint32_t bytes_read = atomic_load_explicit(&queue->bytes_read, memory_order_relaxed);
+
+    for (uint32_t i = 0; i < num_frames; i++) {
+        const sbc_frame_t *frame = &queue->frames[position(queue, advance(queue, read_index, i))];
+        samples_read += frame->samples;
+        bytes_read += frame->length;
+    }
+
+    atomic_store_explicit(&queue->samples_read, samples_read, memory_order_release);
+    atomic_store_explicit(&queue->bytes_read, bytes_read, memory_order_release);
+    atomic_store_explicit(&queue->read_index, advance(queue, read_index, num_frames), memory_order_release);
+}
+
+
+uint32_t sbc_queue_frames(sbc_queue_t *queue) {
+    uint32_t read_index = atomic_load_explicit(&queue->read_index, memory_order_acquire);
+    uint32_t write_index = atomic_load_explicit(&queue->write_index, memory_order_acquire);
+    return distance(queue, read_index, write_index);
+}
+
+
+uint32_t sbc_queue_samples(sbc_queue_t *queue) {
+    // read first, so a concurrent consumer can only make the result too large, not wrap it
+    uint32_t samples_read = atomic_load_explicit(&queue->samples_read, memory_order_acquire);
+    uint32_t samples_written = atomic_load_explicit(&queue->samples_written, memory_order_acquire);
+    return samples_written - samples_read;
+}
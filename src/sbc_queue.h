@@ -0,0 +1,63 @@
+#ifndef sbc_queue_h
+#define sbc_queue_h
+
+// Lock-free single producer / single consumer queue for sbc frames.
+// media_handler() on core 0 writes, the decoder (core 1, refill irq or run loop) reads.
+// Each side only ever updates its own index, so no locks are needed.
+//
+// Every frame has a descriptor, so frames of different size (e.g. after the
+// source changed the bitpool) can be mixed. Frame data never wraps around the
+// end of storage and can always be decoded in place.
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+typedef struct {
+    uint32_t offset;     // into storage
+    uint16_t length;     // bytes, 0 for lost audio to conceal
+    uint16_t samples;    // audio frames per channel
+    uint32_t timestamp;  // rtp timestamp of the first sample
+} sbc_frame_t;
+
+typedef struct {
+    uint8_t *storage;
+    uint32_t size;
+    sbc_frame_t *frames;
+    uint32_t max_frames;
+    uint32_t write_offset;                   // end of the newest frame, producer only
+    uint32_t bytes_written;                  // free running, producer only
+    atomic_uint_least32_t bytes_read;        // free running, consumer only
+    atomic_uint_least32_t write_index;       // frames, producer only
+    atomic_uint_least32_t read_index;        // frames, consumer only
+    atomic_uint_least32_t samples_written;   // free running, producer only
+    atomic_uint_least32_t samples_read;      // free running, consumer only
+} sbc_queue_t;
+
+
+void sbc_queue_init(sbc_queue_t *queue, uint8_t *storage, uint32_t size, sbc_frame_t *frames, uint32_t max_frames);
+
+// discard everything, only while neither side is active
+void sbc_queue_reset(sbc_queue_t *queue);
+
+// producer: store a complete frame, false if there is not enough room.
+// A frame of length 0 (data NULL) stands for samples of lost audio.
+bool sbc_queue_write(sbc_queue_t *queue, const uint8_t *data, uint16_t length, uint16_t samples, uint32_t timestamp);
+
+// consumer: n-th queued frame, 0 is the oldest, NULL if fewer are queued.
+// The frame data stays valid until the frame is consumed.
+const sbc_frame_t * sbc_queue_peek(sbc_queue_t *queue, uint32_t n);
+
+static inline const uint8_t * sbc_queue_frame_data(const sbc_queue_t *queue, const sbc_frame_t *frame) {
+    return &queue->storage[frame->offset];
+}
+
+// consumer: release the oldest num_frames frames
+void sbc_queue_consume(sbc_queue_t *queue, uint32_t num_frames);
+
+// frames and audio frames (samples per channel) queued, usable from both sides
+uint32_t sbc_queue_frames(sbc_queue_t *queue);
+uint32_t sbc_queue_samples(sbc_queue_t *queue);
+
+#endif
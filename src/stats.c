@@ -0,0 +1,131 @@
+#include "stats.h"
+
+#include <stdio.h>
+#include <string.h>
+
+
+static const int32_t _correction_limits[STATS_CORRECTION_BUCKETS - 1] = { -1000, -300, -100, -30, 30, 100, 300, 1000 };
+
+
+void stats_init(stats_t *stats, uint32_t capacity) {
+    memset(stats, 0, sizeof(*stats));
+    stats->capacity = capacity;
+    stats->generation = 1;
+}
+
+
+void stats_set_sample_rate(stats_t *stats, uint32_t sample_rate) {
+    stats->sample_rate = sample_rate;
+}
+
+
+void stats_reset(stats_t *stats) {
+    memset(&stats->source, 0, sizeof(stats->source));
+    stats->generation++;
+}
+
+
+void stats_received(stats_t *stats, bool stored, uint32_t queued_frames) {
+    stats->source.received_frames++;
+    if (!stored) {
+        stats->source.overflow_frames++;
+    }
+    if (queued_frames > stats->source.peak_queued) {
+        stats->source.peak_queued = queued_frames;
+    }
+}
+
+
+// the decoder part starts over once it sees a reset
+static stats_decoder_t *decoder(stats_t *stats) {
+    uint32_t generation = stats->generation;
+    if (stats->decoder.generation != generation) {
+        memset(&stats->decoder, 0, sizeof(stats->decoder));
+        stats->decoder.generation = generation;
+    }
+    return &stats->decoder;
+}
+
+
+void stats_refill(stats_t *stats, uint32_t queued_frames, int32_t correction_ppm, uint32_t audio_frames) {
+    stats_decoder_t *counts = decoder(stats);
+    counts->refills++;
+
+    int bucket = 0;
+    while (bucket < STATS_CORRECTION_BUCKETS - 1 && correction_ppm >= _correction_limits[bucket]) {
+        bucket++;
+    }
+    counts->correction_frames[bucket] += audio_frames;
+
+    uint32_t occupancy = stats->capacity ? queued_frames * STATS_OCCUPANCY_BUCKETS / stats->capacity : 0;
+    if (occupancy >= STATS_OCCUPANCY_BUCKETS) {
+        occupancy = STATS_OCCUPANCY_BUCKETS - 1;
+    }
+    counts->occupancy[occupancy]++;
+}
+
+
+void stats_underrun(stats_t *stats, uint32_t audio_frames, bool first) {
+    stats_decoder_t *counts = decoder(stats);
+    if (first) {
+        counts->underruns++;
+        counts->current_underrun_frames = 0;
+    }
+    counts->underrun_frames += audio_frames;
+    counts->current_underrun_frames += audio_frames;
+    if (counts->current_underrun_frames > counts->longest_underrun_frames) {
+        counts->longest_underrun_frames = counts->current_underrun_frames;
+    }
+}
+
+
+void stats_overflow(stats_t *stats, uint32_t audio_frames) {
+    decoder(stats)->overflow_frames += audio_frames;
+}
+
+
+void stats_get(const stats_t *stats, stats_t *copy) {
+    *copy = *stats;
+    if (copy->decoder.generation != copy->generation) {
+        memset(&copy->decoder, 0, sizeof(copy->decoder));
+    }
+}
+
+
+static uint32_t frames_to_ms(const stats_t *stats, uint32_t frames) {
+    return stats->sample_rate ? (uint32_t)((uint64_t)frames * 1000 / stats->sample_rate) : 0;
+}
+
+
+void stats_print(const stats_t *stats, const char *prefix) {
+    const stats_source_t *source = &stats->source;
+    const stats_decoder_t *counts = &stats->decoder;
+
+    printf("%sframes received %u, dropped for want of room %u, store peak %u of %u frames\n", prefix,
+        (unsigned)source->received_frames, (unsigned)source->overflow_frames,
+        (unsigned)source->peak_queued, (unsigned)stats->capacity);
+    printf("%sunderruns %u, %u ms of silence, longest %u ms, ring buffer overflow %u audio frames\n", prefix,
+        (unsigned)counts->underruns, (unsigned)frames_to_ms(stats, counts->underrun_frames),
+        (unsigned)frames_to_ms(stats, counts->longest_underrun_frames), (unsigned)counts->overflow_frames);
+
+    uint64_t played = 0;
+    for (int i = 0; i < STATS_CORRECTION_BUCKETS; i++) {
+        played += counts->correction_frames[i];
+    }
+    printf("%scorrection ppm", prefix);
+    for (int i = 0; i < STATS_CORRECTION_BUCKETS; i++) {
+        if (i < STATS_CORRECTION_BUCKETS - 1) {
+            printf(" <%d:", (int)_correction_limits[i]);
+        } else {
+            printf(" >=%d:", (int)_correction_limits[i - 1]);
+        }
+        printf("%u%%", played ? (unsigned)(counts->correction_frames[i] * 100ull / played) : 0);
+    }
+    printf("\n");
+
+    printf("%sstore occupancy in sixteenths at %u refills:", prefix, (unsigned)counts->refills);
+    for (int i = 0; i < STATS_OCCUPANCY_BUCKETS; i++) {
+        printf(" %u", (unsigned)counts->occupancy[i]);
+    }
+    printf("\n");
+}
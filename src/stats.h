@@ -0,0 +1,72 @@
+#ifndef stats_h
+#define stats_h
+
+// Counters of the media pipeline for sizing its buffers per installation:
+// frames received and dropped for want of room, underruns (how often, how
+// long), how long playback ran at which resampling correction, and how full
+// the sbc frame store was at every i2s refill. The bluetooth side and the
+// decoder side count into separate parts, each written by its own core.
+// A reset clears the bluetooth part at once, the decoder part on its next count.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+#define STATS_CORRECTION_BUCKETS  9   // ppm up to -1000, -300, -100, -30, below 30, 100, 300, 1000, above
+#define STATS_OCCUPANCY_BUCKETS   16  // sixteenths of the frame store, the last includes full
+
+
+typedef struct {
+    uint32_t received_frames;  // sbc frames, aptx chunks or aac access units offered to the frame store
+    uint32_t overflow_frames;  // of those, not stored for want of room
+    uint32_t peak_queued;      // frames in the store after a write
+} stats_source_t;
+
+typedef struct {
+    uint32_t generation;                  // of the reset it counts since
+    uint32_t refills;
+    uint32_t underruns;                   // times the store ran dry
+    uint32_t underrun_frames;             // audio frames of silence until the store was refilled
+    uint32_t longest_underrun_frames;
+    uint32_t current_underrun_frames;     // of the last underrun
+    uint32_t overflow_frames;             // decoded audio frames that did not fit the ring buffer
+    uint32_t correction_frames[STATS_CORRECTION_BUCKETS];  // audio frames played at a correction
+    uint32_t occupancy[STATS_OCCUPANCY_BUCKETS];           // refills by frames in the store
+} stats_decoder_t;
+
+typedef struct {
+    uint32_t sample_rate;  // of the last stream, for durations
+    uint32_t capacity;     // frames the store holds
+    stats_source_t source;
+    stats_decoder_t decoder;
+    volatile uint32_t generation;
+} stats_t;
+
+
+void stats_init(stats_t *stats, uint32_t capacity);
+
+void stats_set_sample_rate(stats_t *stats, uint32_t sample_rate);
+
+// from the bluetooth side
+void stats_reset(stats_t *stats);
+
+// bluetooth side: a frame offered to the store, queued frames after it
+void stats_received(stats_t *stats, bool stored, uint32_t queued_frames);
+
+// decoder side: an i2s refill of audio_frames, with queued frames in the store before it
+// and the resampling (or i2s clock) correction in ppm the audio is played with
+void stats_refill(stats_t *stats, uint32_t queued_frames, int32_t correction_ppm, uint32_t audio_frames);
+
+// decoder side: audio frames of silence, the first ones of an underrun or more of the current one
+void stats_underrun(stats_t *stats, uint32_t audio_frames, bool first);
+
+// decoder side: decoded audio frames lost for want of room
+void stats_overflow(stats_t *stats, uint32_t audio_frames);
+
+// a copy, with the decoder part cleared if it has not seen the last reset yet
+void stats_get(const stats_t *stats, stats_t *copy);
+
+// readable lines on stdout, each starting with prefix
+void stats_print(const stats_t *stats, const char *prefix);
+
+#endif
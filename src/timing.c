@@ -0,0 +1,191 @@
+#include "timing.h"
+
+#include <string.h>
+
+#include "pico/time.h"
+
+#ifdef __arm__
+#include "hardware/clocks.h"
+#endif
+
+
+#define MAGIC    "PTIM"
+#define VERSION  2
+
+
+static timing_record_t _records[TIMING_STAGES];
+static volatile uint32_t _generation = 1;  // records of older ones are void
+static uint64_t _start_us;
+static uint32_t _deadline_us;
+
+static const char *_names[TIMING_STAGES] = {
+    [TIMING_MEDIA]    = "media",
+    [TIMING_EVENT]    = "event",
+    [TIMING_FILL]     = "fill",
+    [TIMING_DECODE]   = "decode",
+    [TIMING_VOLUME]   = "volume",
+    [TIMING_RESAMPLE] = "resample",
+    [TIMING_HCI]      = "hci",
+    [TIMING_AVRCP]    = "avrcp",
+    [TIMING_REFILL_WAIT] = "refill_wait",
+    [TIMING_LOOP_LATE]   = "loop_late",
+};
+
+
+void timing_init(void) {
+    timing_init_core();
+    timing_reset();
+}
+
+
+void timing_init_core(void) {
+#ifdef __arm__
+    // free running at the processor clock, no interrupt
+    systick_hw->csr = 0;
+    systick_hw->rvr = TIMING_CYCLE_MASK;
+    systick_hw->cvr = 0;
+    systick_hw->csr = 5;  // CLKSOURCE | ENABLE
+#endif
+}
+
+
+void timing_reset(void) {
+    _start_us = time_us_64();
+    _generation++;
+}
+
+
+void timing_add(timing_stage_t stage, uint32_t cycles) {
+    timing_record_t *record = &_records[stage];
+    uint32_t generation = _generation;
+    if (record->generation != generation) {
+        memset(record, 0, sizeof(*record));
+        record->generation = generation;
+        record->min = UINT32_MAX;
+    }
+
+    uint32_t bucket = cycles ? 32 - __builtin_clz(cycles) : 0;
+    if (bucket >= TIMING_BUCKETS) {
+        bucket = TIMING_BUCKETS - 1;
+    }
+    record->histogram[bucket]++;
+    record->count++;
+    record->sum += cycles;
+    if (cycles < record->min) record->min = cycles;
+    if (cycles > record->max) record->max = cycles;
+}
+
+
+static uint32_t system_clock_hz(void) {
+#ifdef __arm__
+    return clock_get_hz(clk_sys);
+#else
+    return 1000000000;
+#endif
+}
+
+
+void timing_add_us(timing_stage_t stage, uint32_t us) {
+    uint64_t cycles = (uint64_t)us * system_clock_hz() / 1000000;
+    timing_add(stage, cycles > UINT32_MAX ? UINT32_MAX : (uint32_t)cycles);
+}
+
+
+void timing_set_deadline_us(uint32_t us) {
+    _deadline_us = us;
+}
+
+
+static uint8_t *put_32(uint8_t *pos, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        *pos++ = value >> (8 * i);
+    }
+    return pos;
+}
+
+
+static const uint8_t *get_32(const uint8_t *pos, uint32_t *value) {
+    *value = pos[0] | pos[1] << 8 | pos[2] << 16 | (uint32_t)pos[3] << 24;
+    return pos + 4;
+}
+
+
+static uint16_t checksum(const uint8_t *buffer, uint32_t size) {
+    uint16_t sum = 0;
+    for (uint32_t i = 0; i < size; i++) {
+        sum += buffer[i];
+    }
+    return sum;
+}
+
+
+uint32_t timing_encode(uint8_t *buffer, uint32_t size) {
+    if (size < TIMING_RECORD_SIZE) return 0;
+
+    uint8_t *pos = buffer;
+    memcpy(pos, MAGIC, 4);
+    pos += 4;
+    *pos++ = VERSION;
+    *pos++ = TIMING_STAGES;
+    *pos++ = TIMING_BUCKETS;
+    *pos++ = 0;
+    pos = put_32(pos, system_clock_hz());
+    pos = put_32(pos, (uint32_t)((time_us_64() - _start_us) / 1000));
+    pos = put_32(pos, _deadline_us);
+
+    uint32_t generation = _generation;
+    for (int stage = 0; stage < TIMING_STAGES; stage++) {
+        timing_record_t record = _records[stage];
+        if (record.generation != generation) {
+            memset(&record, 0, sizeof(record));
+        }
+        pos = put_32(pos, record.count);
+        pos = put_32(pos, record.count ? record.min : 0);
+        pos = put_32(pos, record.max);
+        pos = put_32(pos, (uint32_t)record.sum);
+        pos = put_32(pos, (uint32_t)(record.sum >> 32));
+        for (int i = 0; i < TIMING_BUCKETS; i++) {
+            pos = put_32(pos, record.histogram[i]);
+        }
+    }
+
+    uint16_t sum = checksum(buffer, pos - buffer);
+    *pos++ = sum;
+    *pos++ = sum >> 8;
+    return pos - buffer;
+}
+
+
+bool timing_decode(const uint8_t *buffer, uint32_t size, timing_record_t records[TIMING_STAGES],
+                   uint32_t *clock_hz, uint32_t *elapsed_ms, uint32_t *deadline_us) {
+    if (size < TIMING_RECORD_SIZE || memcmp(buffer, MAGIC, 4) ||
+        buffer[4] != VERSION || buffer[5] != TIMING_STAGES || buffer[6] != TIMING_BUCKETS) {
+        return false;
+    }
+    uint16_t sum = buffer[TIMING_RECORD_SIZE - 2] | buffer[TIMING_RECORD_SIZE - 1] << 8;
+    if (checksum(buffer, TIMING_RECORD_SIZE - 2) != sum) return false;
+
+    const uint8_t *pos = get_32(buffer + 8, clock_hz);
+    pos = get_32(pos, elapsed_ms);
+    pos = get_32(pos, deadline_us);
+    for (int stage = 0; stage < TIMING_STAGES; stage++) {
+        timing_record_t *record = &records[stage];
+        uint32_t low, high;
+        pos = get_32(pos, &record->count);
+        pos = get_32(pos, &record->min);
+        pos = get_32(pos, &record->max);
+        pos = get_32(pos, &low);
+        pos = get_32(pos, &high);
+        record->sum = (uint64_t)high << 32 | low;
+        for (int i = 0; i < TIMING_BUCKETS; i++) {
+            pos = get_32(pos, &record->histogram[i]);
+        }
+        record->generation = 0;
+    }
+    return *clock_hz != 0;
+}
+
+
+const char *timing_stage_name(timing_stage_t stage) {
+    return stage < TIMING_STAGES ? _names[stage] : "?";
+}
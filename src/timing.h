@@ -0,0 +1,115 @@
+#ifndef timing_h
+#define timing_h
+
+// Cycle counts of the stages of the audio path, without printf in the hot path.
+// With TIMING defined, TIMING_BEGIN and TIMING_END around a stage add its
+// cycles to count, min, sum, max and a log2 histogram in ram. Without it they
+// compile to nothing. Cycles come from the SysTick of the core that runs the
+// stage, 24 bits at the system clock: stages up to 2^24 cycles (over 100ms)
+// are measured right. Every stage is recorded on one core only, so the records
+// need no lock. The host counts nanoseconds of its monotonic clock instead.
+// timing_encode() packs all records into one binary record, the host tool
+// timing-report turns it into a table. On the pico main.c sends it to stdio
+// for a 't' on the console, an 'r' restarts the records.
+// Waits, e.g. from a free i2s buffer to its refill on the other core, are
+// taken with the microsecond timer both cores share and recorded in cycles too.
+//
+// Record, little endian: "PTIM", version, stages, buckets, 0 (u8 each),
+// clock hz (u32), ms since the records started (u32), deadline of the
+// refill in us (u32, what the output buffers cover, 0 if unknown), then per stage
+// count, min, max (u32), sum (u64) and the histogram (u32 each),
+// last a checksum (u16, sum of all bytes before it).
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+typedef enum {
+    TIMING_MEDIA,     // media packet handler, bluetooth side
+    TIMING_EVENT,     // a2dp event handler, bluetooth side
+    TIMING_FILL,      // refill of one i2s buffer, with decode, volume and resample of what it takes
+    TIMING_DECODE,    // sbc frames, aptx chunk or aac access unit. Includes volume and resample
+                      // with btstack's sbc decoder, it hands out the audio from within
+    TIMING_VOLUME,    // of one decoded piece
+    TIMING_RESAMPLE,  // of one decoded piece
+    TIMING_HCI,       // hci event handler, bluetooth side
+    TIMING_AVRCP,     // avrcp event handlers, bluetooth side
+    TIMING_REFILL_WAIT,  // from the dma irq freeing an i2s buffer until its refill starts
+    TIMING_LOOP_LATE,    // a run loop timer behind its time, how long handlers hold up the loop
+    TIMING_STAGES
+} timing_stage_t;
+
+#define TIMING_BUCKETS      25  // bucket n counts 2^(n-1) up to 2^n - 1 cycles, the last also more
+#define TIMING_RECORD_SIZE  (20 + TIMING_STAGES * (20 + 4 * TIMING_BUCKETS) + 2)
+
+typedef struct {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+    uint32_t histogram[TIMING_BUCKETS];
+    uint32_t generation;  // records restarted since, cleared by the recording core
+} timing_record_t;
+
+
+#ifdef __arm__
+#include "hardware/structs/systick.h"
+
+#define TIMING_CYCLE_MASK 0xFFFFFF
+
+// SysTick counts down, negated it counts up
+static inline uint32_t timing_now(void) {
+    return -systick_hw->cvr;
+}
+#else
+#include <time.h>
+
+#define TIMING_CYCLE_MASK 0xFFFFFFFF
+
+static inline uint32_t timing_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)((uint64_t)now.tv_sec * 1000000000 + now.tv_nsec);
+}
+#endif
+
+
+#ifdef TIMING
+#define TIMING_BEGIN(stage)  uint32_t timing_start_##stage = timing_now()
+#define TIMING_END(stage)    timing_add(stage, (timing_now() - timing_start_##stage) & TIMING_CYCLE_MASK)
+#define TIMING_ADD_US(stage, us)  timing_add_us(stage, us)
+#else
+#define TIMING_BEGIN(stage)
+#define TIMING_END(stage)
+#define TIMING_ADD_US(stage, us)
+#endif
+
+
+// start the cycle counter of the calling core and the records
+void timing_init(void);
+
+// start the cycle counter of the calling core, for the other core
+void timing_init_core(void);
+
+// forget all records, they restart on their next stage
+void timing_reset(void);
+
+void timing_add(timing_stage_t stage, uint32_t cycles);
+
+// a wait in microseconds, recorded in cycles
+void timing_add_us(timing_stage_t stage, uint32_t us);
+
+// the longest a refill may wait and take before i2s runs out of audio
+void timing_set_deadline_us(uint32_t us);
+
+// the binary record of all stages, returns its size, 0 if it does not fit.
+// Stages running meanwhile on the other core may leave a record a stage off
+uint32_t timing_encode(uint8_t *buffer, uint32_t size);
+
+// the stages of a binary record, false if it is no valid record
+bool timing_decode(const uint8_t *buffer, uint32_t size, timing_record_t records[TIMING_STAGES],
+                   uint32_t *clock_hz, uint32_t *elapsed_ms, uint32_t *deadline_us);
+
+const char *timing_stage_name(timing_stage_t stage);
+
+#endif
@@ -0,0 +1,115 @@
+#include "trace.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "hardware/watchdog.h"
+#include "pico/time.h"
+
+#ifdef __arm__
+#include "pico/platform.h"
+#else
+#define __uninitialized_ram(name) name  // the host has no reboot to survive
+#endif
+
+
+#define MAGIC 0x54524331  // "TRC1"
+
+
+static trace_t __uninitialized_ram(_trace);
+static trace_t _previous;
+static bool _has_previous = false;
+
+static const char *_names[TRACE_EVENTS] = {
+    [TRACE_BOOT]          = "boot",
+    [TRACE_FATAL]         = "fatal",
+    [TRACE_HCI_STATE]     = "hci_state",
+    [TRACE_CONNECTED]     = "connected",
+    [TRACE_DISCONNECTED]  = "disconnected",
+    [TRACE_PAGE]          = "page",
+    [TRACE_A2DP]          = "a2dp",
+    [TRACE_STREAM_FAILED] = "stream_failed",
+    [TRACE_AVRCP]         = "avrcp",
+    [TRACE_BITPOOL]       = "bitpool",
+    [TRACE_UNDERRUN]      = "underrun",
+    [TRACE_REBUFFERED]    = "rebuffered",
+    [TRACE_OVER_BUDGET]   = "over_budget",
+};
+
+static const char *_sides[TRACE_SIDES] = { "bt", "audio" };
+
+
+void trace_init(void) {
+    _has_previous = _trace.magic == MAGIC;
+    uint32_t boots = 1;
+    if (_has_previous) {
+        _previous = _trace;
+        boots = _previous.boots + 1;
+    }
+
+    memset(&_trace, 0, sizeof(_trace));
+    _trace.boots = boots;
+    _trace.magic = MAGIC;
+    trace_bt(TRACE_BOOT, watchdog_caused_reboot(), boots > UINT16_MAX ? UINT16_MAX : boots);
+}
+
+
+static void add(trace_ring_t *ring, trace_event_t event, uint8_t arg8, uint16_t arg16) {
+    uint32_t count = ring->count;
+    ring->entries[count % TRACE_RING_ENTRIES] = (trace_entry_t){ time_us_32(), event, arg8, arg16 };
+    ring->count = count + 1;
+}
+
+
+void trace_bt(trace_event_t event, uint8_t arg8, uint16_t arg16) {
+    add(&_trace.rings[TRACE_SIDE_BT], event, arg8, arg16);
+}
+
+
+void trace_audio(trace_event_t event, uint8_t arg8, uint16_t arg16) {
+    add(&_trace.rings[TRACE_SIDE_AUDIO], event, arg8, arg16);
+}
+
+
+bool trace_has_previous(void) {
+    return _has_previous;
+}
+
+
+// merged by time, the rings are in order each
+void trace_print(bool previous) {
+    if (previous && !_has_previous) {
+        printf("no trace from before the reboot\n");
+        return;
+    }
+    // read in place, a copy would not fit the stack. Entries written while printing are
+    // left out, this boot's oldest may be overwritten by then
+    const trace_t *trace = previous ? &_previous : &_trace;
+    uint32_t next[TRACE_SIDES];
+    uint32_t end[TRACE_SIDES];
+    uint32_t total = 0;
+    for (int side = 0; side < TRACE_SIDES; side++) {
+        end[side] = trace->rings[side].count;
+        next[side] = end[side] > TRACE_RING_ENTRIES ? end[side] - TRACE_RING_ENTRIES : 0;
+        total += end[side] - next[side];
+    }
+
+    printf("trace of %s, boot %u since power on, %u events\n", previous ? "the boot before" : "this boot",
+        (unsigned)trace->boots, (unsigned)total);
+    while (total--) {
+        int oldest = -1;
+        const trace_entry_t *entry = NULL;
+        for (int side = 0; side < TRACE_SIDES; side++) {
+            const trace_ring_t *ring = &trace->rings[side];
+            if (next[side] == end[side]) continue;
+            const trace_entry_t *candidate = &ring->entries[next[side] % TRACE_RING_ENTRIES];
+            if (!entry || candidate->time_us < entry->time_us) {
+                entry = candidate;
+                oldest = side;
+            }
+        }
+        next[oldest]++;
+        printf("%6u.%06u %-5s %-13s %3u %5u\n", (unsigned)(entry->time_us / 1000000), (unsigned)(entry->time_us % 1000000),
+            _sides[oldest], entry->event < TRACE_EVENTS ? _names[entry->event] : "?", entry->arg8, entry->arg16);
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef trace_h
+#define trace_h
+
+// Post-mortem trace: the last events of the bluetooth and the audio side in
+// rings of compact binary entries, in ram the runtime does not initialize.
+// A watchdog reboot keeps it, so the next boot can still show what led to
+// it (a power cycle does not). Each side writes its own ring, so no locks:
+// bluetooth events from the run loop, audio events from the decoder side.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+#define TRACE_RING_ENTRIES 256  // per side, 2KB each
+
+
+typedef enum {
+    TRACE_BOOT,          // arg8 1 after a watchdog reboot, arg16 boots since power on
+    TRACE_FATAL,         // unrecoverable, the watchdog reboots
+    TRACE_HCI_STATE,     // arg8 the btstack state
+    TRACE_CONNECTED,     // arg8 status, arg16 connection handle
+    TRACE_DISCONNECTED,  // arg8 reason, arg16 connection handle
+    TRACE_PAGE,          // reconnect, arg8 which of the remembered sources, most recent first
+    TRACE_A2DP,          // arg8 the a2dp subevent, arg16 a2dp cid
+    TRACE_STREAM_FAILED, // arg8 status of the stream establishment
+    TRACE_AVRCP,         // arg8 the avrcp subevent, arg16 avrcp cid, or the volume it sets
+    TRACE_BITPOOL,       // arg8 max bitpool asked of the source
+    TRACE_UNDERRUN,      // audio ran out, arg16 audio frames to buffer before playing again
+    TRACE_REBUFFERED,    // playing again, arg16 audio frames buffered
+    TRACE_OVER_BUDGET,   // decoding took longer than the audio it made
+    TRACE_EVENTS
+} trace_event_t;
+
+typedef struct {
+    uint32_t time_us;  // since boot
+    uint8_t  event;
+    uint8_t  arg8;
+    uint16_t arg16;
+} trace_entry_t;
+
+typedef struct {
+    volatile uint32_t count;  // entries written, free running, the writer's own
+    trace_entry_t entries[TRACE_RING_ENTRIES];
+} trace_ring_t;
+
+typedef enum {
+    TRACE_SIDE_BT,
+    TRACE_SIDE_AUDIO,
+    TRACE_SIDES
+} trace_side_t;
+
+typedef struct {
+    uint32_t magic;  // the ram holds a trace
+    uint32_t boots;  // since power on
+    trace_ring_t rings[TRACE_SIDES];
+} trace_t;
+
+
+// first thing on boot: keeps the trace from before the reboot, if any, and starts a new one
+void trace_init(void);
+
+// bluetooth side
+void trace_bt(trace_event_t event, uint8_t arg8, uint16_t arg16);
+
+// decoder side
+void trace_audio(trace_event_t event, uint8_t arg8, uint16_t arg16);
+
+// there is a trace from before the reboot
+bool trace_has_previous(void);
+
+// oldest first on stdout, both sides by time, of this boot or the one before
+void trace_print(bool previous);
+
+#endif
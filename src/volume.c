@@ -0,0 +1,98 @@
+#include "volume.h"
+
+#include <math.h>
+#include <string.h>
+
+#ifdef __ARM_FEATURE_DSP
+#include <arm_acle.h>
+#endif
+
+
+static inline int16_t scale(int16_t sample, int32_t volume) {
+    int32_t scaled = (volume * sample) >> VOLUME_SHIFT;
+    if (scaled < INT16_MIN) return INT16_MIN;
+    if (scaled > INT16_MAX) return INT16_MAX;
+    return (int16_t)scaled;
+}
+
+
+#ifdef __ARM_FEATURE_DSP
+
+// two samples of a word: smulbb/smultb, ssat with the shift folded in, pkhbt
+static inline uint32_t scale2(uint32_t pair, int32_t volume) {
+    int32_t low = __ssat(__smulbb((int32_t)pair, volume) >> VOLUME_SHIFT, 16);
+    int32_t high = __ssat(__smultb((int32_t)pair, volume) >> VOLUME_SHIFT, 16);
+    return (uint16_t)low | ((uint32_t)high << 16);
+}
+
+// words via memcpy: decoder output is only halfword aligned, the m33 loads it unaligned just as fast
+static inline uint32_t load2(const int16_t *src) {
+    uint32_t pair;
+    memcpy(&pair, src, sizeof(pair));
+    return pair;
+}
+
+static inline void store2(int16_t *dst, uint32_t pair) {
+    memcpy(dst, &pair, sizeof(pair));
+}
+
+#endif
+
+
+void volume_apply(int16_t *dst, const int16_t *src, uint32_t num_samples, int32_t volume) {
+    if (volume == VOLUME_UNITY) {
+        if (dst != src) memmove(dst, src, num_samples * sizeof(int16_t));
+        return;
+    }
+
+#ifdef __ARM_FEATURE_DSP
+    for (; num_samples >= 4; num_samples -= 4, src += 4, dst += 4) {
+        uint32_t first = load2(src);
+        uint32_t second = load2(src + 2);
+        store2(dst, scale2(first, volume));
+        store2(dst + 2, scale2(second, volume));
+    }
+#endif
+    for (; num_samples; num_samples--) {
+        *dst++ = scale(*src++, volume);
+    }
+}
+
+
+void volume_apply_mono_to_stereo(int16_t *dst, const int16_t *src, uint32_t num_frames, int32_t volume) {
+    if (volume == VOLUME_UNITY) {
+        // does not fit the halfword multiplies, and needs none
+        for (; num_frames; num_frames--, dst += 2) {
+            dst[0] = dst[1] = *src++;
+        }
+        return;
+    }
+
+#ifdef __ARM_FEATURE_DSP
+    for (; num_frames >= 2; num_frames -= 2, src += 2, dst += 4) {
+        uint32_t scaled = scale2(load2(src), volume);
+        store2(dst, (scaled & 0xffff) * 0x10001u);
+        store2(dst + 2, (scaled >> 16) * 0x10001u);
+    }
+#endif
+    for (; num_frames; num_frames--, dst += 2) {
+        int16_t sample = scale(*src++, volume);
+        dst[0] = sample;
+        dst[1] = sample;
+    }
+}
+
+
+// only called from the decoder side, which keeps the last mapping
+int32_t volume_from_avrcp(uint8_t avrcp_volume) {
+    static uint8_t last_volume = 127;
+    static int32_t last_gain = VOLUME_UNITY;
+
+    if (avrcp_volume > 127) avrcp_volume = 127;
+    if (avrcp_volume != last_volume) {
+        float db = -(127 - avrcp_volume) * (VOLUME_RANGE_DB / 126.0f);
+        last_gain = avrcp_volume ? (int32_t)(VOLUME_UNITY * powf(10.0f, db / 20.0f) + 0.5f) : 0;
+        last_volume = avrcp_volume;
+    }
+    return last_gain;
+}
@@ -0,0 +1,31 @@
+#ifndef volume_h
+#define volume_h
+
+// Volume scaling of 16 bit pcm: sample * volume >> 15 with saturation,
+// so 32768 is unity gain. On the Cortex-M33 of the pico 2 two samples are
+// processed per word with the dsp halfword multiplies and ssat, elsewhere
+// (pico w cortex-m0+, host) it is plain c. Both give the same result as
+// scaling every sample on its own.
+
+#include <stdint.h>
+
+
+#define VOLUME_SHIFT  15
+#define VOLUME_UNITY  (1 << VOLUME_SHIFT)
+
+#ifndef VOLUME_RANGE_DB
+#define VOLUME_RANGE_DB  60   // from avrcp volume 127 down to 1
+#endif
+
+
+// gain for the avrcp absolute volume 0..127 on a log taper: 127 is unity,
+// every step below is VOLUME_RANGE_DB / 126 dB quieter down to 1, 0 mutes
+int32_t volume_from_avrcp(uint8_t avrcp_volume);
+
+// num_samples values, dst may be src for in place scaling. volume 0..32767 or VOLUME_UNITY
+void volume_apply(int16_t *dst, const int16_t *src, uint32_t num_samples, int32_t volume);
+
+// num_frames mono values to interleaved stereo in the same pass, dst must not overlap src
+void volume_apply_mono_to_stereo(int16_t *dst, const int16_t *src, uint32_t num_frames, int32_t volume);
+
+#endif